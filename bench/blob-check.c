@@ -0,0 +1,210 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/* blob-check: the SWAR unpackers behind /grid/led/frame and
+ * /grid/led/level/frame (src/serialosc-device/led_blob.c) against the
+ * obvious one-LED-at-a-time decoder, for every on/off byte, every value
+ * of every byte of a level word, random words, and whole random frames
+ * at every grid size, plus the frame size check. prints what doesn't
+ * match, and one JSON summary line:
+ *
+ *   {"bench": "blob_check", "checks": N, "failures": N}
+ *
+ * and exits non-zero if anything failed. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <serialosc/led.h>
+
+static unsigned long checks, failures;
+
+/* the reference: LED i of a blob, a level per nibble (high nibble first)
+ * or an on/off bit per LED (LSB first) */
+static uint8_t
+ref_level(const uint8_t *data, size_t i)
+{
+	return (data[i / 2] >> ((i & 1) ? 0 : 4)) & 0x0F;
+}
+
+static uint8_t
+ref_bit(const uint8_t *data, size_t i)
+{
+	return ((data[i / 8] >> (i % 8)) & 1) ? SOSC_LED_LEVEL_MAX : 0;
+}
+
+static void
+check8(const char *what, const uint8_t *data, uint64_t got, int levels)
+{
+	uint8_t want;
+	int i;
+
+	checks++;
+
+	for (i = 0; i < 8; i++) {
+		want = levels ? ref_level(data, i) : ref_bit(data, i);
+
+		if ((uint8_t) (got >> (i * 8)) == want)
+			continue;
+
+		failures++;
+		fprintf(stderr, "%s: LED %d of %02x %02x %02x %02x is %d, not %d\n",
+		        what, i, data[0], levels ? data[1] : 0, levels ? data[2] : 0,
+		        levels ? data[3] : 0, (uint8_t) (got >> (i * 8)), want);
+		return;
+	}
+}
+
+static void
+check_bits(void)
+{
+	uint8_t b;
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		b = i;
+		check8("bits8", &b, sosc_led_unpack_bits8(b), 0);
+	}
+}
+
+/* every value in each byte position, with the rest zero, all ones, and
+ * random, which between them put each nibble (and each odd, low nibble
+ * in particular) next to every kind of neighbour. */
+static void
+check_levels(void)
+{
+	static const uint8_t fill[] = {0x00, 0xFF, 0x0F, 0xF0};
+	uint8_t w[4];
+	int pos, v, f, i;
+
+	for (pos = 0; pos < 4; pos++)
+		for (v = 0; v < 256; v++) {
+			for (f = 0; f < sizeof(fill) + 1; f++) {
+				for (i = 0; i < 4; i++)
+					w[i] = (f < sizeof(fill)) ? fill[f] : rand();
+
+				w[pos] = v;
+				check8("levels8", w, sosc_led_unpack_levels8(w), 1);
+			}
+		}
+
+	for (i = 0; i < 1000000; i++) {
+		w[0] = rand(); w[1] = rand(); w[2] = rand(); w[3] = rand();
+		check8("levels8", w, sosc_led_unpack_levels8(w), 1);
+	}
+}
+
+/* decode a whole random frame the way led.c does, 8 LEDs at a time, and
+ * compare every LED */
+static void
+check_frame(unsigned cols, unsigned rows, int levels)
+{
+	uint8_t data[SOSC_LED_COLS_MAX * SOSC_LED_ROWS_MAX / 2];
+	size_t nbytes, i, led;
+	unsigned x, y, j;
+	const uint8_t *p;
+	uint64_t got;
+
+	nbytes = sosc_led_frame_size(cols, rows, levels);
+
+	for (i = 0; i < nbytes; i++)
+		data[i] = rand();
+
+	checks++;
+
+	for (p = data, y = 0; y < rows; y++)
+		for (x = 0; x < cols; x += 8) {
+			if (levels) {
+				got = sosc_led_unpack_levels8(p);
+				p += 4;
+			} else
+				got = sosc_led_unpack_bits8(*p++);
+
+			for (j = 0; j < 8; j++) {
+				led = y * cols + x + j;
+
+				if ((uint8_t) (got >> (j * 8))
+				    == (levels ? ref_level(data, led) : ref_bit(data, led)))
+					continue;
+
+				failures++;
+				fprintf(stderr, "%s frame %ux%u: LED %u,%u is wrong\n",
+				        levels ? "level" : "on/off", cols, rows, x + j, y);
+				return;
+			}
+		}
+
+	if ((size_t) (p - data) != nbytes) {
+		failures++;
+		fprintf(stderr, "%s frame %ux%u: read %zu of %zu bytes\n",
+		        levels ? "level" : "on/off", cols, rows,
+		        (size_t) (p - data), nbytes);
+	}
+}
+
+/* frames are only accepted for whole bytes per row, and then are exactly
+ * a nibble or a bit per LED */
+static void
+check_sizes(void)
+{
+	unsigned cols, rows;
+	size_t want;
+	int levels;
+
+	for (cols = 0; cols <= SOSC_LED_COLS_MAX + 8; cols++)
+		for (rows = 0; rows <= SOSC_LED_ROWS_MAX; rows++)
+			for (levels = 0; levels < 2; levels++) {
+				want = (!cols || !rows || (cols % 8)) ? 0
+					: levels ? (cols * rows) / 2 : (cols * rows) / 8;
+
+				checks++;
+
+				if (sosc_led_frame_size(cols, rows, levels) == want)
+					continue;
+
+				failures++;
+				fprintf(stderr, "frame size %ux%u (%s): %zu, not %zu\n",
+				        cols, rows, levels ? "levels" : "on/off",
+				        sosc_led_frame_size(cols, rows, levels), want);
+			}
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned cols, rows;
+	int i;
+
+	srand(1);
+
+	check_bits();
+	check_levels();
+	check_sizes();
+
+	for (cols = 8; cols <= SOSC_LED_COLS_MAX; cols += 8)
+		for (rows = 1; rows <= SOSC_LED_ROWS_MAX; rows++)
+			for (i = 0; i < 100; i++) {
+				check_frame(cols, rows, 0);
+				check_frame(cols, rows, 1);
+			}
+
+	printf("{\"bench\": \"blob_check\", \"checks\": %lu, \"failures\": %lu}\n",
+	       checks, failures);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
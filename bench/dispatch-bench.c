@@ -0,0 +1,299 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/* dispatch-bench: the per-message cost of finding and calling an OSC
+ * method, through liblo's method list (how serialosc-device used to do
+ * it, with every method registered under its full path) and through the
+ * device's own hash table (osc/dispatch.c). both get the same set of
+ * methods as the device registers and the same encoded datagrams, and
+ * the handlers do nothing. liblo is the baseline: each message is run
+ * through it first, then through the table, then the two are compared.
+ * prints one JSON object per line:
+ *
+ *   {"bench": "dispatch", "path": ..., "impl": "liblo" | "table",
+ *    "iterations": N, "ns_per_msg": ...}
+ *   {"bench": "dispatch", "path": ..., "liblo_ns_per_msg": ...,
+ *    "table_ns_per_msg": ..., "speedup": ...} */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OPTPARSE_IMPLEMENTATION
+#define OPTPARSE_API static
+#include <optparse/optparse.h>
+
+#include <lo/lo.h>
+
+#include <serialosc/platform.h>
+#include <serialosc/osc_dispatch.h>
+
+#include "osc_min.h"
+
+#define PREFIX "/bench"
+
+/* what serialosc-device registers, as of this writing */
+static const struct {
+	const char *path;
+	const char *types;
+} methods[] = {
+	{"grid/led/set", "iii"},
+	{"grid/led/all", "i"},
+	{"grid/led/map", "iiiiiiiiii"},
+	{"grid/led/col", NULL},
+	{"grid/led/row", NULL},
+	{"grid/led/frame", "b"},
+	{"grid/led/intensity", "i"},
+	{"grid/led/level/set", "iii"},
+	{"grid/led/level/all", "i"},
+	{"grid/led/level/map", "ii"
+		"iiiiiiiiiiiiiiiiiiiiiiiiiiiiiiii"
+		"iiiiiiiiiiiiiiiiiiiiiiiiiiiiiiii"},
+	{"grid/led/level/frame", "b"},
+	{"grid/led/level/frame", "ib"},
+	{"grid/led/level/delta", "ib"},
+	{"grid/led/commit", ""},
+	{"grid/led/level/col", NULL},
+	{"grid/led/level/row", NULL},
+	{"ring/set", "iii"},
+	{"ring/all", "ii"},
+	{"ring/map", "i"
+		"iiiiiiiiiiiiiiiiiiiiiiiiiiiiiiii"
+		"iiiiiiiiiiiiiiiiiiiiiiiiiiiiiiii"},
+	{"ring/range", "iiii"},
+	{"ring/commit", ""},
+	{"ring/intensity", "i"},
+	{"tilt/set", "ii"},
+
+#define INFO(prop) \
+	{"/sys/info/" prop, "si"}, {"/sys/info/" prop, "i"}, \
+	{"/sys/info/" prop, ""}
+	INFO("id"), INFO("size"), INFO("host"), INFO("port"), INFO("prefix"),
+	INFO("rotation"),
+#undef INFO
+
+	{"/sys/info", "si"}, {"/sys/info", "i"}, {"/sys/info", ""},
+	{"/sys/stats", "si"}, {"/sys/stats", "i"}, {"/sys/stats", ""},
+	{"/sys/cable", "s"},
+	{"/sys/rotation", "i"},
+	{"/sys/port", "i"},
+	{"/sys/host", "s"},
+	{"/sys/prefix", "s"},
+	{"/sys/bundle", "i"},
+	{"/sys/refresh", "i"},
+	{"/sys/backbuffer", "i"}
+};
+
+#define NMETHODS (sizeof(methods) / sizeof(*methods))
+
+static volatile unsigned long calls;
+
+static int
+handler(const char *path, const char *types, lo_arg **argv, int argc,
+        lo_message msg, void *user_data)
+{
+	calls++;
+	return 0;
+}
+
+static void
+lo_error(int num, const char *error_msg, const char *path)
+{
+	fprintf(stderr, "dispatch-bench: lo server error %d in %s: %s\n",
+	        num, path, error_msg);
+}
+
+struct message {
+	const char *name;
+	uint8_t buf[512];
+	size_t nbytes;
+};
+
+static void
+build_messages(struct message *msgs, int *nmsgs)
+{
+	int32_t ints[66] = {0};
+	int n = 0;
+
+	msgs[n].name = PREFIX "/grid/led/set";
+	msgs[n].nbytes = osc_build(msgs[n].buf, sizeof(msgs[n].buf),
+	                           msgs[n].name, "iii", 3, 4, 1);
+	n++;
+
+	msgs[n].name = PREFIX "/grid/led/level/map";
+	msgs[n].nbytes = osc_build_ints(msgs[n].buf, sizeof(msgs[n].buf),
+	                                msgs[n].name, ints, 66);
+	n++;
+
+	msgs[n].name = PREFIX "/grid/led/row";
+	msgs[n].nbytes = osc_build(msgs[n].buf, sizeof(msgs[n].buf),
+	                           msgs[n].name, "iiii", 0, 3, 255, 255);
+	n++;
+
+	msgs[n].name = PREFIX "/ring/set";
+	msgs[n].nbytes = osc_build(msgs[n].buf, sizeof(msgs[n].buf),
+	                           msgs[n].name, "iii", 0, 12, 15);
+	n++;
+
+	msgs[n].name = "/sys/info";
+	msgs[n].nbytes = osc_build(msgs[n].buf, sizeof(msgs[n].buf),
+	                           msgs[n].name, "");
+	n++;
+
+	*nmsgs = n;
+}
+
+typedef int (*dispatch_fn_t)(void *ctx, void *data, size_t nbytes);
+
+static int
+dispatch_liblo(void *ctx, void *data, size_t nbytes)
+{
+	return lo_server_dispatch_data(ctx, data, nbytes);
+}
+
+static int
+dispatch_table(void *ctx, void *data, size_t nbytes)
+{
+	return osc_dispatch_data(ctx, data, nbytes);
+}
+
+/* both decode in place (liblo copies first, the table doesn't), so each
+ * pass gets a fresh copy of the datagram, and the copy is in both sets of
+ * numbers */
+static double
+run(const char *impl, dispatch_fn_t fn, void *ctx, struct message *msg,
+    unsigned long iterations)
+{
+	uint8_t scratch[sizeof(msg->buf)];
+	uint64_t start, elapsed;
+	unsigned long i, expected;
+	double ns;
+
+	expected = calls + iterations;
+	start = sosc_now_usec();
+
+	for (i = 0; i < iterations; i++) {
+		memcpy(scratch, msg->buf, msg->nbytes);
+		fn(ctx, scratch, msg->nbytes);
+	}
+
+	elapsed = sosc_now_usec() - start;
+
+	if (calls != expected)
+		fprintf(stderr, "dispatch-bench: %s missed %lu calls to %s\n",
+		        impl, expected - calls, msg->name);
+
+	ns = (elapsed * 1000.) / (double) iterations;
+
+	printf("{\"bench\": \"dispatch\", \"path\": \"%s\", \"impl\": \"%s\", "
+	       "\"iterations\": %lu, \"ns_per_msg\": %.1f}\n",
+	       msg->name, impl, iterations, ns);
+	fflush(stdout);
+
+	return ns;
+}
+
+static void
+compare(struct message *msg, double liblo_ns, double table_ns)
+{
+	printf("{\"bench\": \"dispatch\", \"path\": \"%s\", "
+	       "\"liblo_ns_per_msg\": %.1f, \"table_ns_per_msg\": %.1f, "
+	       "\"speedup\": %.2f}\n",
+	       msg->name, liblo_ns, table_ns,
+	       table_ns > 0. ? liblo_ns / table_ns : 0.);
+	fflush(stdout);
+}
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -n, --iterations N     messages to dispatch per path and "
+			"implementation [1000000]\n", argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct sosc_osc_dispatch table;
+	struct message msgs[8];
+	unsigned long iterations = 1000000;
+	double liblo_ns, table_ns;
+	char *full;
+	lo_server srv;
+	size_t i;
+	int opt, nmsgs;
+
+	struct optparse options;
+	struct optparse_long longopts[] = {
+		{"iterations", 'n', OPTPARSE_REQUIRED},
+		{"help",       'h', OPTPARSE_NONE},
+		{0}
+	};
+
+	optparse_init(&options, argv);
+
+	while ((opt = optparse_long(&options, longopts, NULL)) != -1) {
+		switch (opt) {
+		case 'n': iterations = strtoul(options.optarg, NULL, 10); break;
+
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+
+		default:
+			fprintf(stderr, "%s: %s\n", argv[0], options.errmsg);
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!(srv = lo_server_new(NULL, lo_error))) {
+		fprintf(stderr, "dispatch-bench: couldn't create a lo_server\n");
+		return EXIT_FAILURE;
+	}
+
+	osc_dispatch_init(&table);
+	osc_dispatch_set_prefix(&table, PREFIX);
+
+	for (i = 0; i < NMETHODS; i++) {
+		osc_dispatch_add(&table, methods[i].path, methods[i].types,
+		                 handler, NULL);
+
+		if (methods[i].path[0] == '/')
+			full = s_strdup(methods[i].path);
+		else
+			full = s_asprintf(PREFIX "/%s", methods[i].path);
+
+		lo_server_add_method(srv, full, methods[i].types, handler, NULL);
+		s_free(full);
+	}
+
+	build_messages(msgs, &nmsgs);
+
+	for (opt = 0; opt < nmsgs; opt++) {
+		liblo_ns = run("liblo", dispatch_liblo, srv, &msgs[opt],
+		               iterations);
+		table_ns = run("table", dispatch_table, &table, &msgs[opt],
+		               iterations);
+		compare(&msgs[opt], liblo_ns, table_ns);
+	}
+
+	lo_server_free(srv);
+	return EXIT_SUCCESS;
+}
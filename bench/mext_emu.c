@@ -0,0 +1,330 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <serialosc/platform.h>
+
+#include "mext_emu.h"
+
+/* the bits of the mext protocol libmonome uses with a grid. packet
+ * lengths include the header byte. */
+
+static int
+host_packet_len(uint8_t hdr)
+{
+	switch (hdr) {
+	case 0x00: /* system query */
+	case 0x01: /* get id */
+	case 0x03: /* get grid offsets */
+	case 0x05: /* get grid size */
+	case 0x07: /* get addr */
+	case 0x0F: /* get firmware version */
+	case 0x12: /* led all off */
+	case 0x13: /* led all on */
+		return 1;
+
+	case 0x17: /* led intensity */
+	case 0x19: /* led level all */
+	case 0x82: /* tilt enable */
+	case 0x83: /* tilt disable */
+		return 2;
+
+	case 0x06: /* set grid size */
+	case 0x08: /* set addr */
+	case 0x10: /* led off */
+	case 0x11: /* led on */
+		return 3;
+
+	case 0x04: /* set grid offset */
+	case 0x15: /* led row */
+	case 0x16: /* led col */
+	case 0x18: /* led level set */
+		return 4;
+
+	case 0x1B: /* led level row */
+	case 0x1C: /* led level col */
+		return 7;
+
+	case 0x14: /* led map */
+		return 11;
+
+	case 0x02: /* set id */
+		return 33;
+
+	case 0x1A: /* led level map */
+		return 35;
+
+	default:
+		return -1;
+	}
+}
+
+static void
+reply(struct mext_emu *emu, const uint8_t *buf, size_t nbytes)
+{
+	if (write(emu->fd, buf, nbytes) < 0)
+		perror("mext_emu: write");
+}
+
+static void
+put(struct mext_emu *emu, unsigned int x, unsigned int y, unsigned int level)
+{
+	if (x < MEXT_EMU_MAX && y < MEXT_EMU_MAX)
+		emu->led[y][x] = level & 0xF;
+}
+
+static void
+all(struct mext_emu *emu, unsigned int level)
+{
+	memset(emu->led, level & 0xF, sizeof(emu->led));
+}
+
+static void
+handle_system(struct mext_emu *emu, const uint8_t *p)
+{
+	uint8_t buf[33];
+
+	switch (p[0]) {
+	case 0x00:
+		/* one led-grid section, one key-grid section */
+		reply(emu, (uint8_t []) {0x00, 0x01, 0x01}, 3);
+		reply(emu, (uint8_t []) {0x00, 0x02, 0x01}, 3);
+		break;
+
+	case 0x01:
+		memset(buf, 0, sizeof(buf));
+		buf[0] = 0x01;
+		memcpy(buf + 1, "serialosc-bench", 15);
+		reply(emu, buf, 33);
+		break;
+
+	case 0x03:
+		reply(emu, (uint8_t []) {0x02, 0x00, 0x00, 0x00}, 4);
+		break;
+
+	case 0x05:
+		reply(emu, (uint8_t []) {0x03, emu->cols, emu->rows}, 3);
+		break;
+
+	case 0x07:
+		reply(emu, (uint8_t []) {0x04, 0x00, 0x00}, 3);
+		break;
+
+	case 0x0F:
+		memcpy(buf, "\x0F" "bench000", 9);
+		reply(emu, buf, 9);
+		break;
+	}
+}
+
+static void
+handle_packet(struct mext_emu *emu, const uint8_t *p)
+{
+	unsigned int x = p[1], y = p[2], i, j;
+
+	if (p[0] < 0x10) {
+		handle_system(emu, p);
+		return;
+	}
+
+	switch (p[0]) {
+	case 0x10: put(emu, x, y, 0);  break;
+	case 0x11: put(emu, x, y, 15); break;
+	case 0x12: all(emu, 0);  break;
+	case 0x13: all(emu, 15); break;
+
+	case 0x14:
+		for (j = 0; j < 8; j++)
+			for (i = 0; i < 8; i++)
+				put(emu, x + i, y + j, (p[3 + j] & (1 << i)) ? 15 : 0);
+		break;
+
+	case 0x15:
+		for (i = 0; i < 8; i++)
+			put(emu, x + i, y, (p[3] & (1 << i)) ? 15 : 0);
+		break;
+
+	case 0x16:
+		for (i = 0; i < 8; i++)
+			put(emu, x, y + i, (p[3] & (1 << i)) ? 15 : 0);
+		break;
+
+	case 0x18: put(emu, x, y, p[3]); break;
+	case 0x19: all(emu, p[1]);       break;
+
+	/* levels are packed two to a byte, high nibble first */
+	case 0x1A:
+		for (i = 0; i < 64; i++)
+			put(emu, x + (i % 8), y + (i / 8),
+			    p[3 + i / 2] >> ((i & 1) ? 0 : 4));
+		break;
+
+	case 0x1B:
+		for (i = 0; i < 8; i++)
+			put(emu, x + i, y, p[3 + i / 2] >> ((i & 1) ? 0 : 4));
+		break;
+
+	case 0x1C:
+		for (i = 0; i < 8; i++)
+			put(emu, x, y + i, p[3 + i / 2] >> ((i & 1) ? 0 : 4));
+		break;
+
+	default:
+		/* intensity, tilt: nothing to keep track of */
+		return;
+	}
+
+	emu->led_cmds++;
+}
+
+static size_t
+read_allowance(struct mext_emu *emu, size_t want)
+{
+	uint64_t elapsed, allowed, burst;
+
+	if (!emu->bytes_per_sec)
+		return want;
+
+	elapsed = sosc_now_usec() - emu->throttle_start;
+	allowed = (elapsed * emu->bytes_per_sec) / 1000000;
+
+	/* don't let credit pile up while nobody's writing, a real link
+	 * can't catch up on the time it spent idle */
+	burst = emu->bytes_per_sec / 100 + 64;
+	if (allowed > emu->throttle_bytes + burst)
+		emu->throttle_bytes = allowed - burst;
+
+	if (allowed <= emu->throttle_bytes)
+		return 0;
+
+	allowed -= emu->throttle_bytes;
+	return (allowed < want) ? allowed : want;
+}
+
+int
+mext_emu_pump(struct mext_emu *emu)
+{
+	uint8_t buf[4096], *p;
+	uint64_t cmds_before = emu->led_cmds;
+	size_t avail, nbytes;
+	ssize_t n;
+	int len;
+
+	for (;;) {
+		memcpy(buf, emu->pending, emu->npending);
+
+		if (!(nbytes = read_allowance(emu, sizeof(buf) - emu->npending)))
+			break;
+
+		n = read(emu->fd, buf + emu->npending, nbytes);
+
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				break;
+
+			/* EIO once the slave side is closed */
+			return -1;
+		} else if (!n)
+			return -1;
+
+		emu->bytes_in += n;
+		emu->throttle_bytes += n;
+
+		avail = emu->npending + n;
+		p = buf;
+
+		while (avail) {
+			if ((len = host_packet_len(*p)) < 0) {
+				emu->unknown_bytes++;
+				p++;
+				avail--;
+				continue;
+			}
+
+			if (avail < len)
+				break;
+
+			handle_packet(emu, p);
+			p += len;
+			avail -= len;
+		}
+
+		memcpy(emu->pending, p, avail);
+		emu->npending = avail;
+	}
+
+	return emu->led_cmds - cmds_before;
+}
+
+int
+mext_emu_key(struct mext_emu *emu, unsigned int x, unsigned int y, int down)
+{
+	uint8_t buf[3] = {down ? 0x21 : 0x20, x, y};
+
+	return write(emu->fd, buf, sizeof(buf)) == sizeof(buf) ? 0 : -1;
+}
+
+int
+mext_emu_open(struct mext_emu *emu, unsigned int cols, unsigned int rows)
+{
+	struct termios tio;
+	const char *name;
+
+	memset(emu, 0, sizeof(*emu));
+
+	emu->cols = cols;
+	emu->rows = rows;
+
+	if ((emu->fd = posix_openpt(O_RDWR | O_NOCTTY)) < 0) {
+		perror("mext_emu: posix_openpt");
+		return -1;
+	}
+
+	if (grantpt(emu->fd) || unlockpt(emu->fd) || !(name = ptsname(emu->fd))) {
+		perror("mext_emu: setting up pty");
+		goto err;
+	}
+
+	snprintf(emu->slave_path, sizeof(emu->slave_path), "%s", name);
+
+	/* no line discipline getting in the way of binary data */
+	if (!tcgetattr(emu->fd, &tio)) {
+		cfmakeraw(&tio);
+		tcsetattr(emu->fd, TCSANOW, &tio);
+	}
+
+	fcntl(emu->fd, F_SETFL, fcntl(emu->fd, F_GETFL) | O_NONBLOCK);
+
+	emu->throttle_start = sosc_now_usec();
+	return 0;
+
+err:
+	close(emu->fd);
+	return -1;
+}
+
+void
+mext_emu_close(struct mext_emu *emu)
+{
+	close(emu->fd);
+}
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* a mext grid on the master side of a pseudo-terminal. serialosc-device
+ * opens the slave side as if it were the real thing; we answer libmonome's
+ * system queries, keep track of what every LED would be showing, and can
+ * inject key presses. */
+
+#define MEXT_EMU_MAX 16
+
+struct mext_emu {
+	int fd;
+	char slave_path[64];
+
+	unsigned int cols, rows;
+
+	/* [y][x], 0-15 */
+	uint8_t led[MEXT_EMU_MAX][MEXT_EMU_MAX];
+
+	/* a partial packet left over from the last read */
+	uint8_t pending[64];
+	size_t npending;
+
+	/* if non-zero, read no faster than this, to stand in for a real
+	 * serial link */
+	uint64_t bytes_per_sec;
+	uint64_t throttle_start;
+	uint64_t throttle_bytes;
+
+	uint64_t bytes_in;
+	uint64_t led_cmds;
+	uint64_t unknown_bytes;
+};
+
+int  mext_emu_open(struct mext_emu *emu, unsigned int cols, unsigned int rows);
+void mext_emu_close(struct mext_emu *emu);
+
+/* reads and handles whatever is waiting (or as much as the throttle
+ * allows). returns the number of LED commands applied, or -1 once the
+ * other end has gone away. */
+int mext_emu_pump(struct mext_emu *emu);
+
+int mext_emu_key(struct mext_emu *emu, unsigned int x, unsigned int y,
+                 int down);
@@ -0,0 +1,194 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "osc_min.h"
+
+static size_t
+padded(size_t len)
+{
+	return (len + 4) & ~3;
+}
+
+static size_t
+put_str(uint8_t *buf, size_t avail, const char *s)
+{
+	size_t len = strlen(s), size = padded(len);
+
+	if (size > avail)
+		return 0;
+
+	memset(buf, 0, size);
+	memcpy(buf, s, len);
+	return size;
+}
+
+size_t
+osc_build(uint8_t *buf, size_t size, const char *path,
+          const char *types, ...)
+{
+	size_t off, n;
+	uint32_t v;
+	va_list ap;
+	char tags[OSC_MAX_ARGS + 2];
+
+	if (strlen(types) > OSC_MAX_ARGS)
+		return 0;
+
+	tags[0] = ',';
+	strcpy(tags + 1, types);
+
+	if (!(off = put_str(buf, size, path)))
+		return 0;
+
+	if (!(n = put_str(buf + off, size - off, tags)))
+		return 0;
+
+	off += n;
+	va_start(ap, types);
+
+	for (; *types; types++) {
+		switch (*types) {
+		case 'i':
+			if (off + 4 > size)
+				goto err;
+
+			v = htonl((uint32_t) va_arg(ap, int32_t));
+			memcpy(buf + off, &v, 4);
+			off += 4;
+			break;
+
+		case 's':
+			if (!(n = put_str(buf + off, size - off, va_arg(ap, const char *))))
+				goto err;
+
+			off += n;
+			break;
+
+		default:
+			goto err;
+		}
+	}
+
+	va_end(ap);
+	return off;
+
+err:
+	va_end(ap);
+	return 0;
+}
+
+size_t
+osc_build_ints(uint8_t *buf, size_t size, const char *path,
+               const int32_t *args, int nargs)
+{
+	size_t off, n;
+	uint32_t v;
+	int i;
+
+	if (!(off = put_str(buf, size, path)))
+		return 0;
+
+	/* the typetag: a comma, nargs 'i's, padded */
+	n = padded(1 + nargs);
+	if (off + n + (nargs * 4) > size)
+		return 0;
+
+	memset(buf + off, 0, n);
+	buf[off] = ',';
+	memset(buf + off + 1, 'i', nargs);
+	off += n;
+
+	for (i = 0; i < nargs; i++, off += 4) {
+		v = htonl((uint32_t) args[i]);
+		memcpy(buf + off, &v, 4);
+	}
+
+	return off;
+}
+
+static const char *
+get_str(uint8_t *buf, size_t nbytes, size_t *off)
+{
+	const char *s = (const char *) buf + *off;
+	size_t len;
+
+	if (*off >= nbytes)
+		return NULL;
+
+	len = strnlen(s, nbytes - *off);
+	if (*off + len >= nbytes)
+		return NULL;
+
+	*off += padded(len);
+	return s;
+}
+
+int
+osc_parse(uint8_t *buf, size_t nbytes, struct osc_msg *msg)
+{
+	size_t off = 0;
+	uint32_t v;
+	const char *t;
+
+	if (!(msg->path = get_str(buf, nbytes, &off)))
+		return -1;
+
+	if (!(t = get_str(buf, nbytes, &off)) || *t != ',')
+		return -1;
+
+	msg->types = t + 1;
+
+	for (msg->nargs = 0, t++; *t; t++, msg->nargs++) {
+		if (msg->nargs == OSC_MAX_ARGS)
+			return -1;
+
+		switch (*t) {
+		case 'i':
+			if (off + 4 > nbytes)
+				return -1;
+
+			memcpy(&v, buf + off, 4);
+			msg->args[msg->nargs].i = (int32_t) ntohl(v);
+			off += 4;
+			break;
+
+		case 'h':
+			if (off + 8 > nbytes)
+				return -1;
+
+			memcpy(&v, buf + off, 4);
+			msg->args[msg->nargs].h = (int64_t) ntohl(v) << 32;
+			memcpy(&v, buf + off + 4, 4);
+			msg->args[msg->nargs].h |= ntohl(v);
+			off += 8;
+			break;
+
+		case 's':
+			if (!(msg->args[msg->nargs].s = get_str(buf, nbytes, &off)))
+				return -1;
+			break;
+
+		default:
+			return -1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* just enough OSC for the benchmark to talk to serialosc-device without
+ * liblo's allocations showing up in the numbers. ints and strings only,
+ * plus int64s on the way in for /sys/stats. */
+
+#define OSC_MAX_ARGS 8
+
+struct osc_msg {
+	const char *path;
+	const char *types;
+	int nargs;
+
+	union {
+		int32_t i;
+		int64_t h;
+		const char *s;
+	} args[OSC_MAX_ARGS];
+};
+
+/* types is a typetag without the leading comma, followed by one int32_t
+ * or const char * per tag. returns the encoded size, or 0 if it didn't
+ * fit. */
+size_t osc_build(uint8_t *buf, size_t size, const char *path,
+                 const char *types, ...);
+
+/* a message of nothing but int32s, for the LED maps */
+size_t osc_build_ints(uint8_t *buf, size_t size, const char *path,
+                      const int32_t *args, int nargs);
+
+/* parses buf in place (strings point into it). returns 0 on success. */
+int osc_parse(uint8_t *buf, size_t nbytes, struct osc_msg *msg);
@@ -0,0 +1,325 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/* rotation-check: the rotated mext encoding led.c does when it writes to
+ * the serial port itself (src/serialosc-device/led_rotate.c) against
+ * libmonome doing the same. libmonome opens an emulated grid (mext_emu.c)
+ * at each size and rotation, and for every LED, every quad row and every
+ * quad, on/off and levels, we draw the same thing through libmonome and
+ * through our geometry and compare what ends up lit on the device. prints
+ * what doesn't match, and one JSON summary line:
+ *
+ *   {"bench": "rotation_check", "checks": N, "failures": N}
+ *
+ * and exits non-zero if anything failed. */
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <monome.h>
+
+#include <serialosc/led.h>
+
+#include "mext_emu.h"
+
+#define TRIALS 16
+
+struct grid {
+	struct mext_emu emu;
+	monome_t *monome;
+
+	int rotation;
+	unsigned cols, rows; /* rotated, as the application sees them */
+
+	/* the device as our geometry says it should look, [y][x] */
+	uint8_t want[MEXT_EMU_MAX][MEXT_EMU_MAX];
+};
+
+static unsigned long checks, failures;
+
+static const char *rotation_names[] = {"0", "90", "180", "270"};
+
+/*************************************************************************
+ * the emulated grid
+ *************************************************************************/
+
+struct opener {
+	struct mext_emu *emu;
+	atomic_int done;
+};
+
+/* monome_open() waits for answers to its system queries, so something
+ * has to be pumping the emulator while it does */
+static void *
+answer_queries(void *arg)
+{
+	struct opener *o = arg;
+	struct pollfd p = {.fd = o->emu->fd, .events = POLLIN};
+
+	while (!atomic_load(&o->done))
+		if (poll(&p, 1, 10) > 0)
+			mext_emu_pump(o->emu);
+
+	return NULL;
+}
+
+/* libmonome's writes are done by the time its calls return, so once
+ * there's nothing left to read, the emulator has seen all of them */
+static void
+drain(struct grid *g)
+{
+	struct pollfd p = {.fd = g->emu.fd, .events = POLLIN};
+
+	while (poll(&p, 1, 0) > 0)
+		if (mext_emu_pump(&g->emu) < 0)
+			break;
+}
+
+static int
+grid_open(struct grid *g, unsigned cols, unsigned rows, int rotation)
+{
+	struct opener o;
+	pthread_t thread;
+
+	memset(g, 0, sizeof(*g));
+
+	if (mext_emu_open(&g->emu, cols, rows))
+		return -1;
+
+	o.emu = &g->emu;
+	atomic_init(&o.done, 0);
+
+	if (pthread_create(&thread, NULL, answer_queries, &o))
+		goto err_thread;
+
+	g->monome = monome_open(g->emu.slave_path);
+
+	atomic_store(&o.done, 1);
+	pthread_join(thread, NULL);
+
+	if (!g->monome) {
+		fprintf(stderr, "rotation-check: libmonome couldn't open %s\n",
+		        g->emu.slave_path);
+		goto err_thread;
+	}
+
+	monome_set_rotation(g->monome, rotation);
+
+	g->rotation = rotation;
+	g->cols = monome_get_cols(g->monome);
+	g->rows = monome_get_rows(g->monome);
+
+	/* whatever libmonome did on the way in is where we start from */
+	drain(g);
+	memcpy(g->want, g->emu.led, sizeof(g->want));
+	return 0;
+
+err_thread:
+	mext_emu_close(&g->emu);
+	return -1;
+}
+
+static void
+grid_close(struct grid *g)
+{
+	monome_close(g->monome);
+	mext_emu_close(&g->emu);
+}
+
+static void
+want_put(struct grid *g, unsigned x, unsigned y, uint8_t level)
+{
+	if (x < g->emu.cols && y < g->emu.rows)
+		g->want[y][x] = level;
+}
+
+static void
+compare(struct grid *g, const char *what, unsigned x, unsigned y)
+{
+	unsigned dx, dy;
+
+	drain(g);
+	checks++;
+
+	for (dy = 0; dy < g->emu.rows; dy++)
+		for (dx = 0; dx < g->emu.cols; dx++) {
+			if (g->emu.led[dy][dx] == g->want[dy][dx])
+				continue;
+
+			failures++;
+			fprintf(stderr, "%ux%u rotated %s, %s at %u,%u: device LED "
+			        "%u,%u is %d from libmonome, %d from us\n",
+			        g->emu.cols, g->emu.rows, rotation_names[g->rotation],
+			        what, x, y, dx, dy, g->emu.led[dy][dx],
+			        g->want[dy][dx]);
+
+			/* start the next check from what libmonome drew */
+			memcpy(g->want, g->emu.led, sizeof(g->want));
+			return;
+		}
+}
+
+/*************************************************************************
+ * checks
+ *************************************************************************/
+
+static uint8_t
+random_level(int levels)
+{
+	return levels ? rand() % (SOSC_LED_LEVEL_MAX + 1)
+	              : (rand() & 1) * SOSC_LED_LEVEL_MAX;
+}
+
+/* one LED at a time, on a dark grid, so that each lands somewhere
+ * unambiguous */
+static void
+check_points(struct grid *g)
+{
+	unsigned x, y, dx, dy;
+
+	for (y = 0; y < g->rows; y++)
+		for (x = 0; x < g->cols; x++) {
+			monome_led_level_set(g->monome, x, y, SOSC_LED_LEVEL_MAX);
+
+			dx = x;
+			dy = y;
+			sosc_led_rotate_point(g->rotation, g->cols, g->rows, &dx, &dy);
+			want_put(g, dx, dy, SOSC_LED_LEVEL_MAX);
+
+			compare(g, "level set", x, y);
+
+			monome_led_set(g->monome, x, y, 0);
+			want_put(g, dx, dy, 0);
+
+			compare(g, "set", x, y);
+		}
+}
+
+static void
+check_rows(struct grid *g, int levels)
+{
+	uint8_t src[SOSC_LED_QUAD_SIZE], dst[SOSC_LED_QUAD_SIZE], bits;
+	unsigned x_off, y, dx, dy, i;
+	int trial, vertical;
+
+	for (trial = 0; trial < TRIALS; trial++)
+		for (y = 0; y < g->rows; y++)
+			for (x_off = 0; x_off < g->cols; x_off += SOSC_LED_QUAD_SIZE) {
+				for (bits = 0, i = 0; i < SOSC_LED_QUAD_SIZE; i++) {
+					src[i] = random_level(levels);
+					bits |= (!!src[i]) << i;
+				}
+
+				if (levels)
+					monome_led_level_row(g->monome, x_off, y,
+					                     SOSC_LED_QUAD_SIZE, src);
+				else
+					monome_led_row(g->monome, x_off, y, 1, &bits);
+
+				vertical = sosc_led_rotate_row(g->rotation, g->cols, g->rows,
+				                               x_off, y, src, &dx, &dy, dst);
+
+				for (i = 0; i < SOSC_LED_QUAD_SIZE; i++)
+					if (vertical)
+						want_put(g, dx, dy + i, dst[i]);
+					else
+						want_put(g, dx + i, dy, dst[i]);
+
+				compare(g, levels ? "level row" : "row", x_off, y);
+			}
+}
+
+static void
+check_quads(struct grid *g, int levels)
+{
+	uint8_t src[SOSC_LED_QUAD_SIZE * SOSC_LED_QUAD_SIZE];
+	uint8_t dst[SOSC_LED_QUAD_SIZE * SOSC_LED_QUAD_SIZE];
+	uint8_t bits[SOSC_LED_QUAD_SIZE];
+	unsigned x_off, y_off, dx, dy, x, y;
+	int trial;
+
+	for (trial = 0; trial < TRIALS; trial++)
+		for (y_off = 0; y_off < g->rows; y_off += SOSC_LED_QUAD_SIZE)
+			for (x_off = 0; x_off < g->cols; x_off += SOSC_LED_QUAD_SIZE) {
+				for (y = 0; y < SOSC_LED_QUAD_SIZE; y++)
+					for (bits[y] = 0, x = 0; x < SOSC_LED_QUAD_SIZE; x++) {
+						src[y * SOSC_LED_QUAD_SIZE + x] = random_level(levels);
+						bits[y] |= (!!src[y * SOSC_LED_QUAD_SIZE + x]) << x;
+					}
+
+				if (levels)
+					monome_led_level_map(g->monome, x_off, y_off, src);
+				else
+					monome_led_map(g->monome, x_off, y_off, bits);
+
+				sosc_led_rotate_quad(g->rotation, g->cols, g->rows,
+				                     x_off, y_off, src, SOSC_LED_QUAD_SIZE,
+				                     &dx, &dy, dst);
+
+				for (y = 0; y < SOSC_LED_QUAD_SIZE; y++)
+					for (x = 0; x < SOSC_LED_QUAD_SIZE; x++)
+						want_put(g, dx + x, dy + y,
+						         dst[y * SOSC_LED_QUAD_SIZE + x]);
+
+				compare(g, levels ? "level map" : "map", x_off, y_off);
+			}
+}
+
+static int
+check_grid(unsigned cols, unsigned rows, int rotation)
+{
+	struct grid g;
+	int levels;
+
+	if (grid_open(&g, cols, rows, rotation))
+		return -1;
+
+	check_points(&g);
+
+	for (levels = 0; levels < 2; levels++) {
+		check_rows(&g, levels);
+		check_quads(&g, levels);
+	}
+
+	grid_close(&g);
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	static const unsigned sizes[][2] = {{8, 8}, {16, 8}, {16, 16}};
+	int rotation, ret = EXIT_SUCCESS;
+	size_t i;
+
+	srand(1);
+
+	for (i = 0; i < sizeof(sizes) / sizeof(*sizes); i++)
+		for (rotation = MONOME_ROTATE_0; rotation <= MONOME_ROTATE_270;
+		     rotation++)
+			if (check_grid(sizes[i][0], sizes[i][1], rotation))
+				ret = EXIT_FAILURE;
+
+	printf("{\"bench\": \"rotation_check\", \"checks\": %lu, "
+	       "\"failures\": %lu}\n", checks, failures);
+
+	return (failures || ret) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,838 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* serialosc-bench: runs serialosc-device against an emulated grid on a
+ * pseudo-terminal, stands in for both the supervisor and an application,
+ * and prints one JSON object per line per measurement:
+ *
+ *   key_latency    mext key packet written -> <prefix>/grid/key received
+ *   led_latency    /grid/led/set sent -> LED lit on the emulated grid
+ *   led_fps        full /grid/led/level/map frames shown per second, with
+ *                  up to --window frames in flight
+ *   led_flood      --flood single-LED messages as fast as the socket
+ *                  takes them, and how long the grid takes to catch up
+ *   device_latency serialosc-device's own /sys/stats/latency figures
+ *
+ * before any of those, a "setup" line records the machine and the
+ * options, so that a saved run says what it was measured on.
+ *
+ * all times in microseconds. with --unix, the device is started with -u
+ * and we talk to it over unix sockets instead of loopback UDP, so that
+ * the two can be compared. each line says which it used in "transport".
+ * --label adds a "label" to every line as well, for telling apart runs
+ * against different builds of the device (see -x). */
+
+#include <errno.h>
+#include <libgen.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+
+#define OPTPARSE_IMPLEMENTATION
+#define OPTPARSE_API static
+#include <optparse/optparse.h>
+
+#include <serialosc/platform.h>
+#include <serialosc/dgram.h>
+#include <serialosc/ipc.h>
+
+#include "mext_emu.h"
+#include "osc_min.h"
+
+#define PREFIX          "/bench"
+#define READY_TIMEOUT   5000000
+#define SAMPLE_TIMEOUT  1000000
+#define SETTLE_TIMEOUT  5000000
+
+struct bench {
+	struct mext_emu emu;
+
+	pid_t pid;
+	int to_dev, from_dev;
+
+	int sock;
+	uint16_t port;
+	struct sockaddr_storage dev_addr;
+	socklen_t dev_addrlen;
+
+	/* set for --unix. dev_path is the device's socket, app_path ours. */
+	int unix_socket;
+	const char *transport;
+
+	/* --label, or NULL */
+	const char *label;
+	char dev_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+	char app_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+
+	char config_dir[64];
+	char serial[64];
+
+	uint8_t buf[2048];
+};
+
+struct samples {
+	uint64_t *v;
+	size_t n, lost;
+};
+
+/*************************************************************************
+ * plumbing
+ *************************************************************************/
+
+/* the start of every line of output, up to the bench's own fields */
+static void
+print_head(struct bench *b, const char *name)
+{
+	printf("{\"bench\": \"%s\", \"transport\": \"%s\", ",
+	       name, b->transport);
+
+	if (b->label)
+		printf("\"label\": \"%s\", ", b->label);
+}
+
+static void
+send_buf(struct bench *b, const uint8_t *buf, size_t nbytes)
+{
+	struct pollfd p = {.fd = b->sock, .events = POLLOUT};
+
+	while (sendto(b->sock, buf, nbytes, 0, (struct sockaddr *) &b->dev_addr,
+	              b->dev_addrlen) < 0) {
+		if (errno != EAGAIN && errno != ENOBUFS && errno != EINTR) {
+			perror("sendto");
+			return;
+		}
+
+		/* keep the pty drained while we wait, or the device can end up
+		 * blocked writing to it */
+		mext_emu_pump(&b->emu);
+		poll(&p, 1, 1);
+	}
+}
+
+#define SEND(b, path, types, ...) \
+	send_buf(b, (b)->buf, \
+	         osc_build((b)->buf, sizeof((b)->buf), path, types, __VA_ARGS__))
+
+/* waits up to timeout for a datagram whose path is `path`, pumping the
+ * emulated grid all the while. returns 0 if one arrived. */
+static int
+wait_osc(struct bench *b, const char *path, uint64_t timeout,
+         struct osc_msg *msg)
+{
+	struct pollfd fds[2] = {
+		{.fd = b->sock,   .events = POLLIN},
+		{.fd = b->emu.fd, .events = POLLIN}
+	};
+	uint64_t deadline = sosc_now_usec() + timeout;
+	ssize_t n;
+
+	for (;;) {
+		while ((n = recv(b->sock, b->buf, sizeof(b->buf), MSG_DONTWAIT)) > 0)
+			if (!osc_parse(b->buf, n, msg) && !strcmp(msg->path, path))
+				return 0;
+
+		mext_emu_pump(&b->emu);
+
+		if (sosc_now_usec() >= deadline)
+			return -1;
+
+		poll(fds, 2, 1);
+	}
+}
+
+/* pumps the emulated grid until check() is happy or timeout passes */
+static int
+wait_grid(struct bench *b, int (*check)(struct bench *, void *), void *ctx,
+          uint64_t timeout)
+{
+	struct pollfd p = {.fd = b->emu.fd, .events = POLLIN};
+	uint64_t deadline = sosc_now_usec() + timeout;
+
+	for (;;) {
+		if (mext_emu_pump(&b->emu) < 0)
+			return -1;
+
+		if (check(b, ctx))
+			return 0;
+
+		if (sosc_now_usec() >= deadline)
+			return -1;
+
+		poll(&p, 1, 1);
+	}
+}
+
+/*************************************************************************
+ * results
+ *************************************************************************/
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+	return (x > y) - (x < y);
+}
+
+static uint64_t
+percentile(struct samples *s, unsigned int per1000)
+{
+	size_t i;
+
+	if (!s->n)
+		return 0;
+
+	i = (s->n * per1000) / 1000;
+	return s->v[(i < s->n) ? i : s->n - 1];
+}
+
+static void
+print_samples(struct bench *b, const char *name, struct samples *s)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	qsort(s->v, s->n, sizeof(*s->v), cmp_u64);
+
+	for (i = 0; i < s->n; i++)
+		sum += s->v[i];
+
+	print_head(b, name);
+	printf("\"samples\": %zu, \"lost\": %zu, \"mean_us\": %llu, "
+	       "\"p50_us\": %llu, \"p99_us\": %llu, \"p999_us\": %llu, "
+	       "\"max_us\": %llu}\n",
+	       s->n, s->lost,
+	       (unsigned long long) (s->n ? sum / s->n : 0),
+	       (unsigned long long) percentile(s, 500),
+	       (unsigned long long) percentile(s, 990),
+	       (unsigned long long) percentile(s, 999),
+	       (unsigned long long) (s->n ? s->v[s->n - 1] : 0));
+
+	fflush(stdout);
+}
+
+/*************************************************************************
+ * benchmarks
+ *************************************************************************/
+
+static void
+bench_key_latency(struct bench *b, struct samples *s, size_t count)
+{
+	struct osc_msg msg;
+	unsigned int x, y;
+	uint64_t start;
+	size_t i;
+	int down;
+
+	for (i = 0; i < count; i++) {
+		x = (i / 2) % b->emu.cols;
+		y = ((i / 2) / b->emu.cols) % b->emu.rows;
+		down = !(i & 1);
+
+		start = sosc_now_usec();
+		mext_emu_key(&b->emu, x, y, down);
+
+		if (wait_osc(b, PREFIX "/grid/key", SAMPLE_TIMEOUT, &msg)
+		    || msg.nargs != 3 || msg.args[0].i != x || msg.args[1].i != y) {
+			s->lost++;
+			continue;
+		}
+
+		s->v[s->n++] = sosc_now_usec() - start;
+	}
+}
+
+struct led_check {
+	unsigned int x, y, level;
+};
+
+static int
+led_is(struct bench *b, void *ctx)
+{
+	struct led_check *c = ctx;
+	return b->emu.led[c->y][c->x] == c->level;
+}
+
+static void
+bench_led_latency(struct bench *b, struct samples *s, size_t count)
+{
+	struct led_check c;
+	uint64_t start;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		c.x = i % b->emu.cols;
+		c.y = (i / b->emu.cols) % b->emu.rows;
+		c.level = b->emu.led[c.y][c.x] ? 0 : 15;
+
+		start = sosc_now_usec();
+		SEND(b, PREFIX "/grid/led/set", "iii", c.x, c.y, !!c.level);
+
+		if (wait_grid(b, led_is, &c, SAMPLE_TIMEOUT)) {
+			s->lost++;
+			continue;
+		}
+
+		s->v[s->n++] = sosc_now_usec() - start;
+	}
+}
+
+/* frame k has every LED at a different level from frame k - 1, and
+ * shows k mod 16 in the top left corner */
+static unsigned int
+frame_level(unsigned int x, unsigned int y, uint64_t k)
+{
+	return (x + 2 * y + k) & 0xF;
+}
+
+static int
+frame_shown(struct bench *b, uint64_t k)
+{
+	unsigned int x, y;
+
+	for (y = 0; y < b->emu.rows; y++)
+		for (x = 0; x < b->emu.cols; x++)
+			if (b->emu.led[y][x] != frame_level(x, y, k))
+				return 0;
+
+	return 1;
+}
+
+static void
+send_frame(struct bench *b, uint64_t k)
+{
+	int32_t args[2 + 64];
+	unsigned int x_off, y_off, i;
+
+	for (y_off = 0; y_off < b->emu.rows; y_off += 8)
+		for (x_off = 0; x_off < b->emu.cols; x_off += 8) {
+			args[0] = x_off;
+			args[1] = y_off;
+
+			for (i = 0; i < 64; i++)
+				args[2 + i] = frame_level(x_off + (i % 8), y_off + (i / 8), k);
+
+			send_buf(b, b->buf, osc_build_ints(b->buf, sizeof(b->buf),
+			         PREFIX "/grid/led/level/map", args, 66));
+		}
+}
+
+static void
+bench_led_fps(struct bench *b, uint64_t duration, unsigned int window)
+{
+	struct pollfd p = {.fd = b->emu.fd, .events = POLLIN};
+	uint64_t start, end, now, sent = 0, seen = 0, shown = 0, k;
+	uint64_t bytes_before = b->emu.bytes_in;
+
+	start = sosc_now_usec();
+	end = start + duration;
+
+	while ((now = sosc_now_usec()) < end) {
+		while (sent - seen < window)
+			send_frame(b, ++sent);
+
+		if (mext_emu_pump(&b->emu) < 0)
+			break;
+
+		/* the device is allowed to skip frames, so look for the newest
+		 * one in flight that the grid is showing */
+		for (k = sent; k > seen; k--)
+			if (frame_shown(b, k)) {
+				seen = k;
+				shown++;
+				break;
+			}
+
+		poll(&p, 1, 1);
+	}
+
+	now = sosc_now_usec() - start;
+
+	print_head(b, "led_fps");
+	printf("\"duration_us\": %llu, \"window\": %u, \"frames_sent\": %llu, "
+	       "\"frames_shown\": %llu, \"fps\": %.1f, "
+	       "\"serial_bytes_per_sec\": %.0f}\n",
+	       (unsigned long long) now, window,
+	       (unsigned long long) sent, (unsigned long long) shown,
+	       (shown * 1e6) / now,
+	       ((b->emu.bytes_in - bytes_before) * 1e6) / now);
+
+	fflush(stdout);
+}
+
+struct flood_check {
+	uint8_t want[MEXT_EMU_MAX][MEXT_EMU_MAX];
+};
+
+static int
+grid_matches(struct bench *b, void *ctx)
+{
+	struct flood_check *c = ctx;
+	unsigned int y;
+
+	for (y = 0; y < b->emu.rows; y++)
+		if (memcmp(b->emu.led[y], c->want[y], b->emu.cols))
+			return 0;
+
+	return 1;
+}
+
+static void
+bench_led_flood(struct bench *b, size_t count)
+{
+	struct flood_check c;
+	uint64_t start, sent_at, bytes_before = b->emu.bytes_in;
+	unsigned int x, y, level;
+	uint32_t rng = 1;
+	size_t i;
+	int settled;
+
+	memcpy(c.want, b->emu.led, sizeof(c.want));
+	start = sosc_now_usec();
+
+	for (i = 0; i < count; i++) {
+		rng = rng * 1103515245 + 12345;
+
+		x = (rng >> 8) % b->emu.cols;
+		y = (rng >> 16) % b->emu.rows;
+		level = (rng >> 24) & 0xF;
+
+		c.want[y][x] = level;
+		SEND(b, PREFIX "/grid/led/level/set", "iii", x, y, level);
+
+		if (!(i % 64))
+			mext_emu_pump(&b->emu);
+	}
+
+	sent_at = sosc_now_usec();
+	settled = !wait_grid(b, grid_matches, &c, SETTLE_TIMEOUT);
+
+	print_head(b, "led_flood");
+	printf("\"messages\": %zu, \"send_us\": %llu, \"settle_us\": %llu, "
+	       "\"settled\": %s, \"messages_per_sec\": %.0f, "
+	       "\"serial_bytes\": %llu}\n",
+	       count, (unsigned long long) (sent_at - start),
+	       (unsigned long long) (sosc_now_usec() - sent_at),
+	       settled ? "true" : "false",
+	       (count * 1e6) / (sent_at - start),
+	       (unsigned long long) (b->emu.bytes_in - bytes_before));
+
+	fflush(stdout);
+}
+
+static void
+report_device_stats(struct bench *b)
+{
+	struct osc_msg msg;
+
+	if (b->unix_socket)
+		SEND(b, "/sys/stats", "s", b->app_path);
+	else
+		SEND(b, "/sys/stats", "i", b->port);
+
+	while (!wait_osc(b, "/sys/stats/latency", 200000, &msg)) {
+		if (msg.nargs != 6)
+			continue;
+
+		print_head(b, "device_latency");
+		printf("\"path\": \"%s\", \"samples\": %lld, \"p50_us\": %d, "
+		       "\"p99_us\": %d, \"p999_us\": %d, \"max_us\": %d}\n",
+		       msg.args[0].s,
+		       (long long) msg.args[1].h, msg.args[2].i,
+		       msg.args[3].i, msg.args[4].i, msg.args[5].i);
+	}
+
+	fflush(stdout);
+}
+
+static void
+report_setup(struct bench *b, const char *device_exe, unsigned int cols,
+             unsigned int rows, uint64_t serial_rate, size_t samples)
+{
+	struct utsname u;
+
+	if (uname(&u))
+		memset(&u, 0, sizeof(u));
+
+	print_head(b, "setup");
+	printf("\"kernel\": \"%s %s\", \"machine\": \"%s\", \"cpus\": %ld, "
+	       "\"device\": \"%s\", \"grid\": \"%ux%u\", "
+	       "\"serial_rate\": %llu, \"samples\": %zu}\n",
+	       u.sysname, u.release, u.machine, sysconf(_SC_NPROCESSORS_ONLN),
+	       device_exe, cols, rows, (unsigned long long) serial_rate, samples);
+
+	fflush(stdout);
+}
+
+/*************************************************************************
+ * device process
+ *************************************************************************/
+
+static int
+spawn_device(struct bench *b, const char *exe)
+{
+	int in[2], out[2];
+
+	if (pipe(in) || pipe(out)) {
+		perror("pipe");
+		return -1;
+	}
+
+	if (!(b->pid = fork())) {
+		dup2(in[0], STDIN_FILENO);
+		dup2(out[1], STDOUT_FILENO);
+
+		close(in[0]); close(in[1]);
+		close(out[0]); close(out[1]);
+		close(b->emu.fd);
+
+		if (b->unix_socket)
+			execl(exe, exe, "-c", b->config_dir, "-u", b->emu.slave_path,
+			      NULL);
+		else
+			execl(exe, exe, "-c", b->config_dir, b->emu.slave_path, NULL);
+		perror(exe);
+		_exit(1);
+	} else if (b->pid < 0) {
+		perror("fork");
+		return -1;
+	}
+
+	close(in[0]);
+	close(out[1]);
+
+	b->to_dev = in[1];
+	b->from_dev = out[0];
+	return 0;
+}
+
+/* answer libmonome's queries until the device tells us (the way it tells
+ * serialoscd) that it's up, and on which port or unix socket */
+static int
+wait_ready(struct bench *b)
+{
+	struct pollfd fds[2] = {
+		{.fd = b->from_dev, .events = POLLIN},
+		{.fd = b->emu.fd,   .events = POLLIN}
+	};
+	uint64_t deadline = sosc_now_usec() + READY_TIMEOUT;
+	struct sockaddr_in *sin = (struct sockaddr_in *) &b->dev_addr;
+	sosc_ipc_msg_t msg;
+	int port = 0;
+
+	while (sosc_now_usec() < deadline) {
+		poll(fds, 2, 10);
+		mext_emu_pump(&b->emu);
+
+		if (!(fds[0].revents & (POLLIN | POLLHUP)))
+			continue;
+
+		if (sosc_ipc_msg_read(b->from_dev, &msg) <= 0)
+			return -1;
+
+		switch (msg.type) {
+		case SOSC_DEVICE_INFO:
+			snprintf(b->serial, sizeof(b->serial), "%s",
+			         msg.device_info.serial ? msg.device_info.serial : "");
+			s_free(msg.device_info.serial);
+			s_free(msg.device_info.friendly);
+			break;
+
+		case SOSC_OSC_PORT_CHANGE:
+			port = msg.port_change.port;
+			break;
+
+		case SOSC_OSC_UNIX_PATH:
+			snprintf(b->dev_path, sizeof(b->dev_path), "%s",
+			         msg.unix_path.path ? msg.unix_path.path : "");
+			s_free(msg.unix_path.path);
+			break;
+
+		case SOSC_DEVICE_READY:
+			if (b->unix_socket) {
+				b->dev_addrlen = sosc_dgram_unix_addr(&b->dev_addr,
+				                                      b->dev_path);
+				return b->dev_addrlen ? 0 : -1;
+			}
+
+			sin->sin_family = AF_INET;
+			sin->sin_port = htons(port);
+			sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			b->dev_addrlen = sizeof(*sin);
+			return port ? 0 : -1;
+
+		default:
+			break;
+		}
+	}
+
+	return -1;
+}
+
+/* point the device's output at us and wait for it to confirm */
+static int
+connect_app(struct bench *b)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+	};
+	socklen_t len = sizeof(addr);
+	struct osc_msg msg;
+	int rcvbuf = 1 << 20;
+
+	if ((b->sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0
+	    || bind(b->sock, (struct sockaddr *) &addr, sizeof(addr))
+	    || getsockname(b->sock, (struct sockaddr *) &addr, &len)) {
+		perror("socket");
+		return -1;
+	}
+
+	setsockopt(b->sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	b->port = ntohs(addr.sin_port);
+
+	SEND(b, "/sys/host", "s", "127.0.0.1");
+	SEND(b, "/sys/port", "i", b->port);
+	SEND(b, "/sys/prefix", "s", PREFIX);
+	SEND(b, "/sys/info/prefix", "i", b->port);
+
+	return wait_osc(b, "/sys/prefix", SAMPLE_TIMEOUT, &msg);
+}
+
+/* the same over unix sockets. /sys/host and /sys/port only take UDP
+ * destinations, so we subscribe instead, and ask for replies by path. */
+static int
+connect_app_unix(struct bench *b)
+{
+	struct sockaddr_storage addr;
+	socklen_t len;
+	struct osc_msg msg;
+	int rcvbuf = 1 << 20;
+
+	snprintf(b->app_path, sizeof(b->app_path), "%s/bench.sock",
+	         b->config_dir);
+
+	if (!(len = sosc_dgram_unix_addr(&addr, b->app_path))
+	    || (b->sock = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0
+	    || bind(b->sock, (struct sockaddr *) &addr, len)) {
+		perror("socket");
+		return -1;
+	}
+
+	setsockopt(b->sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	SEND(b, "/sys/prefix", "s", PREFIX);
+	SEND(b, "/sys/subscribe", "s", b->app_path);
+	SEND(b, "/sys/info/prefix", "s", b->app_path);
+
+	return wait_osc(b, "/sys/prefix", SAMPLE_TIMEOUT, &msg);
+}
+
+static void
+stop_device(struct bench *b)
+{
+	sosc_ipc_msg_t msg = {
+		.type = SOSC_PROCESS_SHOULD_EXIT
+	};
+	uint64_t deadline = sosc_now_usec() + 2000000;
+	char *path;
+
+	sosc_ipc_msg_write(b->to_dev, &msg);
+
+	while (waitpid(b->pid, NULL, WNOHANG) == 0) {
+		mext_emu_pump(&b->emu);
+
+		if (sosc_now_usec() > deadline) {
+			kill(b->pid, SIGKILL);
+			waitpid(b->pid, NULL, 0);
+			break;
+		}
+
+		usleep(1000);
+	}
+
+	if ((path = s_asprintf("%s/%s.conf", b->config_dir, b->serial))) {
+		unlink(path);
+		s_free(path);
+	}
+
+	/* the device removes its own socket, unless we had to kill it */
+	if (*b->dev_path)
+		unlink(b->dev_path);
+
+	if (*b->app_path)
+		unlink(b->app_path);
+
+	rmdir(b->config_dir);
+}
+
+/*************************************************************************
+ * entry point
+ *************************************************************************/
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -x, --device PATH      serialosc-device to run "
+			"[next to this binary]\n"
+		"  -s, --size COLSxROWS   emulated grid size [16x8]\n"
+		"  -n, --samples N        latency samples per path [1000]\n"
+		"  -t, --duration SECS    how long to run led_fps for [5]\n"
+		"  -w, --window N         frames in flight for led_fps [4]\n"
+		"  -f, --flood N          messages to send for led_flood [10000]\n"
+		"  -r, --serial-rate BPS  read the pty no faster than this many "
+			"bytes/sec [unlimited]\n"
+		"  -u, --unix             talk to the device over unix sockets "
+			"instead of UDP\n"
+		"  -l, --label NAME       add \"label\": NAME to every line\n",
+		argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct bench b = {.pid = -1, .to_dev = -1, .from_dev = -1, .sock = -1};
+	const char *device_exe = NULL;
+	unsigned int cols = 16, rows = 8, window = 4;
+	size_t samples = 1000, flood = 10000;
+	uint64_t duration = 5, serial_rate = 0;
+	struct samples s = {0};
+	char *exe_dir;
+	int opt, ret = EXIT_FAILURE;
+
+	struct optparse options;
+	struct optparse_long longopts[] = {
+		{"device",      'x', OPTPARSE_REQUIRED},
+		{"size",        's', OPTPARSE_REQUIRED},
+		{"samples",     'n', OPTPARSE_REQUIRED},
+		{"duration",    't', OPTPARSE_REQUIRED},
+		{"window",      'w', OPTPARSE_REQUIRED},
+		{"flood",       'f', OPTPARSE_REQUIRED},
+		{"serial-rate", 'r', OPTPARSE_REQUIRED},
+		{"unix",        'u', OPTPARSE_NONE},
+		{"label",       'l', OPTPARSE_REQUIRED},
+		{"help",        'h', OPTPARSE_NONE},
+		{0, 0, 0}
+	};
+
+	optparse_init(&options, argv);
+
+	while ((opt = optparse_long(&options, longopts, NULL)) != -1) {
+		switch (opt) {
+		case 'x': device_exe = options.optarg; break;
+		case 'n': samples = strtoul(options.optarg, NULL, 10); break;
+		case 't': duration = strtoull(options.optarg, NULL, 10); break;
+		case 'w': window = strtoul(options.optarg, NULL, 10); break;
+		case 'f': flood = strtoul(options.optarg, NULL, 10); break;
+		case 'r': serial_rate = strtoull(options.optarg, NULL, 10); break;
+		case 'u': b.unix_socket = 1; break;
+		case 'l': b.label = options.optarg; break;
+
+		case 's':
+			if (sscanf(options.optarg, "%ux%u", &cols, &rows) != 2) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+
+		default:
+			fprintf(stderr, "%s: %s\n", argv[0], options.errmsg);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!cols || !rows || cols > MEXT_EMU_MAX || rows > MEXT_EMU_MAX
+	    || (cols % 8) || (rows % 8) || !window || window > 15) {
+		fprintf(stderr, "%s: grid must be 8x8 to 16x16 in multiples of 8, "
+		        "window 1 to 15\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	b.transport = b.unix_socket ? "unix" : "udp";
+
+	if (!device_exe) {
+		exe_dir = dirname(s_strdup(argv[0]));
+		device_exe = s_asprintf("%s/serialosc-device", exe_dir);
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	snprintf(b.config_dir, sizeof(b.config_dir), "/tmp/serialosc-bench.XXXXXX");
+	if (!mkdtemp(b.config_dir)) {
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+
+	if (mext_emu_open(&b.emu, cols, rows))
+		goto err_emu;
+
+	b.emu.bytes_per_sec = serial_rate;
+
+	if (spawn_device(&b, device_exe))
+		goto err_spawn;
+
+	if (wait_ready(&b)) {
+		fprintf(stderr, "%s: %s never came up on %s\n", argv[0], device_exe,
+		        b.emu.slave_path);
+		goto err_device;
+	}
+
+	if (b.unix_socket ? connect_app_unix(&b) : connect_app(&b)) {
+		fprintf(stderr, "%s: device isn't answering OSC\n", argv[0]);
+		goto err_device;
+	}
+
+	if (!(s.v = s_calloc(samples, sizeof(*s.v))))
+		goto err_device;
+
+	report_setup(&b, device_exe, cols, rows, serial_rate, samples);
+
+	bench_key_latency(&b, &s, samples);
+	print_samples(&b, "key_latency", &s);
+
+	s.n = s.lost = 0;
+	bench_led_latency(&b, &s, samples);
+	print_samples(&b, "led_latency", &s);
+
+	bench_led_fps(&b, duration * 1000000, window);
+	bench_led_flood(&b, flood);
+	report_device_stats(&b);
+
+	s_free(s.v);
+	ret = EXIT_SUCCESS;
+
+err_device:
+	stop_device(&b);
+err_spawn:
+	mext_emu_close(&b.emu);
+err_emu:
+	rmdir(b.config_dir);
+	return ret;
+}
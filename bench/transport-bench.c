@@ -0,0 +1,308 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/* transport-bench: the floor under serialosc-bench's --unix comparison.
+ * two processes bounce a /grid/key-sized datagram back and forth, once
+ * over loopback UDP and once over the unix datagram sockets from
+ * src/common/dgram.c, with nothing but the kernel in between. prints one
+ * JSON object per transport:
+ *
+ *   {"bench": "transport", "transport": "udp" | "unix", "bytes": N,
+ *    "round_trips": N, "mean_ns": ..., "p50_ns": ..., "p99_ns": ...,
+ *    "max_ns": ...}
+ *
+ * whatever difference this shows is all that --unix can take off a round
+ * trip through serialosc-device. */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define OPTPARSE_IMPLEMENTATION
+#define OPTPARSE_API static
+#include <optparse/optparse.h>
+
+#include <serialosc/platform.h>
+#include <serialosc/dgram.h>
+
+/* "/monome/grid/key" ",iii" and three ints, padded */
+#define DGRAM_SIZE 36
+#define TIMEOUT_MS 1000
+
+struct peer {
+	int fd;
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+};
+
+static uint64_t
+now_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+	return (x > y) - (x < y);
+}
+
+/* both kinds of socket are non-blocking */
+static ssize_t
+recv_wait(int fd, void *buf, size_t nbytes, struct sockaddr_storage *from,
+          socklen_t *fromlen)
+{
+	struct pollfd p = {.fd = fd, .events = POLLIN};
+	ssize_t n;
+
+	for (;;) {
+		n = recvfrom(fd, buf, nbytes, 0, (struct sockaddr *) from, fromlen);
+		if (n >= 0 || (errno != EAGAIN && errno != EINTR))
+			return n;
+
+		if (poll(&p, 1, TIMEOUT_MS) == 0)
+			return -1;
+	}
+}
+
+static void
+send_to(struct peer *from, struct peer *to, const void *buf, size_t nbytes)
+{
+	struct sosc_dgram_out out = {
+		buf, nbytes, (struct sockaddr *) &to->addr, to->addrlen
+	};
+
+	sosc_dgram_send(from->fd, &out, 1);
+}
+
+/* the child: send back whatever arrives until a 1-byte datagram does */
+static void
+echo(struct peer *self)
+{
+	struct sockaddr_storage from;
+	struct sosc_dgram_out out;
+	uint8_t buf[DGRAM_SIZE];
+	socklen_t fromlen;
+	ssize_t n;
+
+	for (;;) {
+		fromlen = sizeof(from);
+		if ((n = recv_wait(self->fd, buf, sizeof(buf), &from, &fromlen)) < 0)
+			continue;
+
+		if (n == 1)
+			_exit(0);
+
+		out = (struct sosc_dgram_out) {
+			buf, n, (struct sockaddr *) &from, fromlen
+		};
+
+		sosc_dgram_send(self->fd, &out, 1);
+	}
+}
+
+static int
+run(const char *transport, struct peer *a, struct peer *b,
+    size_t round_trips)
+{
+	uint8_t buf[DGRAM_SIZE] = {0};
+	uint64_t *v, start, sum = 0;
+	size_t i, n = 0;
+	pid_t pid;
+
+	if (!(v = s_calloc(round_trips, sizeof(*v))))
+		return -1;
+
+	if ((pid = fork()) < 0) {
+		perror("fork");
+		goto err_fork;
+	} else if (!pid) {
+		echo(b);
+	}
+
+	for (i = 0; i < round_trips; i++) {
+		start = now_nsec();
+		send_to(a, b, buf, sizeof(buf));
+
+		if (recv_wait(a->fd, buf, sizeof(buf), NULL, NULL) != sizeof(buf))
+			continue;
+
+		v[n] = now_nsec() - start;
+		sum += v[n++];
+	}
+
+	send_to(a, b, buf, 1);
+	waitpid(pid, NULL, 0);
+
+	qsort(v, n, sizeof(*v), cmp_u64);
+
+	printf("{\"bench\": \"transport\", \"transport\": \"%s\", \"bytes\": %d, "
+	       "\"round_trips\": %zu, \"mean_ns\": %llu, \"p50_ns\": %llu, "
+	       "\"p99_ns\": %llu, \"max_ns\": %llu}\n",
+	       transport, DGRAM_SIZE, n,
+	       (unsigned long long) (n ? sum / n : 0),
+	       (unsigned long long) (n ? v[n / 2] : 0),
+	       (unsigned long long) (n ? v[(n * 99) / 100] : 0),
+	       (unsigned long long) (n ? v[n - 1] : 0));
+	fflush(stdout);
+
+	s_free(v);
+	return 0;
+
+err_fork:
+	s_free(v);
+	return -1;
+}
+
+static int
+udp_peer(struct peer *p)
+{
+	struct sockaddr_in *sin = (struct sockaddr_in *) &p->addr;
+
+	if ((p->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) < 0)
+		return -1;
+
+	memset(&p->addr, 0, sizeof(p->addr));
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	p->addrlen = sizeof(*sin);
+
+	if (bind(p->fd, (struct sockaddr *) sin, p->addrlen)
+	    || getsockname(p->fd, (struct sockaddr *) sin, &p->addrlen)) {
+		close(p->fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+bench_udp(size_t round_trips)
+{
+	struct peer a, b;
+	int ret = -1;
+
+	if (udp_peer(&a))
+		goto err_a;
+	if (udp_peer(&b))
+		goto err_b;
+
+	ret = run("udp", &a, &b, round_trips);
+
+	close(b.fd);
+err_b:
+	close(a.fd);
+err_a:
+	if (ret)
+		perror("transport-bench: udp");
+	return ret;
+}
+
+static int
+bench_unix(size_t round_trips)
+{
+	char dir[] = "/tmp/transport-bench.XXXXXX";
+	char path_a[64], path_b[64];
+	struct peer a, b;
+	int ret = -1;
+
+	if (!mkdtemp(dir))
+		goto err_dir;
+
+	snprintf(path_a, sizeof(path_a), "%s/a.sock", dir);
+	snprintf(path_b, sizeof(path_b), "%s/b.sock", dir);
+
+	if ((a.fd = sosc_dgram_unix_open(path_a)) < 0)
+		goto err_a;
+	if ((b.fd = sosc_dgram_unix_open(path_b)) < 0)
+		goto err_b;
+
+	a.addrlen = sosc_dgram_unix_addr(&a.addr, path_a);
+	b.addrlen = sosc_dgram_unix_addr(&b.addr, path_b);
+
+	ret = run("unix", &a, &b, round_trips);
+
+	sosc_dgram_unix_close(b.fd, path_b);
+err_b:
+	sosc_dgram_unix_close(a.fd, path_a);
+err_a:
+	rmdir(dir);
+err_dir:
+	if (ret)
+		perror("transport-bench: unix");
+	return ret;
+}
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -n, --round-trips N    round trips per transport [100000]\n",
+		argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t round_trips = 100000;
+	int opt;
+
+	struct optparse options;
+	struct optparse_long longopts[] = {
+		{"round-trips", 'n', OPTPARSE_REQUIRED},
+		{"help",        'h', OPTPARSE_NONE},
+		{0}
+	};
+
+	optparse_init(&options, argv);
+
+	while ((opt = optparse_long(&options, longopts, NULL)) != -1) {
+		switch (opt) {
+		case 'n': round_trips = strtoul(options.optarg, NULL, 10); break;
+
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+
+		default:
+			fprintf(stderr, "%s: %s\n", argv[0], options.errmsg);
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	if (bench_udp(round_trips) || bench_unix(round_trips))
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* effects that the device process draws by itself, so that an app doesn't
+ * have to stream an LED update for every step of a fade or every blink of
+ * a cursor. each animation covers a rectangle of the grid and steps on
+ * its own period. see src/serialosc-device/anim.c. */
+
+#define SOSC_ANIM_MAX         8
+#define SOSC_ANIM_CELLS_MAX   4096 /* levels in a scroll image or in all of
+                                    * an animation's keyframes together */
+#define SOSC_ANIM_PERIOD_MIN  1000 /* usec */
+
+typedef enum {
+	SOSC_ANIM_NONE,
+	SOSC_ANIM_FADE,
+	SOSC_ANIM_BLINK,
+	SOSC_ANIM_SCROLL,
+	SOSC_ANIM_FRAMES
+} sosc_anim_type_t;
+
+struct sosc_anim {
+	sosc_anim_type_t type;
+	unsigned x, y, w, h;
+
+	/* usec per step, and the sosc_now_usec() the next step is due */
+	uint64_t period;
+	uint64_t next;
+	unsigned step;
+
+	union {
+		/* nsteps is the distance between the two levels. a bouncing
+		 * fade goes back and forth forever, otherwise it stops at
+		 * the end. */
+		struct {
+			uint8_t from, to;
+			unsigned nsteps;
+			int bounce;
+		} fade;
+
+		struct {
+			uint8_t on, off;
+		} blink;
+
+		/* the region is a window onto levels, an image w by h that
+		 * wraps around at the edges, moving dx and dy a step */
+		struct {
+			int dx, dy;
+			unsigned w, h;
+		} scroll;
+
+		/* count keyframes of the region's size, one after the other
+		 * in levels, played on a loop */
+		struct {
+			unsigned count;
+		} frames;
+	};
+
+	/* unpacked, one level per byte. NULL for fades and blinks. */
+	uint8_t *levels;
+};
+
+struct sosc_anims {
+	struct sosc_anim slot[SOSC_ANIM_MAX];
+};
+
+struct sosc_state;
+
+/* these all (re)start animation number id, drawing the first step
+ * straight away. they return -1 if an argument is out of range (including
+ * a rectangle that runs off the grid) or a blob is the wrong size for
+ * what it's supposed to hold, in which case whatever was running as id
+ * carries on. */
+int sosc_anim_fade(struct sosc_state *state, unsigned id, unsigned x,
+                   unsigned y, unsigned w, unsigned h, unsigned from,
+                   unsigned to, uint64_t duration, int bounce);
+int sosc_anim_blink(struct sosc_state *state, unsigned id, unsigned x,
+                    unsigned y, unsigned w, unsigned h, unsigned on,
+                    unsigned off, uint64_t period);
+
+/* blobs are levels packed two to a byte, high nibble first, like
+ * /grid/led/level/frame. a scroll image is image_w levels wide and as
+ * tall as the blob makes it. */
+int sosc_anim_scroll(struct sosc_state *state, unsigned id, unsigned x,
+                     unsigned y, unsigned w, unsigned h, int dx, int dy,
+                     uint64_t period, unsigned image_w, const uint8_t *data,
+                     size_t nbytes);
+int sosc_anim_frames(struct sosc_state *state, unsigned id, unsigned x,
+                     unsigned y, unsigned w, unsigned h, uint64_t period,
+                     const uint8_t *data, size_t nbytes);
+
+/* stopping leaves the LEDs as the last step drew them */
+void sosc_anim_stop(struct sosc_state *state, unsigned id);
+void sosc_anim_stop_all(struct sosc_state *state);
+
+/* when the next step of any animation is due, or 0 if none are running */
+uint64_t sosc_anim_next(struct sosc_state *state);
+
+/* called by the scheduler. draws every step that's due by now. */
+void sosc_anim_run(struct sosc_state *state, uint64_t now);
@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#endif
+
+/* datagrams read by one recvmmsg() call. OSC from applications is a few
+ * hundred bytes at most; anything that doesn't fit in a slot is
+ * truncated by the kernel and dropped rather than half-dispatched. */
+#define SOSC_DGRAM_BATCH_SIZE 16
+#define SOSC_DGRAM_MAX_SIZE   8192
+
+struct sosc_dgram {
+	void *data;
+	size_t nbytes;
+
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+};
+
+typedef void (sosc_dgram_cb_t)(void *ctx, struct sosc_dgram *dgram);
+
+typedef struct sosc_dgram_batch sosc_dgram_batch_t;
+
+sosc_dgram_batch_t *sosc_dgram_batch_new(void);
+void sosc_dgram_batch_free(sosc_dgram_batch_t *batch);
+
+/* reads up to max datagrams from fd without blocking and hands each one
+ * to cb, in order. oversized datagrams are counted in *ndropped (if not
+ * NULL) instead. returns how many datagrams were read off the socket,
+ * dropped ones included, so anything less than max means it's empty. -1
+ * on error. */
+int sosc_dgram_recv(sosc_dgram_batch_t *batch, int fd, unsigned int max,
+                    sosc_dgram_cb_t *cb, void *ctx, unsigned int *ndropped);
+
+struct sosc_dgram_out {
+	const void *data;
+	size_t nbytes;
+
+	const struct sockaddr *to;
+	socklen_t tolen;
+};
+
+/* sends each datagram to its own address, in as few syscalls as the
+ * platform allows. best effort, like any UDP send: returns how many the
+ * kernel took. one that fails is skipped, not retried. */
+int sosc_dgram_send(int fd, const struct sosc_dgram_out *out,
+                    unsigned int count);
+
+#ifndef WIN32
+/* SOCK_DGRAM sockets in the AF_UNIX domain, for apps on the same
+ * machine. sosc_dgram_unix_open() binds one to path (replacing a stale
+ * socket left there, but nothing else) and makes it non-blocking, and
+ * returns it or -1. sosc_dgram_unix_close() closes it and removes path.
+ * sosc_dgram_unix_addr() fills in the address for path, and returns its
+ * length or 0 if path doesn't fit. */
+int sosc_dgram_unix_open(const char *path);
+void sosc_dgram_unix_close(int fd, const char *path);
+socklen_t sosc_dgram_unix_addr(struct sockaddr_storage *sa, const char *path);
+#endif
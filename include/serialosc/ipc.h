@@ -18,6 +18,8 @@
 
 #include <stdint.h>
 
+#include <serialosc/stats.h>
+
 #ifdef WIN32
 #define SOSC_PIPE_PREFIX "\\\\.\\pipe\\org.monome.serialosc-"
 #define SOSC_DETECTOR_PIPE (SOSC_PIPE_PREFIX "detector")
@@ -32,9 +34,12 @@ typedef enum {
 	SOSC_DEVICE_READY,
 	SOSC_DEVICE_DISCONNECTION,
 	SOSC_OSC_PORT_CHANGE,
+	SOSC_OSC_UNIX_PATH,
+	SOSC_STATS_REPORT,
 
 	/* supervisor -> device */
-	SOSC_PROCESS_SHOULD_EXIT
+	SOSC_PROCESS_SHOULD_EXIT,
+	SOSC_STATS_REQUEST
 } sosc_ipc_type_t;
 
 typedef struct sosc_ipc_msg {
@@ -53,6 +58,17 @@ typedef struct sosc_ipc_msg {
 		struct {
 			uint16_t port;
 		} port_change;
+
+		/* where the device's unix socket is, if it has one */
+		struct {
+			char *path;
+		} unix_path;
+
+		/* the report echoes the request's seq */
+		struct {
+			uint32_t seq;
+			struct sosc_latency_summary latency[SOSC_LATENCY_MAX];
+		} stats;
 	};
 
 	uint16_t magic;
@@ -0,0 +1,261 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* big enough for the largest grid there is, the 512 at 32x16 */
+#define SOSC_LED_COLS_MAX  32
+#define SOSC_LED_ROWS_MAX  16
+#define SOSC_LED_QUAD_SIZE 8
+#define SOSC_LED_QUADS_X   (SOSC_LED_COLS_MAX / SOSC_LED_QUAD_SIZE)
+#define SOSC_LED_QUADS_Y   (SOSC_LED_ROWS_MAX / SOSC_LED_QUAD_SIZE)
+#define SOSC_LED_QUADS     (SOSC_LED_QUADS_X * SOSC_LED_QUADS_Y)
+
+#define SOSC_LED_LEVEL_MAX 15
+
+/* sizes of the mext packets behind each LED call. the framebuffer uses
+ * them to pick the cheapest commands and to account for how much serial
+ * bandwidth it saves, older protocols will be a little different. */
+#define SOSC_MEXT_LED_SET_SIZE        3
+#define SOSC_MEXT_LED_ALL_SIZE        1
+#define SOSC_MEXT_LED_MAP_SIZE        11
+#define SOSC_MEXT_LED_ROW_SIZE        4 /* per 8 LEDs */
+#define SOSC_MEXT_LED_LEVEL_SET_SIZE  4
+#define SOSC_MEXT_LED_LEVEL_ALL_SIZE  2
+#define SOSC_MEXT_LED_LEVEL_MAP_SIZE  35
+#define SOSC_MEXT_LED_LEVEL_ROW_SIZE  7 /* per 8 LEDs */
+#define SOSC_MEXT_LED_INTENSITY_SIZE  2
+#define SOSC_MEXT_RING_SET_SIZE       4
+#define SOSC_MEXT_RING_ALL_SIZE       3
+#define SOSC_MEXT_RING_MAP_SIZE       34
+#define SOSC_MEXT_RING_RANGE_SIZE     5
+
+#define SOSC_LED_RINGS     4
+#define SOSC_LED_RING_SIZE 64
+
+/* one ring's worth of /ring/frame, levels packed two to a byte */
+#define SOSC_LED_RING_FRAME_SIZE (SOSC_LED_RING_SIZE / 2)
+
+/* the most a single flush can write: a level map for every quad and a
+ * map for every ring */
+#define SOSC_LED_FLUSH_MAX \
+	((SOSC_LED_QUADS * SOSC_MEXT_LED_LEVEL_MAP_SIZE) \
+	 + (SOSC_LED_RINGS * SOSC_MEXT_RING_MAP_SIZE))
+
+struct sosc_state;
+
+/* levels are stored in application coordinates, i.e. before libmonome
+ * applies the rotation, since that's the space every LED call is made in.
+ * on/off calls are stored as 0 and SOSC_LED_LEVEL_MAX. */
+typedef struct {
+	uint8_t level[SOSC_LED_ROWS_MAX][SOSC_LED_COLS_MAX]; /* [y][x] */
+} sosc_led_frame_t;
+
+typedef struct {
+	uint8_t level[SOSC_LED_RINGS][SOSC_LED_RING_SIZE];
+} sosc_led_rings_t;
+
+struct sosc_led {
+	/* what the application has asked for */
+	sosc_led_frame_t frame;
+
+	/* what has been written to the device */
+	sosc_led_frame_t hw;
+
+	/* bitmask of quads touched since the last flush, and when each was
+	 * first touched (for the LED latency histogram) */
+	unsigned int dirty;
+	uint64_t dirty_since[SOSC_LED_QUADS];
+
+	/* arc rings work the same way, with one dirty bit per ring */
+	sosc_led_rings_t rings;
+	sosc_led_rings_t rings_hw;
+	unsigned int rings_dirty;
+	uint64_t rings_dirty_since[SOSC_LED_RINGS];
+
+	/* sosc_now_usec() of the last flush, and when the next one is due
+	 * if we're holding changes back for the flush clock (0 if not). */
+	uint64_t last_flush;
+	uint64_t flush_deadline;
+
+	/* sequence numbers on /grid/led/level/frame and /delta. see
+	 * osc/mext_methods.c. */
+	struct {
+		uint32_t last_seq;
+		int have_seq;
+
+		/* an unnumbered frame came after last_seq. it's a full frame
+		 * all the same, so the next delta counts from its own number
+		 * rather than being checked against last_seq. */
+		int rebase;
+
+		/* a delta went missing and we've asked for a full frame,
+		 * last at sosc_now_usec() == resync_sent */
+		int resync;
+		uint64_t resync_sent;
+	} seq;
+
+	/* set while a flush is held back for room in the serial output
+	 * queue. sosc_serial_out_write() flushes once there is some, and
+	 * whatever is dirty by then goes out, so only the newest state of
+	 * each quad and ring is ever sent. */
+	int waiting;
+
+	/* depth of the incoming OSC bundles we're inside of. nothing is
+	 * flushed until the outermost one has been dispatched in full.
+	 * touched is set if anything in it changed the frame or the rings. */
+	int transaction;
+	int touched;
+
+	/* set by /sys/backbuffer. drawing goes into back and rings_back
+	 * and only reaches frame and rings on /grid/led/commit. */
+	int back_buffered;
+	sosc_led_frame_t back;
+	sosc_led_rings_t rings_back;
+
+	/* local echo, a bit per LED in each row. lit is what a held key has
+	 * lit in momentary mode (and what was there before, in saved), until
+	 * the key comes up or the app draws over it. keys leave whatever the
+	 * app has claimed in owned alone. */
+	struct {
+		uint32_t lit[SOSC_LED_ROWS_MAX];
+		uint32_t owned[SOSC_LED_ROWS_MAX];
+		uint8_t saved[SOSC_LED_ROWS_MAX][SOSC_LED_COLS_MAX];
+	} echo;
+};
+
+void sosc_led_init(struct sosc_state *state);
+void sosc_led_invalidate(struct sosc_state *state);
+
+void sosc_led_set(struct sosc_state *state, unsigned x, unsigned y,
+                  unsigned level);
+void sosc_led_all(struct sosc_state *state, unsigned level);
+void sosc_led_map(struct sosc_state *state, unsigned x_off, unsigned y_off,
+                  const uint8_t *levels);
+void sosc_led_row(struct sosc_state *state, unsigned x_off, unsigned y,
+                  size_t count, const uint8_t *levels);
+void sosc_led_col(struct sosc_state *state, unsigned x, unsigned y_off,
+                  size_t count, const uint8_t *levels);
+
+/* the whole grid at once, row by row from the top left. levels are packed
+ * two to a byte, high nibble first, and on/off frames one bit per LED,
+ * LSB first. both return -1 if nbytes doesn't match the grid's size. */
+int sosc_led_level_frame(struct sosc_state *state, const uint8_t *data,
+                         size_t nbytes);
+int sosc_led_frame(struct sosc_state *state, const uint8_t *data,
+                   size_t nbytes);
+
+/* the size of a frame blob for a grid of cols by rows, levels or on/off,
+ * or 0 if frames can't be sent to a grid that size (cols must be a
+ * multiple of 8, so that every row starts on a byte). */
+size_t sosc_led_frame_size(unsigned cols, unsigned rows, int levels);
+
+/* 8 LEDs' worth of a frame blob (four bytes of levels, or one of on/off
+ * bits) unpacked at once into a uint64_t, one level per byte, leftmost
+ * LED in the low byte. see led_blob.c, and bench/blob-check.c, which
+ * checks them against a straightforward decoder. */
+uint64_t sosc_led_unpack_levels8(const uint8_t *packed);
+uint64_t sosc_led_unpack_bits8(uint8_t bits);
+
+/* where LEDs in application coordinates end up on the device for a
+ * libmonome rotation (a monome_rotate_t), given the grid's rotated size:
+ * one LED, the 8 of a quad row (returning 1 if they go out as a column),
+ * or a whole quad, row by row from src lines stride bytes apart. dx and
+ * dy are where the result starts on the device, dst is in the order the
+ * device wants it. see led_rotate.c, and bench/rotation-check.c, which
+ * checks them against libmonome. */
+void sosc_led_rotate_point(int rotation, unsigned cols, unsigned rows,
+                           unsigned *x, unsigned *y);
+int  sosc_led_rotate_row(int rotation, unsigned cols, unsigned rows,
+                         unsigned x_off, unsigned y, const uint8_t *src,
+                         unsigned *dx, unsigned *dy, uint8_t *dst);
+void sosc_led_rotate_quad(int rotation, unsigned cols, unsigned rows,
+                          unsigned x_off, unsigned y_off,
+                          const uint8_t *src, size_t stride,
+                          unsigned *dx, unsigned *dy, uint8_t *dst);
+
+/* just the cells that changed: a bitmask of the whole grid laid out like
+ * an on/off frame, then the new level of each set bit, in order, packed
+ * like a level frame. returns the number of cells in the delta, or -1
+ * if the blob is malformed, in which case nothing is applied. */
+int sosc_led_level_delta(struct sosc_state *state, const uint8_t *data,
+                         size_t nbytes);
+
+void sosc_led_ring_set(struct sosc_state *state, unsigned ring, unsigned x,
+                       unsigned level);
+void sosc_led_ring_all(struct sosc_state *state, unsigned ring,
+                       unsigned level);
+void sosc_led_ring_map(struct sosc_state *state, unsigned ring,
+                       const uint8_t *levels);
+void sosc_led_ring_range(struct sosc_state *state, unsigned ring,
+                         unsigned start, unsigned end, unsigned level);
+
+/* the first nbytes / SOSC_LED_RING_FRAME_SIZE rings, packed like a level
+ * frame. returns the number of rings, or -1 if nbytes isn't a whole
+ * number of rings. */
+int sosc_led_ring_frame(struct sosc_state *state, const uint8_t *data,
+                        size_t nbytes);
+
+/* any number of segments, each three bytes (ring, first LED, count)
+ * followed by count levels, packed the same way. segments wrap around
+ * past the last LED like sosc_led_ring_range(). returns the number of
+ * LEDs in the delta, or -1 if the blob is malformed, in which case
+ * nothing is applied. */
+int sosc_led_ring_delta(struct sosc_state *state, const uint8_t *data,
+                        size_t nbytes);
+
+/* copy the back buffer to the front and send the difference. returns 1
+ * if anything changed, 0 if not or if the back buffer is off. */
+int sosc_led_commit(struct sosc_state *state);
+void sosc_led_set_back_buffered(struct sosc_state *state, int on);
+
+/* for whatever the device process draws by itself: straight to the front
+ * frame, whether the back buffer is on or not. */
+void sosc_led_put_front(struct sosc_state *state, unsigned x, unsigned y,
+                        unsigned level);
+
+/* called from the key handler. draws the press straight to the device
+ * according to state->config.dev.echo. */
+void sosc_led_echo_key(struct sosc_state *state, unsigned x, unsigned y,
+                       int down);
+
+/* claim (or give back) a rectangle of the grid from local echo */
+void sosc_led_echo_own(struct sosc_state *state, unsigned x, unsigned y,
+                       unsigned w, unsigned h, int own);
+
+/* put back anything a held key has lit, e.g. when echo is turned off */
+void sosc_led_echo_restore(struct sosc_state *state);
+
+void sosc_led_intensity(struct sosc_state *state, unsigned level);
+void sosc_led_ring_intensity(struct sosc_state *state, unsigned level);
+
+/* bracket a batch of LED calls that should reach the device together.
+ * these nest, and the last sosc_led_end() does the update. */
+void sosc_led_begin(struct sosc_state *state);
+void sosc_led_end(struct sosc_state *state);
+
+/* closes however many are still open, for when whatever opened them
+ * went away without closing them. does the same update. */
+void sosc_led_abort_transaction(struct sosc_state *state);
+
+void sosc_led_update(struct sosc_state *state);
+void sosc_led_flush(struct sosc_state *state);
+
+/* called by the scheduler once state->led.flush_deadline has passed */
+void sosc_led_tick(struct sosc_state *state, uint64_t now);
@@ -24,9 +24,60 @@
 				 lo_arg **argv, int argc,\
 				 lo_message data, void *user_data)
 
+/* these go into state->dispatch, see osc/dispatch.c. the LED methods are
+ * added without the prefix, so they don't need redoing when it changes. */
 void osc_register_sys_methods(sosc_state_t *state);
-
 void osc_register_methods(sosc_state_t *state);
-void osc_unregister_methods(sosc_state_t *state);
 
 char *osc_path(const char *path, const char *prefix);
+
+/* what to pass lo_send_from() as the server when replying to `to` */
+lo_server osc_reply_server(sosc_state_t *state, lo_address to);
+
+int  osc_outgoing_resolve(sosc_state_t *state);
+void osc_outgoing_build_templates(sosc_state_t *state);
+void osc_send_event(sosc_state_t *state, sosc_osc_event_t ev,
+                    const int32_t *args);
+
+/* more destinations for device events. a subscriber with a NULL or empty
+ * prefix uses config.app.osc_prefix, and one with a NULL port is a unix
+ * socket, with its path in host. both return -1 on failure, which for
+ * osc_subscribe() includes being full, a host that can't be resolved
+ * (which is done here, once), or, for a unix socket, not having one of
+ * our own to send from. */
+int  osc_subscribe(sosc_state_t *state, const char *host, const char *port,
+                   const char *prefix);
+int  osc_unsubscribe(sosc_state_t *state, const char *host,
+                     const char *port);
+void osc_unsubscribe_all(sosc_state_t *state);
+
+/* rebuild after the prefix changes. osc_fastpath_dispatch() returns -1,
+ * without having touched anything, if the datagram isn't one of the
+ * messages it knows. */
+void osc_fastpath_build(sosc_state_t *state);
+int  osc_fastpath_dispatch(sosc_state_t *state, const void *data,
+                           size_t nbytes);
+
+/* returns non-zero if it stopped at SOSC_OSC_RECV_BUDGET with datagrams
+ * possibly still waiting */
+int  osc_recv(sosc_state_t *state);
+int  osc_recv_unix(sosc_state_t *state);
+
+/* bundles timetagged for the future, held until they're due */
+uint64_t osc_scheduled_next(sosc_state_t *state);
+void osc_scheduled_run(sosc_state_t *state, uint64_t now);
+
+/* /enc/delta, held back and summed according to config.dev.enc_window.
+ * osc_enc_flush() sends whatever encoder n is holding right away. */
+void osc_send_enc_delta(sosc_state_t *state, unsigned n, int32_t delta);
+void osc_enc_flush(sosc_state_t *state, unsigned n);
+uint64_t osc_enc_next(sosc_state_t *state);
+void osc_enc_run(sosc_state_t *state, uint64_t now);
+
+/* /tilt, filtered and thinned out according to config.tilt */
+void osc_send_tilt(sosc_state_t *state, unsigned n, int32_t x, int32_t y,
+                   int32_t z);
+void osc_tilt_reset(sosc_state_t *state, unsigned n);
+
+void osc_bundle_begin(sosc_state_t *state);
+void osc_bundle_end(sosc_state_t *state);
@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <lo/lo.h>
+
+/* our own method table, in place of liblo's. liblo walks every method it
+ * has for every message and pattern-matches the path against each, and
+ * with every LED method registered under the app's prefix, changing the
+ * prefix meant tearing the lot down and adding it back. here, methods
+ * under the prefix are stored by the path after it ("grid/led/set"), and
+ * ones that aren't by their full path ("/sys/port"). both hash into the
+ * same buckets, and the typetag picks between methods on the same path.
+ * the prefix itself is just a string we compare against. */
+
+#define SOSC_OSC_DISPATCH_METHODS 128
+#define SOSC_OSC_DISPATCH_BUCKETS 256 /* power of two */
+#define SOSC_OSC_DISPATCH_MAX_ARGS 80
+
+struct sosc_osc_method {
+	const char *path;
+	const char *types; /* NULL takes anything */
+	lo_method_handler handler;
+	void *user_data;
+
+	uint32_t hash;
+	int next; /* next in the bucket, -1 at the end */
+};
+
+struct sosc_osc_dispatch {
+	const char *prefix;
+	size_t prefix_len;
+
+	struct sosc_osc_method methods[SOSC_OSC_DISPATCH_METHODS];
+	unsigned int nmethods;
+	int buckets[SOSC_OSC_DISPATCH_BUCKETS];
+};
+
+void osc_dispatch_init(struct sosc_osc_dispatch *d);
+
+/* the strings aren't copied, so they need to outlive the table. returns
+ * -1 if the table is full. */
+int osc_dispatch_add(struct sosc_osc_dispatch *d, const char *path,
+                     const char *types, lo_method_handler handler,
+                     void *user_data);
+
+/* same deal, the prefix isn't copied */
+void osc_dispatch_set_prefix(struct sosc_osc_dispatch *d, const char *prefix);
+
+/* look up and call the method(s) for an already-decoded message. paths
+ * with OSC wildcards in them are matched against every method, as liblo
+ * would. a handler returning non-zero passes the message on to the next
+ * method that matches, and if none is left this returns -1. */
+int osc_dispatch_call(struct sosc_osc_dispatch *d, const char *path,
+                      const char *types, lo_arg **argv, int argc,
+                      lo_message msg);
+
+/* decode a single OSC message in place (the arguments are byte-swapped
+ * into host order) and dispatch it. handlers get a NULL lo_message.
+ * returns 0 if a method took it, 1 if none did (the datagram has been
+ * swapped, so it can't go to liblo after that), or -1, with the datagram
+ * untouched, for bundles and anything we can't decode, which should go
+ * to lo_server_dispatch_data() instead. */
+int osc_dispatch_data(struct sosc_osc_dispatch *d, void *data,
+                      size_t nbytes);
+
+/* for lo_server_add_method(srv, NULL, NULL, ...), with the table as the
+ * user data, so that whatever liblo dispatches itself (bundles, and all of
+ * it where we let liblo do the reading) still ends up here */
+int osc_dispatch_lo_handler(const char *path, const char *types,
+                            lo_arg **argv, int argc, lo_message msg,
+                            void *user_data);
@@ -16,8 +16,14 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 char *sosc_get_default_config_dir(void);
 
+/* microseconds on a monotonic clock with an arbitrary epoch */
+uint64_t sosc_now_usec(void);
+
 char *s_asprintf(const char *fmt, ...);
 void *s_malloc(size_t size);
 void *s_calloc(size_t nmemb, size_t size);
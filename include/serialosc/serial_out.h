@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* LED output for mext grids doesn't go through libmonome's blocking
+ * writes. the framebuffer (see led.c) encodes mext packets into this
+ * queue, and it's only written out to a non-blocking handle on the
+ * serial port when the event loop reports the port writable, so a backed
+ * up USB link never holds up key input or OSC. */
+
+#define SOSC_SERIAL_OUT_SIZE 2048
+
+/* room LED flushes leave spare, so that the odd command that isn't part
+ * of the frame (intensity, tilt) can still be queued while they wait */
+#define SOSC_SERIAL_OUT_RESERVE 64
+
+/* tilt sensors whose on/off can be held back for want of room */
+#define SOSC_SERIAL_OUT_TILT_MAX 32
+
+struct sosc_state;
+
+struct sosc_serial_out {
+	/* our own non-blocking handle on the serial port, or -1 if LED
+	 * output goes through libmonome (not a mext device, or no way to
+	 * open the port a second time) */
+	int fd;
+
+	/* bytes waiting to go out are buf[head] to buf[tail - 1] */
+	uint8_t buf[SOSC_SERIAL_OUT_SIZE];
+	size_t head, tail;
+
+	/* set from when an LED flush first has to wait for room until the
+	 * queue next runs dry */
+	int congested;
+
+	/* commands that didn't fit even in the reserve, queued from the
+	 * write path once they do. only the latest of each matters: the
+	 * intensity (-1 if none is waiting) and, for each sensor with its
+	 * bit set in tilt_waiting, whether it's on in tilt_on. */
+	int intensity;
+	uint32_t tilt_waiting, tilt_on;
+};
+
+void sosc_serial_out_open(struct sosc_state *state);
+void sosc_serial_out_close(struct sosc_state *state);
+
+/* whether LED output should be queued. the queue only speaks mext, so it
+ * steps aside for anything else. */
+int sosc_serial_out_active(struct sosc_state *state);
+
+size_t sosc_serial_out_pending(struct sosc_state *state);
+size_t sosc_serial_out_space(struct sosc_state *state);
+
+/* room for nbytes at the end of the queue, or NULL if there isn't any.
+ * the bytes are queued as soon as this returns. */
+uint8_t *sosc_serial_out_reserve(struct sosc_state *state, size_t nbytes);
+
+/* writes as much as the port will take without blocking. called only
+ * when the event loop sees the port is writable, which it asks about
+ * whenever anything is queued. */
+void sosc_serial_out_write(struct sosc_state *state);
+
+/* tells the application (with /sys/congestion 1 or 0) when LED output
+ * starts backing up and when it's caught up again, so it can ease off on
+ * its frame rate. a no-op if nothing's changed. only the queue can tell,
+ * so /sys/info reports /sys/congestion -1 for devices without one. */
+void sosc_serial_out_set_congested(struct sosc_state *state, int congested);
+
+/* commands that aren't part of the LED frame, queued behind whatever's
+ * already waiting. they change the device's state once rather than
+ * drawing, so they're never dropped: without room, they're kept (the
+ * latest for each) until the write path makes some. the only failure is
+ * a tilt sensor past SOSC_SERIAL_OUT_TILT_MAX when the queue is full. */
+void sosc_serial_out_intensity(struct sosc_state *state, unsigned level);
+int sosc_serial_out_tilt(struct sosc_state *state, unsigned sensor, int on);
@@ -25,10 +25,27 @@
 #endif
 #endif
 
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#endif
+
+#include <stdint.h>
+
 #include <lo/lo.h>
 #include <monome.h>
 
 #include <serialosc/platform.h>
+#include <serialosc/dgram.h>
+#include <serialosc/stats.h>
+#include <serialosc/led.h>
+#include <serialosc/anim.h>
+#include <serialosc/tile.h>
+#include <serialosc/serial_out.h>
+#include <serialosc/timer_wheel.h>
+#include <serialosc/osc_dispatch.h>
 
 #define SOSC_SUPERVISOR_OSC_PORT "12002"
 #define SOSC_WIN_SERVICE_NAME "serialosc"
@@ -36,22 +53,224 @@
 #define container_of(ptr, type, member) \
 	((type *) ((char *) (ptr) - offsetof(type, member)))
 
+/* tilt sensors that can be configured separately (see config.tilt), and
+ * the most smoothing any of them can have */
+#define SOSC_OSC_TILT_MAX 4
+#define SOSC_TILT_SMOOTHING_MAX 8
+
+typedef enum {
+	SOSC_ECHO_OFF,
+	SOSC_ECHO_MOMENTARY, /* lit while held */
+	SOSC_ECHO_TOGGLE,    /* each press flips the LED */
+
+	SOSC_ECHO_MAX
+} sosc_echo_mode_t;
+
 typedef struct {
 	struct {
 		char port[6];
+
+		/* also listen on a unix datagram socket in the config
+		 * directory, see server.c */
+		int unix_socket;
 	} server;
 
 	struct {
 		char *osc_prefix;
 		char *host;
 		char port[6];
+
+		int bundle_events;
 	} app;
 
 	struct {
 		monome_rotate_t rotation;
+
+		/* LED flush clock in Hz, 0 to flush every change immediately */
+		int led_refresh_rate;
+
+		/* keys light their own LEDs, see sosc_led_echo_key() */
+		sosc_echo_mode_t echo;
+
+		/* milliseconds over which each encoder's deltas are summed
+		 * into one /enc/delta, 0 to send every one */
+		int enc_window;
 	} dev;
+
+	/* one for each tilt sensor, see osc/outgoing.c */
+	struct {
+		/* samples sent a second at most, 0 for no limit */
+		int rate;
+
+		/* how far an axis has to move from what was last sent */
+		int deadband;
+
+		/* strength of the low-pass filter, 0 (off) to
+		 * SOSC_TILT_SMOOTHING_MAX */
+		int smoothing;
+	} tilt[SOSC_OSC_TILT_MAX];
 } sosc_config_t;
 
+/* outgoing device events, each of which gets a prebuilt OSC message
+ * template (see osc/outgoing.c) */
+typedef enum {
+	SOSC_OSC_GRID_KEY,
+	SOSC_OSC_ENC_DELTA,
+	SOSC_OSC_ENC_KEY,
+	SOSC_OSC_TILT,
+
+	SOSC_OSC_EVENT_MAX
+} sosc_osc_event_t;
+
+#define SOSC_OSC_TEMPLATE_SIZE 128
+
+/* the hottest incoming LED messages, which osc/fastpath.c picks out of
+ * the receive buffer before they get anywhere near a method table */
+typedef enum {
+	SOSC_OSC_FAST_LED_SET,
+	SOSC_OSC_FAST_LED_MAP,
+	SOSC_OSC_FAST_LED_LEVEL_SET,
+	SOSC_OSC_FAST_LED_LEVEL_MAP,
+	SOSC_OSC_FAST_RING_SET,
+	SOSC_OSC_FAST_RING_MAP,
+
+	SOSC_OSC_FAST_MAX
+} sosc_osc_fast_t;
+
+#define SOSC_OSC_FAST_HEADER_SIZE 192
+
+typedef struct {
+	/* the address and typetag, padded, exactly as they'll arrive */
+	uint8_t header[SOSC_OSC_FAST_HEADER_SIZE];
+	size_t header_nbytes;
+
+	/* the length of the whole datagram, 0 if the prefix didn't fit */
+	size_t nbytes;
+} sosc_osc_fast_template_t;
+
+/* encoders whose deltas can be held back for config.dev.enc_window. any
+ * others go straight out. */
+#define SOSC_OSC_ENC_MAX 4
+
+/* coalesced input events are sent in bundles no larger than this, which
+ * keeps them inside a single ethernet frame. */
+#define SOSC_OSC_BUNDLE_SIZE 1472
+
+typedef struct {
+	uint8_t buf[SOSC_OSC_TEMPLATE_SIZE];
+
+	/* offset of the first int32 argument in buf, and the length of the
+	 * whole datagram. nbytes is 0 if the prefix didn't fit. */
+	size_t args_offset;
+	size_t nbytes;
+} sosc_osc_template_t;
+
+/* extra destinations added with /sys/subscribe. device events go to each
+ * of them as well as to state->outgoing. */
+#define SOSC_OSC_SUBSCRIBERS_MAX 8
+
+typedef struct {
+	lo_address addr;
+
+	/* set if addr is a unix socket rather than a host and port, in
+	 * which case events go out through state->unix_sock */
+	char *path;
+
+	/* addr, resolved. salen is 0 if that failed. */
+	struct sockaddr_storage sa;
+	socklen_t salen;
+
+	/* NULL to share config.app.osc_prefix, in which case the events are
+	 * the very same datagrams that go to state->outgoing, and templates
+	 * isn't used */
+	char *prefix;
+	sosc_osc_template_t templates[SOSC_OSC_EVENT_MAX];
+} sosc_osc_subscriber_t;
+
+/* incoming datagrams dispatched per wakeup before we go back and give the
+ * serial port a turn, and the power-of-two buckets that the per-wakeup
+ * counts are sorted into (1, 2-3, 4-7, ... 64) */
+#define SOSC_OSC_RECV_BUDGET  64
+#define SOSC_OSC_RECV_BUCKETS 7
+
+struct sosc_stats {
+	uint64_t osc_events_prebuilt;
+	uint64_t osc_events_allocated;
+
+	uint64_t osc_bundles_sent;
+	uint64_t osc_datagrams_saved;
+
+	/* datagrams to /sys/subscribe destinations that the kernel took */
+	uint64_t osc_fanout_datagrams;
+
+	/* deltas read from the encoders, and /enc/delta messages sent */
+	uint64_t enc_deltas_received;
+	uint64_t enc_deltas_sent;
+
+	/* likewise for tilt samples and /tilt */
+	uint64_t tilt_samples_received;
+	uint64_t tilt_samples_sent;
+
+	/* what passing every LED call straight through would have cost on
+	 * the serial link, and what the framebuffer actually wrote */
+	uint64_t led_bytes_requested;
+	uint64_t led_bytes_written;
+
+	/* incoming bundles applied to the framebuffer as a whole */
+	uint64_t led_transactions;
+
+	/* incoming datagrams (those dropped, and messages no method took), and
+	 * how many were read per wakeup */
+	uint64_t osc_datagrams_received;
+	uint64_t osc_datagrams_dropped;
+	uint64_t osc_messages_unhandled;
+	uint64_t osc_fastpath_hits;
+
+	/* bundles timetagged for the future: put on the timer wheel, applied
+	 * more than a millisecond late (including any that arrived late), and
+	 * applied early because the wheel was full */
+	uint64_t osc_bundles_scheduled;
+	uint64_t osc_bundles_late;
+	uint64_t osc_bundles_overflowed;
+	uint64_t osc_recv_batches[SOSC_OSC_RECV_BUCKETS];
+
+	/* the serial output queue. write_usec is time spent inside write(),
+	 * which should stay near zero since the fd never blocks. queued is
+	 * the current depth. commands_deferred counts intensity and tilt
+	 * commands held back until there was room for them. */
+	uint64_t serial_out_bytes;
+	uint64_t serial_out_writes;
+	uint64_t serial_out_full;
+	uint64_t serial_out_write_usec;
+	uint64_t serial_out_write_usec_max;
+	uint64_t serial_out_queued;
+	uint64_t serial_out_queued_max;
+	uint64_t serial_out_bytes_dropped;
+	uint64_t serial_out_congestion_events;
+	uint64_t serial_out_commands_deferred;
+	uint64_t led_flushes_deferred;
+
+	/* /grid/led/level/delta */
+	uint64_t led_deltas_applied;
+	uint64_t led_deltas_lost;
+	uint64_t led_deltas_stale;
+	uint64_t led_resync_requests;
+
+	/* /grid/led/commit */
+	uint64_t led_commits;
+
+	/* key presses drawn by local echo */
+	uint64_t led_echoes;
+
+	/* steps drawn by /grid/led/anim/ animations */
+	uint64_t led_anim_steps;
+
+	/* /grid/led/tile/blit */
+	uint64_t led_tile_blits;
+
+	struct sosc_hist latency[SOSC_LATENCY_MAX];
+};
+
 typedef struct sosc_state {
 	int running;
 
@@ -62,6 +281,13 @@ typedef struct sosc_state {
 	int ipc_in_fd;
 	int ipc_out_fd;
 
+	/* the same OSC methods as server, for apps on this machine. fd is
+	 * -1 unless config.server.unix_socket is set. */
+	struct {
+		int fd;
+		char *path;
+	} unix_sock;
+
 #ifdef SOSC_ZEROCONF
 #ifdef _WIN32
 	PDNS_SERVICE_INSTANCE dnssd_service_ref;
@@ -70,11 +296,87 @@ typedef struct sosc_state {
 #endif
 #endif
 
+	struct {
+		sosc_osc_template_t templates[SOSC_OSC_EVENT_MAX];
+
+		/* state->outgoing, resolved once so that events can be sent
+		 * straight from the server socket. 0 if it couldn't be
+		 * resolved, in which case liblo sends them. */
+		struct sockaddr_storage addr;
+		socklen_t addrlen;
+
+		/* events drained in one wakeup, waiting to go out as one
+		 * bundle. only used if config.app.bundle_events is set. */
+		struct {
+			int open;
+			unsigned int nmsgs;
+			size_t nbytes;
+			uint8_t buf[SOSC_OSC_BUNDLE_SIZE];
+		} bundle;
+
+		sosc_osc_subscriber_t subscribers[SOSC_OSC_SUBSCRIBERS_MAX];
+		unsigned int nsubscribers;
+
+		/* encoder deltas summed but not sent yet, when each encoder
+		 * last sent one, and when the earliest of them is due (0 if
+		 * none are waiting). see osc/outgoing.c. */
+		struct {
+			int32_t pending[SOSC_OSC_ENC_MAX];
+			uint64_t last_sent[SOSC_OSC_ENC_MAX];
+			uint64_t deadline;
+		} enc;
+
+		/* each tilt sensor's filtered position (in 1/256ths), what was
+		 * last sent, and when. primed is clear until the first sample
+		 * after the sensor is enabled. */
+		struct sosc_osc_tilt {
+			int32_t filtered[3];
+			int32_t sent[3];
+			uint64_t last_sent;
+			int primed;
+		} tilt[SOSC_OSC_TILT_MAX];
+	} out;
+
+	/* see osc/dispatch.c */
+	struct sosc_osc_dispatch dispatch;
+
+	struct {
+		/* NULL if it couldn't be allocated, in which case we fall back
+		 * to letting liblo read one datagram at a time */
+		sosc_dgram_batch_t *batch;
+
+		/* sosc_now_usec() when we went to read the serial port for the
+		 * event being handled, and when the datagram being dispatched
+		 * was received (0 outside of dispatch). */
+		uint64_t serial_read_at;
+		uint64_t osc_recv_at;
+
+		/* see osc/incoming.c */
+		struct sosc_timer_wheel scheduled;
+
+		/* see osc/fastpath.c */
+		sosc_osc_fast_template_t fast[SOSC_OSC_FAST_MAX];
+	} in;
+
+	struct sosc_led led;
+	struct sosc_anims anim;
+	struct sosc_tiles tiles;
+	struct sosc_serial_out serial_out;
+	struct sosc_stats stats;
+
 	sosc_config_t config;
 } sosc_state_t;
 
 int  sosc_event_loop(struct sosc_state *state);
-void sosc_server_run(const char *config_dir, monome_t *monome);
+void sosc_server_run(const char *config_dir, int unix_socket,
+                     monome_t *monome);
+
+int  sosc_serial_handle_next(struct sosc_state *state);
+void sosc_server_report_stats(struct sosc_state *state, uint32_t seq);
+
+uint64_t sosc_scheduler_next_deadline(struct sosc_state *state);
+int  sosc_scheduler_timeout(struct sosc_state *state);
+void sosc_scheduler_run(struct sosc_state *state);
 
 int sosc_config_create_directory();
 int sosc_config_read(const char *config_dir, const char *serial, sosc_config_t *config);
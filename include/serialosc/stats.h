@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/* latency histograms, in microseconds, log-linear: values below
+ * SOSC_HIST_SUB_COUNT get a bucket each, and above that every power of
+ * two is split into SOSC_HIST_SUB_COUNT buckets, so a bucket is never
+ * wider than 1/8th of the values in it. anything past 2^26us (about a
+ * minute) lands in the last bucket.
+ *
+ * on windows the serial and OSC sides run on different threads from the
+ * one that reports, hence the atomics. relaxed ordering is plenty, we
+ * only need each counter to be right on its own. */
+
+#define SOSC_HIST_SUB_BITS  3
+#define SOSC_HIST_SUB_COUNT (1 << SOSC_HIST_SUB_BITS)
+#define SOSC_HIST_MAX_EXP   26
+#define SOSC_HIST_BUCKETS \
+	((SOSC_HIST_MAX_EXP - SOSC_HIST_SUB_BITS + 2) * SOSC_HIST_SUB_COUNT)
+
+typedef enum {
+	SOSC_LATENCY_KEY, /* serial read -> OSC send, for grid keys */
+	SOSC_LATENCY_LED, /* OSC receipt -> serial write */
+	SOSC_LATENCY_BUNDLE, /* bundle timetag -> dispatch */
+
+	SOSC_LATENCY_MAX
+} sosc_latency_path_t;
+
+struct sosc_hist {
+	atomic_uint_fast64_t counts[SOSC_HIST_BUCKETS];
+	atomic_uint_fast64_t max;
+};
+
+/* what gets reported, over OSC and IPC */
+struct sosc_latency_summary {
+	uint64_t count;
+	uint32_t p50;
+	uint32_t p99;
+	uint32_t p999;
+	uint32_t max;
+};
+
+const char *sosc_latency_path_name(sosc_latency_path_t path);
+
+void sosc_hist_record(struct sosc_hist *hist, uint64_t usec);
+void sosc_hist_summarize(struct sosc_hist *hist,
+                         struct sosc_latency_summary *summary);
+
+/* folds one device's summary into a running total. percentiles can't be
+ * combined exactly, so the total's are the worst of any device's. */
+void sosc_latency_summary_merge(struct sosc_latency_summary *total,
+                                const struct sosc_latency_summary *s);
@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* small images (digits, arrows, step patterns) that an app uploads once
+ * and then draws by number, rather than sending the same levels over
+ * again every time. see src/serialosc-device/tile.c. */
+
+#define SOSC_TILE_MAX      64
+#define SOSC_TILE_SIZE_MAX 16 /* in either direction */
+
+struct sosc_tile {
+	unsigned w, h;
+
+	/* one level per byte, row by row. NULL if the tile isn't defined. */
+	uint8_t *levels;
+};
+
+struct sosc_tiles {
+	struct sosc_tile tile[SOSC_TILE_MAX];
+};
+
+struct sosc_state;
+
+/* data is levels packed two to a byte, high nibble first, like
+ * /grid/led/level/frame. returns -1 if id or the size is out of range or
+ * nbytes doesn't match it, leaving any existing tile id as it was. */
+int sosc_tile_define(struct sosc_state *state, unsigned id, unsigned w,
+                     unsigned h, const uint8_t *data, size_t nbytes);
+
+/* draws tile id with its top left corner at x, y, clipping whatever falls
+ * off the grid. if transparent is set, cells at level 0 are skipped.
+ * returns the number of cells drawn, or -1 if the tile isn't defined. */
+int sosc_tile_blit(struct sosc_state *state, unsigned id, int x, int y,
+                   int transparent);
+
+void sosc_tile_forget(struct sosc_state *state, unsigned id);
+void sosc_tile_forget_all(struct sosc_state *state);
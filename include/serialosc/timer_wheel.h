@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* datagrams held until a particular sosc_now_usec(), for OSC bundles with
+ * a timetag in the future. a hashed wheel: timers are filed into a slot
+ * by the millisecond they're due in, so adding one and finding the next
+ * are cheap however many are waiting, as long as most of them are due
+ * within the next SOSC_TIMER_WHEEL_SLOTS milliseconds. */
+
+#define SOSC_TIMER_WHEEL_SLOTS      256 /* power of two */
+#define SOSC_TIMER_WHEEL_TICK_USEC  1000
+#define SOSC_TIMER_WHEEL_MAX        256
+
+struct sosc_timer {
+	struct sosc_timer *next;
+	uint64_t deadline;
+
+	size_t nbytes;
+	uint8_t data[];
+};
+
+struct sosc_timer_wheel {
+	/* each slot's timers are sorted by deadline */
+	struct sosc_timer *slots[SOSC_TIMER_WHEEL_SLOTS];
+
+	/* no timer is due in a tick before this one */
+	uint64_t cursor;
+	unsigned int count;
+};
+
+typedef void (*sosc_timer_cb_t)(void *ctx, struct sosc_timer *timer);
+
+/* copies the data. returns -1 if the wheel is full or out of memory. */
+int sosc_timer_wheel_add(struct sosc_timer_wheel *wheel, uint64_t deadline,
+                         const void *data, size_t nbytes);
+
+/* the earliest deadline, or 0 if nothing is waiting */
+uint64_t sosc_timer_wheel_next(struct sosc_timer_wheel *wheel);
+
+/* hands every timer due by now to cb, in deadline order, and frees it */
+void sosc_timer_wheel_expire(struct sosc_timer_wheel *wheel, uint64_t now,
+                             sosc_timer_cb_t cb, void *ctx);
+
+void sosc_timer_wheel_clear(struct sosc_timer_wheel *wheel);
@@ -0,0 +1,346 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* recvmmsg() and sendmmsg() are GNU extensions */
+#if (defined(HAVE_RECVMMSG) || defined(HAVE_SENDMMSG)) \
+	&& !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#include <serialosc/platform.h>
+#include <serialosc/dgram.h>
+
+/* liblo reads one datagram per lo_server_recv_noblock(), so a burst of
+ * LED messages costs a poll() and a recvfrom() each. this pulls as many
+ * as are waiting (up to a limit) in as few syscalls as the platform
+ * allows, and the caller dispatches them itself. */
+
+struct sosc_dgram_batch {
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr msgs[SOSC_DGRAM_BATCH_SIZE];
+	struct iovec iov[SOSC_DGRAM_BATCH_SIZE];
+#endif
+
+	struct sosc_dgram dgrams[SOSC_DGRAM_BATCH_SIZE];
+	uint8_t buf[SOSC_DGRAM_BATCH_SIZE][SOSC_DGRAM_MAX_SIZE];
+};
+
+sosc_dgram_batch_t *
+sosc_dgram_batch_new(void)
+{
+	sosc_dgram_batch_t *batch;
+	int i;
+
+	if (!(batch = s_calloc(1, sizeof(*batch))))
+		return NULL;
+
+	for (i = 0; i < SOSC_DGRAM_BATCH_SIZE; i++)
+		batch->dgrams[i].data = batch->buf[i];
+
+	return batch;
+}
+
+void
+sosc_dgram_batch_free(sosc_dgram_batch_t *batch)
+{
+	s_free(batch);
+}
+
+/* recv_some() reads up to count datagrams and returns how many it took
+ * off the socket (fewer than count means the socket is empty), or -1 on
+ * error. the ones worth dispatching end up at the start of
+ * batch->dgrams, with their number in *nkept. */
+
+#ifdef HAVE_RECVMMSG
+
+static int
+recv_some(sosc_dgram_batch_t *batch, int fd, unsigned int count,
+          unsigned int *nkept, unsigned int *ndropped)
+{
+	struct mmsghdr *m;
+	int i, n;
+
+	for (i = 0; i < count; i++) {
+		batch->iov[i].iov_base = batch->buf[i];
+		batch->iov[i].iov_len  = SOSC_DGRAM_MAX_SIZE;
+
+		m = &batch->msgs[i];
+		memset(&m->msg_hdr, 0, sizeof(m->msg_hdr));
+		m->msg_hdr.msg_name    = &batch->dgrams[i].from;
+		m->msg_hdr.msg_namelen = sizeof(batch->dgrams[i].from);
+		m->msg_hdr.msg_iov     = &batch->iov[i];
+		m->msg_hdr.msg_iovlen  = 1;
+	}
+
+	*nkept = 0;
+
+	do {
+		n = recvmmsg(fd, batch->msgs, count, MSG_DONTWAIT, NULL);
+	} while (n < 0 && errno == EINTR);
+
+	if (n < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+
+	for (i = 0; i < n; i++) {
+		m = &batch->msgs[i];
+
+		if (m->msg_hdr.msg_flags & MSG_TRUNC) {
+			if (ndropped)
+				(*ndropped)++;
+			continue;
+		}
+
+		if (*nkept != i)
+			memcpy(&batch->dgrams[*nkept].from, &batch->dgrams[i].from,
+			       m->msg_hdr.msg_namelen);
+
+		batch->dgrams[*nkept].data    = batch->buf[i];
+		batch->dgrams[*nkept].nbytes  = m->msg_len;
+		batch->dgrams[*nkept].fromlen = m->msg_hdr.msg_namelen;
+		(*nkept)++;
+	}
+
+	return n;
+}
+
+#else /* !HAVE_RECVMMSG */
+
+static int
+readable(int fd)
+{
+	struct timeval tv = {0, 0};
+	fd_set rfds;
+
+	FD_ZERO(&rfds);
+	FD_SET(fd, &rfds);
+
+	return select(fd + 1, &rfds, NULL, NULL, &tv) > 0;
+}
+
+/* one recvfrom() per datagram, but still without going back through the
+ * event loop for each one. */
+static int
+recv_some(sosc_dgram_batch_t *batch, int fd, unsigned int count,
+          unsigned int *nkept, unsigned int *ndropped)
+{
+	struct sosc_dgram *d;
+	int i, n;
+
+	*nkept = 0;
+
+	for (i = 0; i < count && readable(fd); i++) {
+		d = &batch->dgrams[*nkept];
+		d->data = batch->buf[*nkept];
+		d->fromlen = sizeof(d->from);
+
+		n = recvfrom(fd, d->data, SOSC_DGRAM_MAX_SIZE, 0,
+		             (struct sockaddr *) &d->from, &d->fromlen);
+
+		/* posix truncates silently, windows returns an error. either
+		 * way, the datagram is gone. */
+		if (n < 0 || n >= SOSC_DGRAM_MAX_SIZE) {
+			if (ndropped)
+				(*ndropped)++;
+			continue;
+		}
+
+		d->nbytes = n;
+		(*nkept)++;
+	}
+
+	return i;
+}
+
+#endif
+
+int
+sosc_dgram_recv(sosc_dgram_batch_t *batch, int fd, unsigned int max,
+                sosc_dgram_cb_t *cb, void *ctx, unsigned int *ndropped)
+{
+	unsigned int total, count, nkept, i;
+	int nread;
+
+	for (total = 0; total < max; total += nread) {
+		count = max - total;
+		if (count > SOSC_DGRAM_BATCH_SIZE)
+			count = SOSC_DGRAM_BATCH_SIZE;
+
+		if ((nread = recv_some(batch, fd, count, &nkept, ndropped)) < 0)
+			return total ? total : -1;
+
+		for (i = 0; i < nkept; i++)
+			cb(ctx, &batch->dgrams[i]);
+
+		if (nread < count) {
+			total += nread;
+			break;
+		}
+	}
+
+	return total;
+}
+
+/*************************************************************************
+ * sending
+ *************************************************************************/
+
+#ifdef HAVE_SENDMMSG
+
+int
+sosc_dgram_send(int fd, const struct sosc_dgram_out *out, unsigned int count)
+{
+	struct mmsghdr msgs[SOSC_DGRAM_BATCH_SIZE];
+	struct iovec iov[SOSC_DGRAM_BATCH_SIZE];
+	unsigned int done, sent, chunk, i;
+	int n;
+
+	for (done = sent = 0; done < count; done += n) {
+		chunk = count - done;
+		if (chunk > SOSC_DGRAM_BATCH_SIZE)
+			chunk = SOSC_DGRAM_BATCH_SIZE;
+
+		for (i = 0; i < chunk; i++) {
+			iov[i].iov_base = (void *) out[done + i].data;
+			iov[i].iov_len  = out[done + i].nbytes;
+
+			memset(&msgs[i], 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name    = (void *) out[done + i].to;
+			msgs[i].msg_hdr.msg_namelen = out[done + i].tolen;
+			msgs[i].msg_hdr.msg_iov     = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen  = 1;
+		}
+
+		do {
+			n = sendmmsg(fd, msgs, chunk, MSG_DONTWAIT);
+		} while (n < 0 && errno == EINTR);
+
+		/* sendmmsg() stops at the first one that fails. skip it, the
+		 * rest may well go through. */
+		if (n <= 0) {
+			n = 1;
+			continue;
+		}
+
+		sent += n;
+	}
+
+	return sent;
+}
+
+#else /* !HAVE_SENDMMSG */
+
+int
+sosc_dgram_send(int fd, const struct sosc_dgram_out *out, unsigned int count)
+{
+	unsigned int i, sent = 0;
+
+	for (i = 0; i < count; i++)
+		if (sendto(fd, (const void *) out[i].data, out[i].nbytes, 0,
+		           out[i].to, out[i].tolen) >= 0)
+			sent++;
+
+	return sent;
+}
+
+#endif
+
+/*************************************************************************
+ * unix domain sockets
+ *************************************************************************/
+
+#ifndef WIN32
+
+socklen_t
+sosc_dgram_unix_addr(struct sockaddr_storage *sa, const char *path)
+{
+	struct sockaddr_un *un = (struct sockaddr_un *) sa;
+	size_t len = strlen(path);
+
+	if (!len || len >= sizeof(un->sun_path))
+		return 0;
+
+	memset(un, 0, sizeof(*un));
+	un->sun_family = AF_UNIX;
+	memcpy(un->sun_path, path, len);
+
+	return offsetof(struct sockaddr_un, sun_path) + len + 1;
+}
+
+int
+sosc_dgram_unix_open(const char *path)
+{
+	struct sockaddr_storage sa;
+	struct stat st;
+	socklen_t salen;
+	int fd;
+
+	if (!(salen = sosc_dgram_unix_addr(&sa, path))) {
+		fprintf(stderr, "sosc_dgram_unix_open(): %s is too long\n", path);
+		return -1;
+	}
+
+	/* left behind by a process that didn't get to clean up. anything
+	 * that isn't a socket, we leave alone and fail on. */
+	if (!lstat(path, &st) && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	if ((fd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+		goto err_socket;
+
+	if (bind(fd, (struct sockaddr *) &sa, salen))
+		goto err_bind;
+
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK)
+	    || fcntl(fd, F_SETFD, FD_CLOEXEC))
+		goto err_fcntl;
+
+	return fd;
+
+err_fcntl:
+	unlink(path);
+err_bind:
+	close(fd);
+err_socket:
+	fprintf(stderr, "sosc_dgram_unix_open(): %s: %s\n", path, strerror(errno));
+	return -1;
+}
+
+void
+sosc_dgram_unix_close(int fd, const char *path)
+{
+	if (fd < 0)
+		return;
+
+	close(fd);
+	unlink(path);
+}
+
+#endif
@@ -118,6 +118,15 @@ sosc_ipc_msg_read(int fd, sosc_ipc_msg_t *buf)
 		                 &buf->device_info.friendly))
 			return -1;
 
+		break;
+
+	case SOSC_OSC_UNIX_PATH:
+		buf->unix_path.path = NULL;
+		if (read_strdata(fd, 1, &buf->unix_path.path))
+			return -1;
+
+		break;
+
 	default:
 		break;
 	}
@@ -209,10 +218,19 @@ sosc_ipc_msg_to_buf(uint8_t *buf, size_t nbytes, sosc_ipc_msg_t *msg)
 			return -1;
 		break;
 
+	case SOSC_OSC_UNIX_PATH:
+		strbytes = strdata_to_buf(buf, nbytes, 1, msg->unix_path.path);
+
+		if (strbytes < 0)
+			return -1;
+		break;
+
 	case SOSC_DEVICE_READY:
 	case SOSC_DEVICE_DISCONNECTION:
 	case SOSC_OSC_PORT_CHANGE:
+	case SOSC_STATS_REPORT:
 	case SOSC_PROCESS_SHOULD_EXIT:
+	case SOSC_STATS_REQUEST:
 		strbytes = 0;
 		break;
 
@@ -324,10 +342,23 @@ sosc_ipc_msg_from_buf(uint8_t *buf, size_t nbytes, sosc_ipc_msg_t **msg)
 			goto invalid_msg;
 		break;
 
+	case SOSC_OSC_UNIX_PATH:
+		(*msg)->unix_path.path = NULL;
+
+		strbytes = strdata_from_buf(
+			buf, nbytes, 1,
+			&(*msg)->unix_path.path);
+
+		if (strbytes < 0)
+			goto invalid_msg;
+		break;
+
 	case SOSC_DEVICE_READY:
 	case SOSC_DEVICE_DISCONNECTION:
 	case SOSC_OSC_PORT_CHANGE:
+	case SOSC_STATS_REPORT:
 	case SOSC_PROCESS_SHOULD_EXIT:
+	case SOSC_STATS_REQUEST:
 		strbytes = 0;
 		break;
 
@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
 
 #include <serialosc/serialosc.h>
 
@@ -36,6 +37,15 @@ s_asprintf(const char *fmt, ...)
 	return buf;
 }
 
+uint64_t
+sosc_now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
 void *
 s_malloc(size_t size)
 {
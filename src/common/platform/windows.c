@@ -27,6 +27,7 @@
 #include <errno.h>
 
 #include <direct.h>
+#include <windows.h>
 
 #include <serialosc/platform.h>
 
@@ -97,6 +98,19 @@ s_asprintf(const char *fmt, ...)
 	return buf;
 }
 
+uint64_t
+sosc_now_usec(void)
+{
+	LARGE_INTEGER count, freq;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+
+	return ((uint64_t) count.QuadPart / freq.QuadPart) * 1000000
+		+ (((uint64_t) count.QuadPart % freq.QuadPart) * 1000000)
+			/ freq.QuadPart;
+}
+
 void *
 s_malloc(size_t size)
 {
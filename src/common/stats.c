@@ -0,0 +1,163 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include <serialosc/stats.h>
+
+#define HIST_SUB_MASK (SOSC_HIST_SUB_COUNT - 1)
+
+static const char *latency_path_names[SOSC_LATENCY_MAX] = {
+	[SOSC_LATENCY_KEY] = "key",
+	[SOSC_LATENCY_LED] = "led",
+	[SOSC_LATENCY_BUNDLE] = "bundle"
+};
+
+const char *
+sosc_latency_path_name(sosc_latency_path_t path)
+{
+	if (path < 0 || path >= SOSC_LATENCY_MAX)
+		return "unknown";
+
+	return latency_path_names[path];
+}
+
+static int
+highest_bit(uint64_t v)
+{
+	int bit = 0;
+
+	while (v >>= 1)
+		bit++;
+
+	return bit;
+}
+
+static unsigned int
+bucket_for(uint64_t usec)
+{
+	int exp;
+
+	if (usec < SOSC_HIST_SUB_COUNT)
+		return usec;
+
+	if ((exp = highest_bit(usec)) > SOSC_HIST_MAX_EXP)
+		return SOSC_HIST_BUCKETS - 1;
+
+	return ((exp - SOSC_HIST_SUB_BITS + 1) * SOSC_HIST_SUB_COUNT)
+		+ ((usec >> (exp - SOSC_HIST_SUB_BITS)) & HIST_SUB_MASK);
+}
+
+/* the largest value that lands in a bucket */
+static uint64_t
+bucket_top(unsigned int bucket)
+{
+	int shift;
+
+	if (bucket < SOSC_HIST_SUB_COUNT)
+		return bucket;
+
+	shift = (bucket / SOSC_HIST_SUB_COUNT) - 1;
+
+	return ((uint64_t) (SOSC_HIST_SUB_COUNT + (bucket & HIST_SUB_MASK))
+	        << shift) + ((uint64_t) 1 << shift) - 1;
+}
+
+void
+sosc_hist_record(struct sosc_hist *hist, uint64_t usec)
+{
+	uint_fast64_t max;
+
+	atomic_fetch_add_explicit(&hist->counts[bucket_for(usec)], 1,
+	                          memory_order_relaxed);
+
+	max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+
+	while (usec > max
+	       && !atomic_compare_exchange_weak_explicit(&hist->max, &max, usec,
+	               memory_order_relaxed, memory_order_relaxed));
+}
+
+static uint32_t
+clamp_u32(uint64_t v)
+{
+	return (v > UINT32_MAX) ? UINT32_MAX : v;
+}
+
+void
+sosc_hist_summarize(struct sosc_hist *hist,
+                    struct sosc_latency_summary *summary)
+{
+	uint64_t counts[SOSC_HIST_BUCKETS], total, seen, max;
+	struct {
+		uint32_t *dst;
+		uint64_t per10k;
+	} quantiles[] = {
+		{&summary->p50,  5000},
+		{&summary->p99,  9900},
+		{&summary->p999, 9990}
+	};
+	unsigned int i, q;
+
+	/* the counts can move under us while we're reading them, so take a
+	 * copy and work out everything from that. */
+	for (total = 0, i = 0; i < SOSC_HIST_BUCKETS; i++)
+		total += counts[i] = atomic_load_explicit(&hist->counts[i],
+		                                          memory_order_relaxed);
+
+	max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+
+	summary->count = total;
+	summary->max   = clamp_u32(max);
+	summary->p50 = summary->p99 = summary->p999 = 0;
+
+	if (!total)
+		return;
+
+	for (seen = 0, q = 0, i = 0; i < SOSC_HIST_BUCKETS; i++) {
+		seen += counts[i];
+
+		/* a quantile is the top of the first bucket that gets us past
+		 * it, but never more than the largest value actually seen */
+		for (; q < sizeof(quantiles) / sizeof(*quantiles)
+		       && seen * 10000 >= total * quantiles[q].per10k; q++) {
+			*quantiles[q].dst = clamp_u32(
+				(bucket_top(i) < max) ? bucket_top(i) : max);
+		}
+	}
+}
+
+#define WORST(field) \
+	total->field = (s->field > total->field) ? s->field : total->field
+
+void
+sosc_latency_summary_merge(struct sosc_latency_summary *total,
+                           const struct sosc_latency_summary *s)
+{
+	total->count += s->count;
+
+	/* a device with nothing recorded has no say in the percentiles */
+	if (!s->count)
+		return;
+
+	WORST(p50);
+	WORST(p99);
+	WORST(p999);
+	WORST(max);
+}
+
+#undef WORST
@@ -0,0 +1,367 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include <serialosc/serialosc.h>
+#include <serialosc/platform.h>
+#include <serialosc/led.h>
+#include <serialosc/anim.h>
+
+/* animations draw with sosc_led_put_front(), like local echo, so they
+ * carry on with the back buffer turned on. each step is drawn when it
+ * comes due but goes out through sosc_led_update(), so animations that
+ * step together, or faster than the refresh clock, still cost a single
+ * flush a tick. if we're held up, an animation skips ahead to wherever it
+ * should be by now rather than playing the missed steps back to back. */
+
+static void
+fill(sosc_state_t *state, const struct sosc_anim *a, unsigned level)
+{
+	unsigned x, y;
+
+	for (y = a->y; y < a->y + a->h; y++)
+		for (x = a->x; x < a->x + a->w; x++)
+			sosc_led_put_front(state, x, y, level);
+}
+
+static void
+draw(sosc_state_t *state, const struct sosc_anim *a)
+{
+	const uint8_t *src;
+	unsigned i, j, level, ox, oy;
+
+	switch (a->type) {
+	case SOSC_ANIM_FADE:
+		/* a bouncing fade counts on past nsteps on its way back */
+		level = (a->step <= a->fade.nsteps)
+			? a->step : 2 * a->fade.nsteps - a->step;
+
+		fill(state, a, (a->fade.from < a->fade.to)
+			? a->fade.from + level : a->fade.from - level);
+		break;
+
+	case SOSC_ANIM_BLINK:
+		fill(state, a, (a->step & 1) ? a->blink.off : a->blink.on);
+		break;
+
+	case SOSC_ANIM_SCROLL:
+		ox = (a->step * a->scroll.dx) % a->scroll.w;
+		oy = (a->step * a->scroll.dy) % a->scroll.h;
+
+		for (j = 0; j < a->h; j++) {
+			src = a->levels + ((oy + j) % a->scroll.h) * a->scroll.w;
+
+			for (i = 0; i < a->w; i++)
+				sosc_led_put_front(state, a->x + i, a->y + j,
+				                   src[(ox + i) % a->scroll.w]);
+		}
+
+		break;
+
+	case SOSC_ANIM_FRAMES:
+		src = a->levels + a->step * a->w * a->h;
+
+		for (j = 0; j < a->h; j++)
+			for (i = 0; i < a->w; i++)
+				sosc_led_put_front(state, a->x + i, a->y + j, *src++);
+
+		break;
+
+	default:
+		break;
+	}
+}
+
+/* the number of distinct steps before an animation repeats itself, or 0
+ * for one that runs once and stops */
+static unsigned
+cycle_len(const struct sosc_anim *a)
+{
+	switch (a->type) {
+	case SOSC_ANIM_FADE:
+		return a->fade.bounce ? 2 * a->fade.nsteps : 0;
+
+	case SOSC_ANIM_BLINK:
+		return 2;
+
+	case SOSC_ANIM_SCROLL:
+		/* a multiple of both the image's width and its height */
+		return a->scroll.w * a->scroll.h;
+
+	case SOSC_ANIM_FRAMES:
+		return a->frames.count;
+
+	default:
+		return 0;
+	}
+}
+
+static void
+advance(struct sosc_anim *a, uint64_t steps)
+{
+	unsigned cycle = cycle_len(a);
+
+	if (cycle)
+		a->step = (a->step + steps % cycle) % cycle;
+	else if (steps >= a->fade.nsteps - a->step)
+		a->step = a->fade.nsteps;
+	else
+		a->step += steps;
+}
+
+static int
+finished(const struct sosc_anim *a)
+{
+	return a->type == SOSC_ANIM_FADE && !a->fade.bounce
+		&& a->step == a->fade.nsteps;
+}
+
+static void
+release(struct sosc_anim *a)
+{
+	s_free(a->levels);
+	memset(a, 0, sizeof(*a));
+}
+
+/*************************************************************************
+ * starting
+ *************************************************************************/
+
+static int
+init(struct sosc_anim *a, sosc_anim_type_t type, unsigned x, unsigned y,
+     unsigned w, unsigned h, uint64_t period)
+{
+	if (!w || !h || x >= SOSC_LED_COLS_MAX || y >= SOSC_LED_ROWS_MAX
+	    || w > SOSC_LED_COLS_MAX - x || h > SOSC_LED_ROWS_MAX - y)
+		return -1;
+
+	memset(a, 0, sizeof(*a));
+
+	a->type = type;
+	a->x = x;
+	a->y = y;
+	a->w = w;
+	a->h = h;
+	a->period = (period < SOSC_ANIM_PERIOD_MIN)
+		? SOSC_ANIM_PERIOD_MIN : period;
+
+	return 0;
+}
+
+/* a blob of packed levels, holding a whole number of blocks of block_size
+ * levels, with at most a nibble of padding on the end. returns the number
+ * of blocks, or 0 if it doesn't fit that description. */
+static unsigned
+unpack_blocks(uint8_t **levels, unsigned block_size, const uint8_t *data,
+              size_t nbytes)
+{
+	unsigned count, i;
+
+	if (!nbytes || nbytes > SOSC_ANIM_CELLS_MAX / 2)
+		return 0;
+
+	count = (nbytes * 2) / block_size;
+	if (!count || (count * block_size + 1) / 2 != nbytes)
+		return 0;
+
+	if (!(*levels = s_malloc(count * block_size)))
+		return 0;
+
+	for (i = 0; i < count * block_size; i++)
+		(*levels)[i] = (data[i / 2] >> ((i & 1) ? 0 : 4)) & 0x0F;
+
+	return count;
+}
+
+static void
+install(sosc_state_t *state, unsigned id, const struct sosc_anim *a)
+{
+	struct sosc_anim *slot = &state->anim.slot[id];
+
+	release(slot);
+	*slot = *a;
+
+	draw(state, slot);
+	state->stats.led_anim_steps++;
+
+	if (finished(slot))
+		release(slot);
+	else
+		slot->next = sosc_now_usec() + slot->period;
+
+	sosc_led_update(state);
+}
+
+int
+sosc_anim_fade(sosc_state_t *state, unsigned id, unsigned x, unsigned y,
+               unsigned w, unsigned h, unsigned from, unsigned to,
+               uint64_t duration, int bounce)
+{
+	struct sosc_anim a;
+	unsigned nsteps;
+
+	if (id >= SOSC_ANIM_MAX
+	    || from > SOSC_LED_LEVEL_MAX || to > SOSC_LED_LEVEL_MAX)
+		return -1;
+
+	nsteps = (from < to) ? to - from : from - to;
+
+	if (init(&a, SOSC_ANIM_FADE, x, y, w, h,
+	         nsteps ? duration / nsteps : 0))
+		return -1;
+
+	a.fade.from = from;
+	a.fade.to = to;
+	a.fade.nsteps = nsteps;
+	a.fade.bounce = bounce && nsteps;
+
+	install(state, id, &a);
+	return 0;
+}
+
+int
+sosc_anim_blink(sosc_state_t *state, unsigned id, unsigned x, unsigned y,
+                unsigned w, unsigned h, unsigned on, unsigned off,
+                uint64_t period)
+{
+	struct sosc_anim a;
+
+	if (id >= SOSC_ANIM_MAX
+	    || on > SOSC_LED_LEVEL_MAX || off > SOSC_LED_LEVEL_MAX
+	    || init(&a, SOSC_ANIM_BLINK, x, y, w, h, period))
+		return -1;
+
+	a.blink.on = on;
+	a.blink.off = off;
+
+	install(state, id, &a);
+	return 0;
+}
+
+int
+sosc_anim_scroll(sosc_state_t *state, unsigned id, unsigned x, unsigned y,
+                 unsigned w, unsigned h, int dx, int dy, uint64_t period,
+                 unsigned image_w, const uint8_t *data, size_t nbytes)
+{
+	struct sosc_anim a;
+	unsigned image_h;
+
+	if (id >= SOSC_ANIM_MAX || !image_w || image_w > SOSC_ANIM_CELLS_MAX
+	    || init(&a, SOSC_ANIM_SCROLL, x, y, w, h, period))
+		return -1;
+
+	if (!(image_h = unpack_blocks(&a.levels, image_w, data, nbytes)))
+		return -1;
+
+	/* keep the offsets positive, so that they can be worked out with
+	 * unsigned arithmetic */
+	a.scroll.w = image_w;
+	a.scroll.h = image_h;
+	a.scroll.dx = ((dx % (int) image_w) + (int) image_w) % (int) image_w;
+	a.scroll.dy = ((dy % (int) image_h) + (int) image_h) % (int) image_h;
+
+	install(state, id, &a);
+	return 0;
+}
+
+int
+sosc_anim_frames(sosc_state_t *state, unsigned id, unsigned x, unsigned y,
+                 unsigned w, unsigned h, uint64_t period,
+                 const uint8_t *data, size_t nbytes)
+{
+	struct sosc_anim a;
+
+	if (id >= SOSC_ANIM_MAX
+	    || init(&a, SOSC_ANIM_FRAMES, x, y, w, h, period))
+		return -1;
+
+	if (!(a.frames.count = unpack_blocks(&a.levels, w * h, data, nbytes)))
+		return -1;
+
+	install(state, id, &a);
+	return 0;
+}
+
+void
+sosc_anim_stop(sosc_state_t *state, unsigned id)
+{
+	if (id < SOSC_ANIM_MAX)
+		release(&state->anim.slot[id]);
+}
+
+void
+sosc_anim_stop_all(sosc_state_t *state)
+{
+	unsigned i;
+
+	for (i = 0; i < SOSC_ANIM_MAX; i++)
+		release(&state->anim.slot[i]);
+}
+
+/*************************************************************************
+ * running
+ *************************************************************************/
+
+uint64_t
+sosc_anim_next(sosc_state_t *state)
+{
+	struct sosc_anim *a;
+	uint64_t next = 0;
+	unsigned i;
+
+	for (i = 0; i < SOSC_ANIM_MAX; i++) {
+		a = &state->anim.slot[i];
+
+		if (a->type != SOSC_ANIM_NONE && (!next || a->next < next))
+			next = a->next;
+	}
+
+	return next;
+}
+
+void
+sosc_anim_run(sosc_state_t *state, uint64_t now)
+{
+	struct sosc_anim *a;
+	uint64_t steps;
+	unsigned i;
+	int drawn = 0;
+
+	for (i = 0; i < SOSC_ANIM_MAX; i++) {
+		a = &state->anim.slot[i];
+
+		if (a->type == SOSC_ANIM_NONE || a->next > now)
+			continue;
+
+		steps = (now - a->next) / a->period + 1;
+		a->next += steps * a->period;
+
+		advance(a, steps);
+		draw(state, a);
+
+		if (finished(a))
+			release(a);
+
+		state->stats.led_anim_steps++;
+		drawn = 1;
+	}
+
+	if (drawn)
+		sosc_led_update(state);
+}
@@ -28,14 +28,23 @@
 
 
 #define DEFAULT_SERVER_PORT  0
+#define DEFAULT_UNIX_SOCKET  cfg_false
 #define DEFAULT_OSC_PREFIX   "/monome"
 #define DEFAULT_APP_PORT     8000
 #define DEFAULT_APP_HOST     "127.0.0.1"
 #define DEFAULT_ROTATION     MONOME_ROTATE_0
+#define DEFAULT_BUNDLE       cfg_false
+#define DEFAULT_REFRESH_RATE 0
+#define DEFAULT_ECHO         SOSC_ECHO_OFF
+#define DEFAULT_ENC_WINDOW   0
+#define DEFAULT_TILT_RATE    0
+#define DEFAULT_TILT_DEADBAND 0
+#define DEFAULT_TILT_SMOOTHING 0
 
 
 static cfg_opt_t server_opts[] = {
 	CFG_INT("port",       DEFAULT_SERVER_PORT, CFGF_NONE),
+	CFG_BOOL("unix_socket", DEFAULT_UNIX_SOCKET, CFGF_NONE),
 	CFG_END()
 };
 
@@ -43,11 +52,22 @@ static cfg_opt_t app_opts[] = {
 	CFG_STR("osc_prefix", DEFAULT_OSC_PREFIX,  CFGF_NONE),
 	CFG_STR("host",       DEFAULT_APP_HOST,    CFGF_NONE),
 	CFG_INT("port",       DEFAULT_APP_PORT,    CFGF_NONE),
+	CFG_BOOL("bundle_events", DEFAULT_BUNDLE,  CFGF_NONE),
 	CFG_END()
 };
 
 static cfg_opt_t dev_opts[] = {
 	CFG_INT("rotation",   DEFAULT_ROTATION,    CFGF_NONE),
+	CFG_INT("led_refresh_rate", DEFAULT_REFRESH_RATE, CFGF_NONE),
+	CFG_INT("echo",       DEFAULT_ECHO,        CFGF_NONE),
+	CFG_INT("enc_window", DEFAULT_ENC_WINDOW,  CFGF_NONE),
+	CFG_END()
+};
+
+static cfg_opt_t tilt_opts[] = {
+	CFG_INT("rate",       DEFAULT_TILT_RATE,   CFGF_NONE),
+	CFG_INT("deadband",   DEFAULT_TILT_DEADBAND, CFGF_NONE),
+	CFG_INT("smoothing",  DEFAULT_TILT_SMOOTHING, CFGF_NONE),
 	CFG_END()
 };
 
@@ -55,6 +75,7 @@ static cfg_opt_t opts[] = {
 	CFG_SEC("server", server_opts, CFGF_NONE),
 	CFG_SEC("application", app_opts, CFGF_NONE),
 	CFG_SEC("device", dev_opts, CFGF_NONE),
+	CFG_SEC("tilt", tilt_opts, CFGF_MULTI | CFGF_TITLE),
 	CFG_END()
 };
 
@@ -68,6 +89,37 @@ prepend_slash_if_necessary(char **dest, char *prefix)
 		*dest = s_strdup(prefix);
 }
 
+/* tilt sections are titled with the sensor they're for: tilt "0" { ... } */
+static void
+read_tilt(cfg_t *sec, sosc_config_t *config)
+{
+	const char *title;
+	char *end;
+	long n;
+
+	if (!(title = cfg_title(sec)))
+		return;
+
+	n = strtol(title, &end, 10);
+	if (!*title || *end || n < 0 || n >= SOSC_OSC_TILT_MAX)
+		return;
+
+	config->tilt[n].rate = cfg_getint(sec, "rate");
+	config->tilt[n].deadband = cfg_getint(sec, "deadband");
+	config->tilt[n].smoothing = cfg_getint(sec, "smoothing");
+
+	if (config->tilt[n].rate < 0)
+		config->tilt[n].rate = 0;
+
+	if (config->tilt[n].deadband < 0)
+		config->tilt[n].deadband = 0;
+
+	if (config->tilt[n].smoothing < 0)
+		config->tilt[n].smoothing = 0;
+	else if (config->tilt[n].smoothing > SOSC_TILT_SMOOTHING_MAX)
+		config->tilt[n].smoothing = SOSC_TILT_SMOOTHING_MAX;
+}
+
 static char *
 path_for_serial(const char *config_dir, const char *serial)
 {
@@ -78,6 +130,7 @@ int
 sosc_config_read(const char *config_dir, const char *serial, sosc_config_t *config)
 {
 	cfg_t *cfg, *sec;
+	unsigned i;
 	char *path;
 
 	if (!serial)
@@ -102,14 +155,47 @@ sosc_config_read(const char *config_dir, const char *serial, sosc_config_t *conf
 
 	sec = cfg_getsec(cfg, "server");
 	sosc_port_itos(config->server.port, cfg_getint(sec, "port"));
+	config->server.unix_socket = cfg_getbool(sec, "unix_socket");
 
 	sec = cfg_getsec(cfg, "application");
 	prepend_slash_if_necessary(&config->app.osc_prefix, cfg_getstr(sec, "osc_prefix"));
 	config->app.host = s_strdup(cfg_getstr(sec, "host"));
 	sosc_port_itos(config->app.port, cfg_getint(sec, "port"));
+	config->app.bundle_events = cfg_getbool(sec, "bundle_events");
 
 	sec = cfg_getsec(cfg, "device");
 	config->dev.rotation = (cfg_getint(sec, "rotation") / 90) % 4;
+	config->dev.led_refresh_rate = cfg_getint(sec, "led_refresh_rate");
+
+	if (config->dev.led_refresh_rate < 0)
+		config->dev.led_refresh_rate = 0;
+
+	config->dev.echo = cfg_getint(sec, "echo");
+
+	if (config->dev.echo < 0 || config->dev.echo >= SOSC_ECHO_MAX)
+		config->dev.echo = SOSC_ECHO_OFF;
+
+#ifdef WIN32
+	if (config->dev.echo != SOSC_ECHO_OFF) {
+		fprintf(stderr, "serialosc [%s]: local echo isn't available on "
+		        "windows, ignoring echo = %d\n", serial, config->dev.echo);
+		config->dev.echo = SOSC_ECHO_OFF;
+	}
+#endif
+
+	config->dev.enc_window = cfg_getint(sec, "enc_window");
+
+	if (config->dev.enc_window < 0)
+		config->dev.enc_window = 0;
+
+	for (i = 0; i < SOSC_OSC_TILT_MAX; i++) {
+		config->tilt[i].rate = DEFAULT_TILT_RATE;
+		config->tilt[i].deadband = DEFAULT_TILT_DEADBAND;
+		config->tilt[i].smoothing = DEFAULT_TILT_SMOOTHING;
+	}
+
+	for (i = 0; i < cfg_size(cfg, "tilt"); i++)
+		read_tilt(cfg_getnsec(cfg, "tilt", i), config);
 
 	cfg_free(cfg);
 
@@ -120,8 +206,9 @@ int
 sosc_config_write(const char *config_dir, const char *serial, sosc_state_t *state)
 {
 	cfg_t *cfg, *sec;
-	char *path;
+	char *path, title[16];
 	const char *p;
+	unsigned i;
 	FILE *f;
 
 	if (!serial)
@@ -144,15 +231,31 @@ sosc_config_write(const char *config_dir, const char *serial, sosc_state_t *stat
 
 	sec = cfg_getsec(cfg, "server");
 	cfg_setint(sec, "port", lo_server_get_port(state->server));
+	cfg_setbool(sec, "unix_socket",
+	            state->config.server.unix_socket ? cfg_true : cfg_false);
 
 	sec = cfg_getsec(cfg, "application");
 	cfg_setstr(sec, "osc_prefix", state->config.app.osc_prefix);
 	cfg_setstr(sec, "host", lo_address_get_hostname(state->outgoing));
 	p = lo_address_get_port(state->outgoing);
 	cfg_setint(sec, "port", strtol(p , NULL, 10));
+	cfg_setbool(sec, "bundle_events",
+	            state->config.app.bundle_events ? cfg_true : cfg_false);
 
 	sec = cfg_getsec(cfg, "device");
 	cfg_setint(sec, "rotation", monome_get_rotation(state->monome) * 90);
+	cfg_setint(sec, "led_refresh_rate", state->config.dev.led_refresh_rate);
+	cfg_setint(sec, "echo", state->config.dev.echo);
+	cfg_setint(sec, "enc_window", state->config.dev.enc_window);
+
+	for (i = 0; i < SOSC_OSC_TILT_MAX; i++) {
+		snprintf(title, sizeof(title), "%u", i);
+
+		sec = cfg_addtsec(cfg, "tilt", title);
+		cfg_setint(sec, "rate", state->config.tilt[i].rate);
+		cfg_setint(sec, "deadband", state->config.tilt[i].deadband);
+		cfg_setint(sec, "smoothing", state->config.tilt[i].smoothing);
+	}
 
 	cfg_print(cfg, f);
 	fclose(f);
@@ -0,0 +1,353 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#include <serialosc/serialosc.h>
+#include <serialosc/ipc.h>
+#include <serialosc/osc.h>
+
+/* every source is registered once, edge-triggered, and drained until
+ * there's nothing left when it wakes us, so a burst of datagrams or
+ * serial bytes costs one epoll_wait() instead of one poll() per event.
+ *
+ * so that a flood on one source can't starve the others, each drain is
+ * capped (OSC's at SOSC_OSC_RECV_BUDGET, see osc/incoming.c, the rest at
+ * DRAIN_BUDGET). a source that hits the cap is kept in
+ * loop.pending and the next epoll_wait() doesn't block, since with edge
+ * triggering we won't be told about it again.
+ *
+ * we never change the flags on libmonome's or liblo's fds; "is there
+ * more?" is answered with a zero-timeout poll() or by liblo itself.
+ *
+ * the serial output queue has its own non-blocking fd, and is only ever
+ * written to when that's reported writable. it's the one level-triggered
+ * source, and is only registered for EPOLLOUT while something is queued
+ * (see arm_serial_out()): a tty is writable nearly all the time, so an
+ * edge would have come and gone long before anything was queued. */
+
+#define DRAIN_BUDGET 64
+
+enum {
+	SRC_SERIAL,
+	SRC_SERIAL_OUT,
+	SRC_OSC,
+	SRC_OSC_UNIX,
+	SRC_IPC,
+	SRC_TIMER,
+	SRC_SIGNAL,
+
+	SRC_MAX
+};
+
+#define SRC_BIT(src) (1U << (src))
+
+struct epoll_loop {
+	int epfd;
+	int fds[SRC_MAX];
+
+	unsigned int pending;
+
+	/* what the timerfd is currently armed for, 0 if disarmed */
+	uint64_t timer_deadline;
+
+	/* whether the serial output fd is registered for EPOLLOUT */
+	int serial_out_armed;
+};
+
+static int
+readable(int fd)
+{
+	struct pollfd p = {
+		.fd = fd,
+		.events = POLLIN
+	};
+
+	return poll(&p, 1, 0) > 0 && (p.revents & POLLIN);
+}
+
+/*************************************************************************
+ * draining
+ *************************************************************************/
+
+/* each of these returns non-zero if it ran out of budget before the
+ * source ran dry. */
+
+static int
+drain_serial(struct sosc_state *state, int fd)
+{
+	int i;
+
+	/* no-op unless bundling is on */
+	osc_bundle_begin(state);
+
+	for (i = 0; i < DRAIN_BUDGET && readable(fd); i++)
+		if (sosc_serial_handle_next(state) <= 0)
+			break;
+
+	osc_bundle_end(state);
+	return i == DRAIN_BUDGET;
+}
+
+static int
+drain_ipc(struct sosc_state *state, int fd)
+{
+	struct sosc_ipc_msg msg;
+	int i;
+
+	for (i = 0; i < DRAIN_BUDGET && readable(fd); i++) {
+		if (sosc_ipc_msg_read(fd, &msg) <= 0)
+			return 0;
+
+		switch (msg.type) {
+		case SOSC_PROCESS_SHOULD_EXIT:
+			state->running = 0;
+			return 0;
+
+		case SOSC_STATS_REQUEST:
+			sosc_server_report_stats(state, msg.stats.seq);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return i == DRAIN_BUDGET;
+}
+
+static void
+drain_timer(struct epoll_loop *loop)
+{
+	uint64_t expirations;
+
+	while (read(loop->fds[SRC_TIMER], &expirations, sizeof(expirations)) > 0);
+
+	/* fired, so it's disarmed. make sure arm_timer() re-arms it even if
+	 * the scheduler still wants the same deadline. */
+	loop->timer_deadline = 0;
+}
+
+static void
+drain_signal(struct sosc_state *state, int fd)
+{
+	struct signalfd_siginfo si;
+
+	while (read(fd, &si, sizeof(si)) == sizeof(si))
+		state->running = 0;
+}
+
+/*************************************************************************
+ * setup
+ *************************************************************************/
+
+/* sosc_now_usec() is CLOCK_MONOTONIC on linux, so scheduler deadlines
+ * can be handed to the timerfd as absolute times without conversion. */
+static void
+arm_timer(struct epoll_loop *loop, struct sosc_state *state)
+{
+	struct itimerspec its = {{0, 0}, {0, 0}};
+	uint64_t deadline;
+
+	deadline = sosc_scheduler_next_deadline(state);
+
+	if (deadline == loop->timer_deadline)
+		return;
+
+	its.it_value.tv_sec  = deadline / 1000000;
+	its.it_value.tv_nsec = (deadline % 1000000) * 1000;
+
+	if (timerfd_settime(loop->fds[SRC_TIMER], TFD_TIMER_ABSTIME, &its, NULL))
+		perror("timerfd_settime()");
+	else
+		loop->timer_deadline = deadline;
+}
+
+static void
+arm_serial_out(struct epoll_loop *loop, struct sosc_state *state)
+{
+	struct epoll_event ev = {.data.u32 = SRC_SERIAL_OUT};
+	int want;
+
+	if (state->serial_out.fd < 0)
+		return;
+
+	want = sosc_serial_out_pending(state) > 0;
+	if (want == loop->serial_out_armed)
+		return;
+
+	ev.events = want ? EPOLLOUT : 0;
+
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, state->serial_out.fd, &ev))
+		perror("epoll_ctl()");
+	else
+		loop->serial_out_armed = want;
+}
+
+static int
+add_source(struct epoll_loop *loop, int src, int fd, uint32_t events)
+{
+	struct epoll_event ev = {
+		.events = events | EPOLLET,
+		.data.u32 = src
+	};
+
+	loop->fds[src] = fd;
+
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev)) {
+		perror("epoll_ctl()");
+		return 1;
+	}
+
+	return 0;
+}
+
+int
+sosc_event_loop(struct sosc_state *state)
+{
+	struct epoll_event events[SRC_MAX];
+	struct epoll_loop loop = {0};
+	sigset_t signals, old_signals;
+	unsigned int pending;
+	int i, n, ret = 1;
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGINT);
+
+	if ((loop.epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		perror("epoll_create1()");
+		goto err_epoll;
+	}
+
+	if ((loop.fds[SRC_TIMER] = timerfd_create(CLOCK_MONOTONIC,
+	                TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+		perror("timerfd_create()");
+		goto err_timerfd;
+	}
+
+	/* SIGTERM and SIGINT end the loop normally, so the config still gets
+	 * written out on the way down. */
+	sigprocmask(SIG_BLOCK, &signals, &old_signals);
+
+	if ((loop.fds[SRC_SIGNAL] = signalfd(-1, &signals,
+	                SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+		perror("signalfd()");
+		goto err_signalfd;
+	}
+
+	if (add_source(&loop, SRC_SERIAL, monome_get_fd(state->monome), EPOLLIN)
+	    || add_source(&loop, SRC_OSC, lo_server_get_socket_fd(state->server),
+	                  EPOLLIN)
+	    || add_source(&loop, SRC_TIMER, loop.fds[SRC_TIMER], EPOLLIN)
+	    || add_source(&loop, SRC_SIGNAL, loop.fds[SRC_SIGNAL], EPOLLIN))
+		goto err_add;
+
+	/* nothing's queued yet, see arm_serial_out() */
+	if (state->serial_out.fd > -1
+	    && add_source(&loop, SRC_SERIAL_OUT, state->serial_out.fd, 0))
+		goto err_add;
+
+	loop.pending = SRC_BIT(SRC_SERIAL) | SRC_BIT(SRC_OSC);
+
+	if (state->unix_sock.fd > -1) {
+		if (add_source(&loop, SRC_OSC_UNIX, state->unix_sock.fd, EPOLLIN))
+			goto err_add;
+
+		loop.pending |= SRC_BIT(SRC_OSC_UNIX);
+	}
+
+	if (state->ipc_in_fd > -1) {
+		if (add_source(&loop, SRC_IPC, state->ipc_in_fd, EPOLLIN))
+			goto err_add;
+
+		loop.pending |= SRC_BIT(SRC_IPC);
+	}
+
+	for (state->running = 1; state->running;) {
+		arm_timer(&loop, state);
+		arm_serial_out(&loop, state);
+
+		/* block until something has data or the scheduler has something
+		 * due, unless a source still has data we didn't get to */
+		n = epoll_wait(loop.epfd, events, SRC_MAX, loop.pending ? 0 : -1);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+
+			perror("error in epoll_wait()");
+			goto err_add;
+		}
+
+		for (i = 0; i < n; i++) {
+			/* is the monome still connected? */
+			if (events[i].data.u32 == SRC_SERIAL
+			    && events[i].events & (EPOLLHUP | EPOLLERR))
+				goto done;
+
+			loop.pending |= SRC_BIT(events[i].data.u32);
+		}
+
+		pending = loop.pending;
+		loop.pending = 0;
+
+		if (pending & SRC_BIT(SRC_SIGNAL))
+			drain_signal(state, loop.fds[SRC_SIGNAL]);
+
+		if (pending & SRC_BIT(SRC_SERIAL)
+		    && drain_serial(state, loop.fds[SRC_SERIAL]))
+			loop.pending |= SRC_BIT(SRC_SERIAL);
+
+		if (pending & SRC_BIT(SRC_OSC) && osc_recv(state))
+			loop.pending |= SRC_BIT(SRC_OSC);
+
+		if (pending & SRC_BIT(SRC_OSC_UNIX) && osc_recv_unix(state))
+			loop.pending |= SRC_BIT(SRC_OSC_UNIX);
+
+		if (pending & SRC_BIT(SRC_IPC)
+		    && drain_ipc(state, loop.fds[SRC_IPC]))
+			loop.pending |= SRC_BIT(SRC_IPC);
+
+		if (pending & SRC_BIT(SRC_TIMER))
+			drain_timer(&loop);
+
+		if (pending & SRC_BIT(SRC_SERIAL_OUT))
+			sosc_serial_out_write(state);
+
+		sosc_scheduler_run(state);
+	}
+
+done:
+	ret = 0;
+err_add:
+	close(loop.fds[SRC_SIGNAL]);
+err_signalfd:
+	sigprocmask(SIG_SETMASK, &old_signals, NULL);
+	close(loop.fds[SRC_TIMER]);
+err_timerfd:
+	close(loop.epfd);
+err_epoll:
+	return ret;
+}
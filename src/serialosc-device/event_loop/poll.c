@@ -20,6 +20,7 @@
 
 #include <serialosc/serialosc.h>
 #include <serialosc/ipc.h>
+#include <serialosc/osc.h>
 
 static int
 recv_msg(struct sosc_state *state, int ipc_fd)
@@ -34,16 +35,50 @@ recv_msg(struct sosc_state *state, int ipc_fd)
 		state->running = 0;
 		return 0;
 
+	case SOSC_STATS_REQUEST:
+		sosc_server_report_stats(state, msg.stats.seq);
+		return 0;
+
 	default:
 		return -1;
 	}
 }
 
+static int
+readable(struct pollfd *fd)
+{
+	struct pollfd p = {
+		.fd = fd->fd,
+		.events = POLLIN
+	};
+
+	return poll(&p, 1, 0) > 0 && (p.revents & POLLIN);
+}
+
+static void
+drain_serial(struct sosc_state *state, struct pollfd *fd)
+{
+	if (!state->config.app.bundle_events) {
+		sosc_serial_handle_next(state);
+		return;
+	}
+
+	/* take every complete event that's already waiting so that they go
+	 * out in a single bundle. */
+	osc_bundle_begin(state);
+
+	do {
+		if (sosc_serial_handle_next(state) <= 0)
+			break;
+	} while (readable(fd));
+
+	osc_bundle_end(state);
+}
+
 int
 sosc_event_loop(struct sosc_state *state)
 {
-	struct pollfd fds[3];
-	int nfds;
+	struct pollfd fds[5];
 
 	fds[0].fd = monome_get_fd(state->monome);
 	fds[0].events = POLLIN;
@@ -51,15 +86,27 @@ sosc_event_loop(struct sosc_state *state)
 	fds[1].fd = lo_server_get_socket_fd(state->server);
 	fds[1].events = POLLIN;
 
+	/* poll() skips negative fds, so these can sit in the set even when
+	 * there's no supervisor or nothing queued for the serial port */
 	fds[2].fd = state->ipc_in_fd;
 	fds[2].events = POLLIN;
 	fds[2].revents = 0;
 
-	nfds = (state->ipc_in_fd > -1) ? 3 : 2;
+	fds[3].events = POLLOUT;
+	fds[3].revents = 0;
+
+	fds[4].fd = state->unix_sock.fd;
+	fds[4].events = POLLIN;
+	fds[4].revents = 0;
 
 	for (state->running = 1; state->running;) {
-		/* block until either the monome or liblo have data */
-		if (poll(fds, nfds, -1) < 0)
+		fds[3].fd = sosc_serial_out_pending(state)
+			? state->serial_out.fd : -1;
+
+		/* block until either the monome or liblo have data, the serial
+		 * port can take more of what's queued for it, or the scheduler
+		 * has something due */
+		if (poll(fds, 5, sosc_scheduler_timeout(state)) < 0)
 			switch (errno) {
 			case EINVAL:
 				perror("error in poll()");
@@ -76,15 +123,24 @@ sosc_event_loop(struct sosc_state *state)
 
 		/* is there data available for reading from the monome? */
 		if (fds[0].revents & POLLIN)
-			monome_event_handle_next(state->monome);
+			drain_serial(state, &fds[0]);
 
 		/* how about from OSC? */
 		if (fds[1].revents & POLLIN)
-			lo_server_recv_noblock(state->server, 0);
+			osc_recv(state);
+
+		if (fds[4].revents & POLLIN)
+			osc_recv_unix(state);
 
 		/* how about from the supervisor? */
 		if (fds[2].revents & POLLIN)
 			recv_msg(state, state->ipc_in_fd);
+
+		/* room for more LED output? */
+		if (fds[3].revents & (POLLOUT | POLLERR))
+			sosc_serial_out_write(state);
+
+		sosc_scheduler_run(state);
 	}
 
 	return 0;
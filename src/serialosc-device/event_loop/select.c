@@ -20,6 +20,7 @@
 
 #include <serialosc/serialosc.h>
 #include <serialosc/ipc.h>
+#include <serialosc/osc.h>
 
 static int
 recv_msg(struct sosc_state *state, int ipc_fd)
@@ -34,24 +35,66 @@ recv_msg(struct sosc_state *state, int ipc_fd)
 		state->running = 0;
 		return 0;
 
+	case SOSC_STATS_REQUEST:
+		sosc_server_report_stats(state, msg.stats.seq);
+		return 0;
+
 	default:
 		return -1;
 	}
 }
 
+static int
+readable(int fd)
+{
+	struct timeval tv = {0, 0};
+	fd_set rfds;
+
+	FD_ZERO(&rfds);
+	FD_SET(fd, &rfds);
+
+	return select(fd + 1, &rfds, NULL, NULL, &tv) > 0;
+}
+
+static void
+drain_serial(struct sosc_state *state, int fd)
+{
+	if (!state->config.app.bundle_events) {
+		sosc_serial_handle_next(state);
+		return;
+	}
+
+	/* take every complete event that's already waiting so that they go
+	 * out in a single bundle. */
+	osc_bundle_begin(state);
+
+	do {
+		if (sosc_serial_handle_next(state) <= 0)
+			break;
+	} while (readable(fd));
+
+	osc_bundle_end(state);
+}
+
 int
 sosc_event_loop(struct sosc_state *state)
 {
-	int max_fd, monome_fd, osc_fd, ipc_fd;
-	fd_set rfds, efds;
+	int max_fd, monome_fd, osc_fd, unix_fd, ipc_fd, out_fd;
+	uint64_t deadline, now, timeout;
+	struct timeval tv;
+	fd_set rfds, wfds, efds;
 
 	monome_fd = monome_get_fd(state->monome);
 	osc_fd    = lo_server_get_socket_fd(state->server);
+	unix_fd   = state->unix_sock.fd;
 	ipc_fd    = state->ipc_in_fd;
+	out_fd    = state->serial_out.fd;
 
 	max_fd = (osc_fd > monome_fd) ? osc_fd : monome_fd;
 	if (state->ipc_in_fd > -1)
 		max_fd = (ipc_fd > max_fd) ? ipc_fd : max_fd;
+	max_fd = (out_fd > max_fd) ? out_fd : max_fd;
+	max_fd = (unix_fd > max_fd) ? unix_fd : max_fd;
 
 	max_fd++;
 
@@ -60,14 +103,33 @@ sosc_event_loop(struct sosc_state *state)
 		FD_SET(monome_fd, &rfds);
 		FD_SET(osc_fd, &rfds);
 
+		if (unix_fd > -1)
+			FD_SET(unix_fd, &rfds);
+
 		if (ipc_fd > -1)
 			FD_SET(ipc_fd, &rfds);
 
+		FD_ZERO(&wfds);
+		if (sosc_serial_out_pending(state))
+			FD_SET(out_fd, &wfds);
+
 		FD_ZERO(&efds);
 		FD_SET(monome_fd, &efds);
 
-		/* block until either the monome or liblo have data */
-		if (select(max_fd, &rfds, NULL, &efds, NULL) < 0)
+		/* select() takes microseconds, so skip the rounding to
+		 * milliseconds that sosc_scheduler_timeout() does for poll() */
+		deadline = sosc_scheduler_next_deadline(state);
+		now = sosc_now_usec();
+		timeout = (deadline > now) ? deadline - now : 0;
+
+		tv.tv_sec  = timeout / 1000000;
+		tv.tv_usec = timeout % 1000000;
+
+		/* block until either the monome or liblo have data, the serial
+		 * port can take more of what's queued for it, or the scheduler
+		 * has something due */
+		if (select(max_fd, &rfds, &wfds, &efds,
+		           deadline ? &tv : NULL) < 0)
 			switch (errno) {
 			case EBADF:
 			case EINVAL:
@@ -84,14 +146,23 @@ sosc_event_loop(struct sosc_state *state)
 
 		/* is there data available for reading from the monome? */
 		if (FD_ISSET(monome_fd, &rfds))
-			monome_event_handle_next(state->monome);
+			drain_serial(state, monome_fd);
 
 		/* how about from OSC? */
 		if (FD_ISSET(osc_fd, &rfds))
-			lo_server_recv_noblock(state->server, 0);
+			osc_recv(state);
+
+		if (unix_fd > -1 && FD_ISSET(unix_fd, &rfds))
+			osc_recv_unix(state);
 
 		if (ipc_fd > -1 && FD_ISSET(ipc_fd, &rfds))
 			recv_msg(state, state->ipc_in_fd);
+
+		/* room for more LED output? */
+		if (out_fd > -1 && FD_ISSET(out_fd, &wfds))
+			sosc_serial_out_write(state);
+
+		sosc_scheduler_run(state);
 	}
 
 	return 0;
@@ -23,6 +23,7 @@
 
 #include <serialosc/serialosc.h>
 #include <serialosc/ipc.h>
+#include <serialosc/osc.h>
 
 static int
 recv_ipc_msg(struct sosc_state *state, int ipc_fd)
@@ -38,6 +39,10 @@ recv_ipc_msg(struct sosc_state *state, int ipc_fd)
 		state->running = 0;
 		return 0;
 
+	case SOSC_STATS_REQUEST:
+		sosc_server_report_stats(state, msg.stats.seq);
+		return 0;
+
 	default:
 		return -1;
 	}
@@ -101,10 +106,14 @@ serial_poll_thread(LPVOID arg)
 
 	while (state->running) {
 		if (wait_for_serial_input(monome_handle, &ov, INFINITE) == 0) {
+			osc_bundle_begin(state);
+
 			do {
-				status = monome_event_handle_next(state->monome);
+				status = sosc_serial_handle_next(state);
 			} while (status > 0);
 
+			osc_bundle_end(state);
+
 			if (status < 0) {
 				goto err;
 			}
@@ -122,9 +131,19 @@ static DWORD WINAPI
 osc_poll_thread(LPVOID arg)
 {
 	struct sosc_state *state = arg;
+	int timeout;
 
+	/* the LED framebuffer is only ever touched from this thread, so the
+	 * flush clock runs here too. */
 	while (state->running) {
-		lo_server_recv(state->server);
+		timeout = sosc_scheduler_timeout(state);
+
+		if (timeout < 0)
+			lo_server_recv(state->server);
+		else
+			lo_server_recv_noblock(state->server, timeout);
+
+		sosc_scheduler_run(state);
 	}
 
 	return 0;
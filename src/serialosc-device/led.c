@@ -0,0 +1,1299 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <monome.h>
+
+#include <serialosc/serialosc.h>
+#include <serialosc/platform.h>
+#include <serialosc/led.h>
+#include <serialosc/serial_out.h>
+
+/* the LED handlers don't talk to libmonome directly anymore. they write
+ * into state->led.frame, and a flush compares that against what the
+ * device is already showing (state->led.hw), quad by quad, and writes
+ * only what changed using whichever commands are cheapest. apps that
+ * redraw the whole grid every frame mostly redraw the same thing.
+ * arc rings get the same treatment, a ring at a time. */
+
+#define QUAD_INDEX(x, y) \
+	(((y) / SOSC_LED_QUAD_SIZE) * SOSC_LED_QUADS_X + ((x) / SOSC_LED_QUAD_SIZE))
+
+#define QUAD_BIT(x, y) (1U << QUAD_INDEX(x, y))
+
+#define ALL_QUADS ((1U << SOSC_LED_QUADS) - 1)
+
+static int
+is_binary(uint8_t level)
+{
+	return level == 0 || level == SOSC_LED_LEVEL_MAX;
+}
+
+static void
+mark_dirty(sosc_state_t *state, unsigned x, unsigned y)
+{
+	struct sosc_led *led = &state->led;
+
+	led->touched = 1;
+
+	if (led->dirty & QUAD_BIT(x, y))
+		return;
+
+	led->dirty |= QUAD_BIT(x, y);
+	led->dirty_since[QUAD_INDEX(x, y)] = state->in.osc_recv_at
+		? state->in.osc_recv_at : sosc_now_usec();
+}
+
+static void
+put(sosc_state_t *state, unsigned x, unsigned y, unsigned level)
+{
+	struct sosc_led *led = &state->led;
+
+	if (x >= SOSC_LED_COLS_MAX || y >= SOSC_LED_ROWS_MAX)
+		return;
+
+	if (level > SOSC_LED_LEVEL_MAX)
+		level = SOSC_LED_LEVEL_MAX;
+
+	if (led->back_buffered) {
+		led->back.level[y][x] = level;
+		return;
+	}
+
+	/* the app has drawn over a key's echo, so releasing the key mustn't
+	 * put back what was there before */
+	led->echo.lit[y] &= ~(1U << x);
+
+	if (led->frame.level[y][x] == level)
+		return;
+
+	led->frame.level[y][x] = level;
+	mark_dirty(state, x, y);
+}
+
+static void
+mark_ring_dirty(sosc_state_t *state, unsigned ring)
+{
+	struct sosc_led *led = &state->led;
+
+	led->touched = 1;
+
+	if (led->rings_dirty & (1U << ring))
+		return;
+
+	led->rings_dirty |= 1U << ring;
+	led->rings_dirty_since[ring] = state->in.osc_recv_at
+		? state->in.osc_recv_at : sosc_now_usec();
+}
+
+static void
+ring_put(sosc_state_t *state, unsigned ring, unsigned x, unsigned level)
+{
+	struct sosc_led *led = &state->led;
+
+	if (ring >= SOSC_LED_RINGS)
+		return;
+
+	x &= SOSC_LED_RING_SIZE - 1;
+
+	if (level > SOSC_LED_LEVEL_MAX)
+		level = SOSC_LED_LEVEL_MAX;
+
+	if (led->back_buffered) {
+		led->rings_back.level[ring][x] = level;
+		return;
+	}
+
+	if (led->rings.level[ring][x] == level)
+		return;
+
+	led->rings.level[ring][x] = level;
+	mark_ring_dirty(state, ring);
+}
+
+/* one latency sample per quad or ring that made it out to the device */
+static void
+record_latency(sosc_state_t *state, uint64_t dirty_since)
+{
+	sosc_hist_record(&state->stats.latency[SOSC_LATENCY_LED],
+	                 sosc_now_usec() - dirty_since);
+}
+
+static int
+grid_size(sosc_state_t *state, unsigned *cols, unsigned *rows)
+{
+	int c, r;
+
+	c = monome_get_cols(state->monome);
+	r = monome_get_rows(state->monome);
+
+	*cols = (c > 0) ? ((c < SOSC_LED_COLS_MAX) ? c : SOSC_LED_COLS_MAX) : 0;
+	*rows = (r > 0) ? ((r < SOSC_LED_ROWS_MAX) ? r : SOSC_LED_ROWS_MAX) : 0;
+
+	return *cols && *rows;
+}
+
+/*************************************************************************
+ * drawing
+ *************************************************************************/
+
+void
+sosc_led_set(sosc_state_t *state, unsigned x, unsigned y, unsigned level)
+{
+	put(state, x, y, level);
+}
+
+void
+sosc_led_all(sosc_state_t *state, unsigned level)
+{
+	unsigned x, y;
+
+	for (y = 0; y < SOSC_LED_ROWS_MAX; y++)
+		for (x = 0; x < SOSC_LED_COLS_MAX; x++)
+			put(state, x, y, level);
+}
+
+void
+sosc_led_map(sosc_state_t *state, unsigned x_off, unsigned y_off,
+             const uint8_t *levels)
+{
+	unsigned x, y;
+
+	x_off &= ~(SOSC_LED_QUAD_SIZE - 1);
+	y_off &= ~(SOSC_LED_QUAD_SIZE - 1);
+
+	for (y = 0; y < SOSC_LED_QUAD_SIZE; y++)
+		for (x = 0; x < SOSC_LED_QUAD_SIZE; x++)
+			put(state, x_off + x, y_off + y,
+			    levels[(y * SOSC_LED_QUAD_SIZE) + x]);
+}
+
+void
+sosc_led_row(sosc_state_t *state, unsigned x_off, unsigned y,
+             size_t count, const uint8_t *levels)
+{
+	size_t i;
+
+	x_off &= ~(SOSC_LED_QUAD_SIZE - 1);
+
+	for (i = 0; i < count; i++)
+		put(state, x_off + i, y, levels[i]);
+}
+
+void
+sosc_led_col(sosc_state_t *state, unsigned x, unsigned y_off,
+             size_t count, const uint8_t *levels)
+{
+	size_t i;
+
+	y_off &= ~(SOSC_LED_QUAD_SIZE - 1);
+
+	for (i = 0; i < count; i++)
+		put(state, x, y_off + i, levels[i]);
+}
+
+void
+sosc_led_ring_set(sosc_state_t *state, unsigned ring, unsigned x,
+                  unsigned level)
+{
+	ring_put(state, ring, x, level);
+}
+
+void
+sosc_led_ring_all(sosc_state_t *state, unsigned ring, unsigned level)
+{
+	unsigned x;
+
+	for (x = 0; x < SOSC_LED_RING_SIZE; x++)
+		ring_put(state, ring, x, level);
+}
+
+void
+sosc_led_ring_map(sosc_state_t *state, unsigned ring, const uint8_t *levels)
+{
+	unsigned x;
+
+	for (x = 0; x < SOSC_LED_RING_SIZE; x++)
+		ring_put(state, ring, x, levels[x]);
+}
+
+/* start to end inclusive, clockwise, wrapping past 63 back to 0 */
+void
+sosc_led_ring_range(sosc_state_t *state, unsigned ring, unsigned start,
+                    unsigned end, unsigned level)
+{
+	unsigned x;
+
+	start &= SOSC_LED_RING_SIZE - 1;
+	end &= SOSC_LED_RING_SIZE - 1;
+
+	for (x = start;; x = (x + 1) & (SOSC_LED_RING_SIZE - 1)) {
+		ring_put(state, ring, x, level);
+
+		if (x == end)
+			break;
+	}
+}
+
+/*************************************************************************
+ * whole frames
+ *************************************************************************/
+
+/* /grid/led/frame and /grid/led/level/frame carry the whole grid in one
+ * blob, row by row, in the same packing the mext maps use. rather than
+ * go through put() a level at a time, these unpack 8 LEDs at once (see
+ * led_blob.c) and only touch the frame if those 8 differ from what's
+ * there. */
+
+static void
+blit8(sosc_state_t *state, unsigned x_off, unsigned y, uint64_t levels)
+{
+	uint8_t *row = &state->led.frame.level[y][x_off];
+	uint8_t buf[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		buf[i] = levels >> (i * 8);
+
+	if (state->led.back_buffered) {
+		memcpy(&state->led.back.level[y][x_off], buf, sizeof(buf));
+		return;
+	}
+
+	state->led.echo.lit[y] &= ~(0xFFU << x_off);
+
+	if (!memcmp(row, buf, sizeof(buf)))
+		return;
+
+	memcpy(row, buf, sizeof(buf));
+	mark_dirty(state, x_off, y);
+}
+
+int
+sosc_led_level_frame(sosc_state_t *state, const uint8_t *data, size_t nbytes)
+{
+	unsigned cols, rows, x, y;
+	size_t size;
+
+	if (!grid_size(state, &cols, &rows)
+	    || !(size = sosc_led_frame_size(cols, rows, 1)) || nbytes != size)
+		return -1;
+
+	for (y = 0; y < rows; y++)
+		for (x = 0; x < cols; x += 8, data += 4)
+			blit8(state, x, y, sosc_led_unpack_levels8(data));
+
+	return 0;
+}
+
+int
+sosc_led_frame(sosc_state_t *state, const uint8_t *data, size_t nbytes)
+{
+	unsigned cols, rows, x, y;
+	size_t size;
+
+	if (!grid_size(state, &cols, &rows)
+	    || !(size = sosc_led_frame_size(cols, rows, 0)) || nbytes != size)
+		return -1;
+
+	for (y = 0; y < rows; y++)
+		for (x = 0; x < cols; x += 8, data++)
+			blit8(state, x, y, sosc_led_unpack_bits8(*data));
+
+	return 0;
+}
+
+static unsigned
+popcount8(uint8_t x)
+{
+	x = x - ((x >> 1) & 0x55);
+	x = (x & 0x33) + ((x >> 2) & 0x33);
+	return (x + (x >> 4)) & 0x0F;
+}
+
+int
+sosc_led_level_delta(sosc_state_t *state, const uint8_t *data, size_t nbytes)
+{
+	const uint8_t *mask, *levels;
+	size_t mask_size, nchanged, i;
+	unsigned cols, rows, x, y, bit;
+	uint8_t m, level;
+
+	if (!grid_size(state, &cols, &rows)
+	    || !(mask_size = sosc_led_frame_size(cols, rows, 0))
+	    || nbytes < mask_size)
+		return -1;
+
+	mask = data;
+	levels = data + mask_size;
+
+	for (nchanged = 0, i = 0; i < mask_size; i++)
+		nchanged += popcount8(mask[i]);
+
+	if (nbytes - mask_size < (nchanged + 1) / 2)
+		return -1;
+
+	/* mostly zeroes, so skip a byte (8 LEDs) at a time */
+	for (i = 0, nchanged = 0; i < mask_size; i++) {
+		if (!(m = mask[i]))
+			continue;
+
+		x = (i * 8) % cols;
+		y = (i * 8) / cols;
+
+		for (bit = 0; m; bit++, m >>= 1) {
+			if (!(m & 1))
+				continue;
+
+			level = levels[nchanged / 2];
+			level = (nchanged & 1) ? (level & 0xF) : (level >> 4);
+			nchanged++;
+
+			put(state, x + bit, y, level);
+		}
+	}
+
+	return nchanged;
+}
+
+/* rings are only ever touched whole here, so compare a whole ring at a
+ * time and leave the ones that haven't changed clean */
+static void
+ring_blit(sosc_state_t *state, unsigned ring, const uint8_t *levels)
+{
+	struct sosc_led *led = &state->led;
+	uint8_t *dst;
+
+	dst = led->back_buffered
+		? led->rings_back.level[ring] : led->rings.level[ring];
+
+	if (!memcmp(dst, levels, SOSC_LED_RING_SIZE))
+		return;
+
+	memcpy(dst, levels, SOSC_LED_RING_SIZE);
+
+	if (!led->back_buffered)
+		mark_ring_dirty(state, ring);
+}
+
+int
+sosc_led_ring_frame(sosc_state_t *state, const uint8_t *data, size_t nbytes)
+{
+	uint8_t levels[SOSC_LED_RING_SIZE];
+	unsigned ring, nrings, i, j;
+	uint64_t x;
+
+	nrings = nbytes / SOSC_LED_RING_FRAME_SIZE;
+
+	if (!nrings || nrings > SOSC_LED_RINGS
+	    || nbytes % SOSC_LED_RING_FRAME_SIZE)
+		return -1;
+
+	for (ring = 0; ring < nrings; ring++) {
+		for (i = 0; i < SOSC_LED_RING_SIZE; i += 8, data += 4) {
+			x = sosc_led_unpack_levels8(data);
+
+			for (j = 0; j < 8; j++)
+				levels[i + j] = x >> (j * 8);
+		}
+
+		ring_blit(state, ring, levels);
+	}
+
+	return nrings;
+}
+
+int
+sosc_led_ring_delta(sosc_state_t *state, const uint8_t *data, size_t nbytes)
+{
+	const uint8_t *seg, *end = data + nbytes;
+	unsigned ring, start, count, i;
+	int nchanged = 0;
+	uint8_t level;
+
+	/* check the whole thing before applying any of it */
+	for (seg = data; seg < end; seg += 3 + (count + 1) / 2) {
+		if (end - seg < 3)
+			return -1;
+
+		count = seg[2];
+
+		if (seg[0] >= SOSC_LED_RINGS || seg[1] >= SOSC_LED_RING_SIZE
+		    || !count || count > SOSC_LED_RING_SIZE
+		    || (size_t) (end - seg) < 3 + (count + 1) / 2)
+			return -1;
+	}
+
+	for (seg = data; seg < end; seg += 3 + (count + 1) / 2) {
+		ring  = seg[0];
+		start = seg[1];
+		count = seg[2];
+
+		for (i = 0; i < count; i++) {
+			level = seg[3 + i / 2];
+			level = (i & 1) ? (level & 0xF) : (level >> 4);
+
+			ring_put(state, ring, start + i, level);
+		}
+
+		nchanged += count;
+	}
+
+	return nchanged;
+}
+
+/*************************************************************************
+ * mext encoding
+ *************************************************************************/
+
+/* when the serial output queue is active (see serial_out.c), LED commands
+ * are encoded here instead of by libmonome, which means the rotation
+ * libmonome would have applied on the way out is applied here too. the
+ * frame stays in application coordinates either way. */
+
+#define MEXT_LED_OFF        0x10
+#define MEXT_LED_ON         0x11
+#define MEXT_LED_ALL_OFF    0x12
+#define MEXT_LED_ALL_ON     0x13
+#define MEXT_LED_MAP        0x14
+#define MEXT_LED_ROW        0x15
+#define MEXT_LED_COL        0x16
+#define MEXT_LED_LEVEL_SET  0x18
+#define MEXT_LED_LEVEL_ALL  0x19
+#define MEXT_LED_LEVEL_MAP  0x1A
+#define MEXT_LED_LEVEL_ROW  0x1B
+#define MEXT_LED_LEVEL_COL  0x1C
+#define MEXT_RING_SET       0x90
+#define MEXT_RING_ALL       0x91
+#define MEXT_RING_MAP       0x92
+
+/* flushes check for SOSC_LED_FLUSH_MAX bytes of room up front, so a
+ * reservation made while flushing can't fail. */
+static uint8_t *
+mext_packet(sosc_state_t *state, uint8_t cmd, size_t nbytes)
+{
+	uint8_t *p = sosc_serial_out_reserve(state, nbytes);
+
+	if (p)
+		p[0] = cmd;
+
+	return p;
+}
+
+/* where application coordinates end up on the device. these are the
+ * transforms libmonome applies to LED output, so what we draw still lines
+ * up with the keys it rotates on the way in. the geometry itself is in
+ * led_rotate.c. */
+static void
+to_device(sosc_state_t *state, unsigned *x, unsigned *y)
+{
+	unsigned cols, rows;
+
+	if (grid_size(state, &cols, &rows))
+		sosc_led_rotate_point(monome_get_rotation(state->monome),
+		                      cols, rows, x, y);
+}
+
+/* the 8 LEDs of a quad row, as the device sees them. returns 1 if
+ * they're a column now. */
+static int
+device_row(sosc_state_t *state, unsigned x_off, unsigned y,
+           unsigned *dx, unsigned *dy, uint8_t *levels)
+{
+	unsigned cols, rows;
+
+	grid_size(state, &cols, &rows);
+	return sosc_led_rotate_row(monome_get_rotation(state->monome),
+	                           cols, rows, x_off, y,
+	                           &state->led.frame.level[y][x_off],
+	                           dx, dy, levels);
+}
+
+/* a quad, as the device sees it, one level per byte, row by row */
+static void
+device_quad(sosc_state_t *state, unsigned x_off, unsigned y_off,
+            unsigned *dx, unsigned *dy, uint8_t *levels)
+{
+	unsigned cols, rows;
+
+	grid_size(state, &cols, &rows);
+	sosc_led_rotate_quad(monome_get_rotation(state->monome),
+	                     cols, rows, x_off, y_off,
+	                     &state->led.frame.level[y_off][x_off],
+	                     SOSC_LED_COLS_MAX, dx, dy, levels);
+}
+
+/* two levels per byte, high nibble first */
+static void
+mext_pack_levels(uint8_t *dst, const uint8_t *levels, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i += 2)
+		dst[i / 2] = (levels[i] << 4) | (levels[i + 1] & 0xF);
+}
+
+/*************************************************************************
+ * flushing
+ *************************************************************************/
+
+static size_t
+set_cost(uint8_t level)
+{
+	return is_binary(level)
+		? SOSC_MEXT_LED_SET_SIZE
+		: SOSC_MEXT_LED_LEVEL_SET_SIZE;
+}
+
+static void
+write_set(sosc_state_t *state, unsigned x, unsigned y)
+{
+	uint8_t level = state->led.frame.level[y][x];
+	uint8_t *p;
+
+	if (!sosc_serial_out_active(state)) {
+		if (is_binary(level))
+			monome_led_set(state->monome, x, y, !!level);
+		else
+			monome_led_level_set(state->monome, x, y, level);
+
+		goto out;
+	}
+
+	to_device(state, &x, &y);
+
+	if (is_binary(level)) {
+		if ((p = mext_packet(state, level ? MEXT_LED_ON : MEXT_LED_OFF,
+		                     SOSC_MEXT_LED_SET_SIZE))) {
+			p[1] = x;
+			p[2] = y;
+		}
+	} else if ((p = mext_packet(state, MEXT_LED_LEVEL_SET,
+	                            SOSC_MEXT_LED_LEVEL_SET_SIZE))) {
+		p[1] = x;
+		p[2] = y;
+		p[3] = level;
+	}
+
+out:
+	state->stats.led_bytes_written += set_cost(level);
+}
+
+/* on a grid turned on its side, a row goes out as a column, which costs
+ * the same */
+static void
+write_row(sosc_state_t *state, unsigned x_off, unsigned y, int binary)
+{
+	const uint8_t *levels = &state->led.frame.level[y][x_off];
+	uint8_t bits, *p, dev[SOSC_LED_QUAD_SIZE];
+	unsigned dx, dy;
+	int i, vertical;
+
+	if (!sosc_serial_out_active(state)) {
+		if (binary) {
+			for (bits = 0, i = 0; i < SOSC_LED_QUAD_SIZE; i++)
+				bits |= (!!levels[i]) << i;
+
+			monome_led_row(state->monome, x_off, y, 1, &bits);
+		} else
+			monome_led_level_row(state->monome, x_off, y,
+			                     SOSC_LED_QUAD_SIZE, levels);
+
+		goto out;
+	}
+
+	vertical = device_row(state, x_off, y, &dx, &dy, dev);
+
+	if (binary) {
+		for (bits = 0, i = 0; i < SOSC_LED_QUAD_SIZE; i++)
+			bits |= (!!dev[i]) << i;
+
+		if ((p = mext_packet(state, vertical ? MEXT_LED_COL : MEXT_LED_ROW,
+		                     SOSC_MEXT_LED_ROW_SIZE))) {
+			p[1] = dx;
+			p[2] = dy;
+			p[3] = bits;
+		}
+	} else if ((p = mext_packet(state,
+	                            vertical ? MEXT_LED_LEVEL_COL : MEXT_LED_LEVEL_ROW,
+	                            SOSC_MEXT_LED_LEVEL_ROW_SIZE))) {
+		p[1] = dx;
+		p[2] = dy;
+		mext_pack_levels(p + 3, dev, SOSC_LED_QUAD_SIZE);
+	}
+
+out:
+	state->stats.led_bytes_written += binary
+		? SOSC_MEXT_LED_ROW_SIZE
+		: SOSC_MEXT_LED_LEVEL_ROW_SIZE;
+}
+
+static void
+write_map(sosc_state_t *state, unsigned x_off, unsigned y_off, int binary)
+{
+	uint8_t buf[SOSC_LED_QUAD_SIZE * SOSC_LED_QUAD_SIZE];
+	uint8_t bits[SOSC_LED_QUAD_SIZE];
+	int queued = sosc_serial_out_active(state);
+	unsigned x, y;
+	uint8_t *p;
+
+	/* one level per byte, row by row, in whichever orientation it's
+	 * going out in */
+	if (queued)
+		device_quad(state, x_off, y_off, &x_off, &y_off, buf);
+	else
+		for (y = 0; y < SOSC_LED_QUAD_SIZE; y++)
+			memcpy(&buf[y * SOSC_LED_QUAD_SIZE],
+			       &state->led.frame.level[y_off + y][x_off],
+			       SOSC_LED_QUAD_SIZE);
+
+	if (binary) {
+		for (y = 0; y < SOSC_LED_QUAD_SIZE; y++)
+			for (bits[y] = 0, x = 0; x < SOSC_LED_QUAD_SIZE; x++)
+				bits[y] |= (!!buf[y * SOSC_LED_QUAD_SIZE + x]) << x;
+
+		if (!queued)
+			monome_led_map(state->monome, x_off, y_off, bits);
+		else if ((p = mext_packet(state, MEXT_LED_MAP,
+		                          SOSC_MEXT_LED_MAP_SIZE))) {
+			p[1] = x_off;
+			p[2] = y_off;
+			memcpy(p + 3, bits, SOSC_LED_QUAD_SIZE);
+		}
+
+		state->stats.led_bytes_written += SOSC_MEXT_LED_MAP_SIZE;
+	} else {
+		if (!queued)
+			monome_led_level_map(state->monome, x_off, y_off, buf);
+		else if ((p = mext_packet(state, MEXT_LED_LEVEL_MAP,
+		                          SOSC_MEXT_LED_LEVEL_MAP_SIZE))) {
+			p[1] = x_off;
+			p[2] = y_off;
+			mext_pack_levels(p + 3, buf, sizeof(buf));
+		}
+
+		state->stats.led_bytes_written += SOSC_MEXT_LED_LEVEL_MAP_SIZE;
+	}
+}
+
+/* for one quad, work out whether it's cheaper to send the whole thing as
+ * a map, or to go row by row sending either the row or the individual
+ * LEDs that changed in it. */
+static void
+flush_quad(sosc_state_t *state, unsigned x_off, unsigned y_off)
+{
+	struct sosc_led *led = &state->led;
+	size_t row_cost[SOSC_LED_QUAD_SIZE], set_costs[SOSC_LED_QUAD_SIZE];
+	uint8_t changed[SOSC_LED_QUAD_SIZE];
+	int row_binary[SOSC_LED_QUAD_SIZE];
+	size_t plan_cost, map_cost;
+	int quad_binary, any;
+	unsigned x, y;
+	uint8_t level;
+
+	quad_binary = 1;
+	plan_cost = 0;
+	any = 0;
+
+	for (y = 0; y < SOSC_LED_QUAD_SIZE; y++) {
+		changed[y] = 0;
+		set_costs[y] = 0;
+		row_binary[y] = 1;
+
+		for (x = 0; x < SOSC_LED_QUAD_SIZE; x++) {
+			level = led->frame.level[y_off + y][x_off + x];
+			row_binary[y] &= is_binary(level);
+
+			if (level == led->hw.level[y_off + y][x_off + x])
+				continue;
+
+			changed[y] |= 1 << x;
+			set_costs[y] += set_cost(level);
+		}
+
+		quad_binary &= row_binary[y];
+
+		if (!changed[y])
+			continue;
+
+		any = 1;
+		row_cost[y] = row_binary[y]
+			? SOSC_MEXT_LED_ROW_SIZE
+			: SOSC_MEXT_LED_LEVEL_ROW_SIZE;
+
+		plan_cost += (set_costs[y] < row_cost[y]) ? set_costs[y] : row_cost[y];
+	}
+
+	if (!any)
+		return;
+
+	map_cost = quad_binary
+		? SOSC_MEXT_LED_MAP_SIZE
+		: SOSC_MEXT_LED_LEVEL_MAP_SIZE;
+
+	if (map_cost <= plan_cost) {
+		write_map(state, x_off, y_off, quad_binary);
+		goto done;
+	}
+
+	for (y = 0; y < SOSC_LED_QUAD_SIZE; y++) {
+		if (!changed[y])
+			continue;
+
+		if (row_cost[y] <= set_costs[y]) {
+			write_row(state, x_off, y_off + y, row_binary[y]);
+			continue;
+		}
+
+		for (x = 0; x < SOSC_LED_QUAD_SIZE; x++)
+			if (changed[y] & (1 << x))
+				write_set(state, x_off + x, y_off + y);
+	}
+
+done:
+	for (y = 0; y < SOSC_LED_QUAD_SIZE; y++)
+		memcpy(&led->hw.level[y_off + y][x_off],
+		       &led->frame.level[y_off + y][x_off], SOSC_LED_QUAD_SIZE);
+
+	record_latency(state, led->dirty_since[QUAD_INDEX(x_off, y_off)]);
+}
+
+/* if the whole visible frame is one level (clearing the grid, mostly) and
+ * something changed, a single "all" message beats anything else. */
+static int
+flush_uniform(sosc_state_t *state, unsigned cols, unsigned rows)
+{
+	struct sosc_led *led = &state->led;
+	uint8_t level = led->frame.level[0][0];
+	unsigned x, y;
+	int changed = 0;
+	uint8_t *p;
+
+	for (y = 0; y < rows; y++)
+		for (x = 0; x < cols; x++) {
+			if (led->frame.level[y][x] != level)
+				return 0;
+
+			changed |= led->hw.level[y][x] != level;
+		}
+
+	if (!changed)
+		return 1;
+
+	if (is_binary(level)) {
+		if (!sosc_serial_out_active(state))
+			monome_led_all(state->monome, !!level);
+		else
+			mext_packet(state, level ? MEXT_LED_ALL_ON : MEXT_LED_ALL_OFF,
+			            SOSC_MEXT_LED_ALL_SIZE);
+
+		state->stats.led_bytes_written += SOSC_MEXT_LED_ALL_SIZE;
+	} else {
+		if (!sosc_serial_out_active(state))
+			monome_led_level_all(state->monome, level);
+		else if ((p = mext_packet(state, MEXT_LED_LEVEL_ALL,
+		                          SOSC_MEXT_LED_LEVEL_ALL_SIZE)))
+			p[1] = level;
+
+		state->stats.led_bytes_written += SOSC_MEXT_LED_LEVEL_ALL_SIZE;
+	}
+
+	for (y = 0; y < rows; y++)
+		memcpy(led->hw.level[y], led->frame.level[y], cols);
+
+	for (y = 0; y < rows; y += SOSC_LED_QUAD_SIZE)
+		for (x = 0; x < cols; x += SOSC_LED_QUAD_SIZE)
+			if (led->dirty & QUAD_BIT(x, y))
+				record_latency(state, led->dirty_since[QUAD_INDEX(x, y)]);
+
+	return 1;
+}
+
+static void
+write_ring_set(sosc_state_t *state, unsigned ring, unsigned x)
+{
+	uint8_t level = state->led.rings.level[ring][x];
+	uint8_t *p;
+
+	if (!sosc_serial_out_active(state))
+		monome_led_ring_set(state->monome, ring, x, level);
+	else if ((p = mext_packet(state, MEXT_RING_SET,
+	                          SOSC_MEXT_RING_SET_SIZE))) {
+		p[1] = ring;
+		p[2] = x;
+		p[3] = level;
+	}
+
+	state->stats.led_bytes_written += SOSC_MEXT_RING_SET_SIZE;
+}
+
+static void
+write_ring_all(sosc_state_t *state, unsigned ring)
+{
+	uint8_t level = state->led.rings.level[ring][0];
+	uint8_t *p;
+
+	if (!sosc_serial_out_active(state))
+		monome_led_ring_all(state->monome, ring, level);
+	else if ((p = mext_packet(state, MEXT_RING_ALL,
+	                          SOSC_MEXT_RING_ALL_SIZE))) {
+		p[1] = ring;
+		p[2] = level;
+	}
+
+	state->stats.led_bytes_written += SOSC_MEXT_RING_ALL_SIZE;
+}
+
+static void
+write_ring_map(sosc_state_t *state, unsigned ring)
+{
+	const uint8_t *levels = state->led.rings.level[ring];
+	uint8_t *p;
+
+	if (!sosc_serial_out_active(state))
+		monome_led_ring_map(state->monome, ring, levels);
+	else if ((p = mext_packet(state, MEXT_RING_MAP,
+	                          SOSC_MEXT_RING_MAP_SIZE))) {
+		p[1] = ring;
+		mext_pack_levels(p + 2, levels, SOSC_LED_RING_SIZE);
+	}
+
+	state->stats.led_bytes_written += SOSC_MEXT_RING_MAP_SIZE;
+}
+
+/* a ring is either all one level (one "all"), has a few LEDs changed
+ * (a "set" each), or gets sent whole. */
+static void
+flush_ring(sosc_state_t *state, unsigned ring)
+{
+	struct sosc_led *led = &state->led;
+	const uint8_t *levels = led->rings.level[ring];
+	const uint8_t *hw = led->rings_hw.level[ring];
+	unsigned x, changed = 0;
+	int uniform = 1;
+
+	for (x = 0; x < SOSC_LED_RING_SIZE; x++) {
+		changed += levels[x] != hw[x];
+		uniform &= levels[x] == levels[0];
+	}
+
+	if (!changed)
+		return;
+
+	if (uniform)
+		write_ring_all(state, ring);
+	else if (changed * SOSC_MEXT_RING_SET_SIZE < SOSC_MEXT_RING_MAP_SIZE) {
+		for (x = 0; x < SOSC_LED_RING_SIZE; x++)
+			if (levels[x] != hw[x])
+				write_ring_set(state, ring, x);
+	} else
+		write_ring_map(state, ring);
+
+	memcpy(led->rings_hw.level[ring], levels, SOSC_LED_RING_SIZE);
+	record_latency(state, led->rings_dirty_since[ring]);
+}
+
+void
+sosc_led_flush(sosc_state_t *state)
+{
+	struct sosc_led *led = &state->led;
+	unsigned cols, rows, x, y, ring;
+	int queued = sosc_serial_out_active(state);
+
+	if (!led->dirty && !led->rings_dirty)
+		goto out;
+
+	/* the port is backed up. leave everything dirty and let the queue
+	 * call us back when it's drained, by which time the frame will have
+	 * moved on and only the latest of it needs to go out. */
+	if (queued && sosc_serial_out_space(state)
+	    < SOSC_LED_FLUSH_MAX + SOSC_SERIAL_OUT_RESERVE) {
+		if (!led->waiting)
+			state->stats.led_flushes_deferred++;
+
+		led->waiting = 1;
+		led->flush_deadline = 0;
+		sosc_serial_out_set_congested(state, 1);
+		return;
+	}
+
+	for (ring = 0; ring < SOSC_LED_RINGS; ring++)
+		if (led->rings_dirty & (1U << ring))
+			flush_ring(state, ring);
+
+	if (!led->dirty || !grid_size(state, &cols, &rows)
+	    || flush_uniform(state, cols, rows))
+		goto out;
+
+	for (y = 0; y < rows; y += SOSC_LED_QUAD_SIZE)
+		for (x = 0; x < cols; x += SOSC_LED_QUAD_SIZE)
+			if (led->dirty & QUAD_BIT(x, y))
+				flush_quad(state, x, y);
+
+out:
+	led->dirty = 0;
+	led->rings_dirty = 0;
+	led->waiting = 0;
+	led->flush_deadline = 0;
+	led->last_flush = sosc_now_usec();
+}
+
+/* with a refresh rate configured, LED changes are held back and flushed
+ * at most once per tick, so an app that redraws a cell at a time only
+ * costs one diff per frame. if nothing has gone out for a whole tick,
+ * though, there's no frame to coalesce with, and an isolated change goes
+ * out immediately instead of waiting. */
+void
+sosc_led_update(sosc_state_t *state)
+{
+	struct sosc_led *led = &state->led;
+	uint64_t interval, now;
+
+	if (!led->dirty && !led->rings_dirty)
+		return;
+
+	/* sosc_led_end() will be back */
+	if (led->transaction)
+		return;
+
+	if (state->config.dev.led_refresh_rate <= 0) {
+		sosc_led_flush(state);
+		return;
+	}
+
+	/* already waiting on the next tick */
+	if (led->flush_deadline)
+		return;
+
+	interval = 1000000 / state->config.dev.led_refresh_rate;
+	now = sosc_now_usec();
+
+	if (now - led->last_flush >= interval)
+		sosc_led_flush(state);
+	else
+		led->flush_deadline = led->last_flush + interval;
+}
+
+void
+sosc_led_begin(sosc_state_t *state)
+{
+	if (!state->led.transaction++)
+		state->led.touched = 0;
+}
+
+static void
+close_transaction(sosc_state_t *state)
+{
+	/* bundles of anything else, or of LED calls that didn't change
+	 * anything, aren't transactions worth counting */
+	if (state->led.touched)
+		state->stats.led_transactions++;
+
+	sosc_led_update(state);
+}
+
+void
+sosc_led_end(sosc_state_t *state)
+{
+	struct sosc_led *led = &state->led;
+
+	if (!led->transaction || --led->transaction)
+		return;
+
+	close_transaction(state);
+}
+
+void
+sosc_led_abort_transaction(sosc_state_t *state)
+{
+	if (!state->led.transaction)
+		return;
+
+	state->led.transaction = 0;
+	close_transaction(state);
+}
+
+void
+sosc_led_tick(sosc_state_t *state, uint64_t now)
+{
+	struct sosc_led *led = &state->led;
+
+	if (!led->flush_deadline || now < led->flush_deadline)
+		return;
+
+	sosc_led_flush(state);
+}
+
+/* not part of the frame, so it goes into the queue on its own, behind
+ * any LED commands already in there */
+void
+sosc_led_intensity(sosc_state_t *state, unsigned level)
+{
+	if (level > SOSC_LED_LEVEL_MAX)
+		level = SOSC_LED_LEVEL_MAX;
+
+	if (!sosc_serial_out_active(state)) {
+		monome_led_intensity(state->monome, level);
+		return;
+	}
+
+	sosc_serial_out_intensity(state, level);
+}
+
+/* arcs don't have an intensity command of their own, libmonome sends them
+ * the grid's */
+void
+sosc_led_ring_intensity(sosc_state_t *state, unsigned level)
+{
+	if (!sosc_serial_out_active(state)) {
+		monome_led_ring_intensity(state->monome, level);
+		return;
+	}
+
+	sosc_led_intensity(state, level);
+}
+
+/*************************************************************************
+ * back buffer
+ *************************************************************************/
+
+/* with the back buffer on, drawing goes into led->back and nothing is
+ * marked dirty until the app commits. the commit copies over whatever
+ * differs, a row of a quad at a time, and the flush then sends the
+ * difference from what's on the device as usual. since the front frame
+ * only ever changes here, the device never shows half a redraw, even if
+ * the flush is held back for the refresh clock or the serial queue. */
+
+int
+sosc_led_commit(sosc_state_t *state)
+{
+	struct sosc_led *led = &state->led;
+	unsigned x, y, ring;
+	int changed = 0;
+
+	if (!led->back_buffered)
+		return 0;
+
+	for (y = 0; y < SOSC_LED_ROWS_MAX; y++)
+		for (x = 0; x < SOSC_LED_COLS_MAX; x += SOSC_LED_QUAD_SIZE) {
+			if (!memcmp(&led->frame.level[y][x], &led->back.level[y][x],
+			            SOSC_LED_QUAD_SIZE))
+				continue;
+
+			memcpy(&led->frame.level[y][x], &led->back.level[y][x],
+			       SOSC_LED_QUAD_SIZE);
+			mark_dirty(state, x, y);
+			changed = 1;
+		}
+
+	for (ring = 0; ring < SOSC_LED_RINGS; ring++) {
+		if (!memcmp(led->rings.level[ring], led->rings_back.level[ring],
+		            SOSC_LED_RING_SIZE))
+			continue;
+
+		memcpy(led->rings.level[ring], led->rings_back.level[ring],
+		       SOSC_LED_RING_SIZE);
+		mark_ring_dirty(state, ring);
+		changed = 1;
+	}
+
+	/* the committed frame replaces whatever keys had lit */
+	memset(led->echo.lit, 0, sizeof(led->echo.lit));
+
+	state->stats.led_commits++;
+	sosc_led_update(state);
+	return changed;
+}
+
+/* the back buffer starts out as a copy of what's showing, so an app that
+ * only redraws part of the grid doesn't wipe the rest. turning it off
+ * commits whatever is pending first. */
+void
+sosc_led_set_back_buffered(sosc_state_t *state, int on)
+{
+	struct sosc_led *led = &state->led;
+
+	on = !!on;
+
+	if (on == led->back_buffered)
+		return;
+
+	if (on) {
+		memcpy(&led->back, &led->frame, sizeof(led->back));
+		memcpy(&led->rings_back, &led->rings, sizeof(led->rings_back));
+	} else
+		sosc_led_commit(state);
+
+	led->back_buffered = on;
+}
+
+/*************************************************************************
+ * drawing from inside the device process
+ *************************************************************************/
+
+void
+sosc_led_put_front(sosc_state_t *state, unsigned x, unsigned y,
+                   unsigned level)
+{
+	struct sosc_led *led = &state->led;
+
+	if (x >= SOSC_LED_COLS_MAX || y >= SOSC_LED_ROWS_MAX
+	    || led->frame.level[y][x] == level)
+		return;
+
+	led->frame.level[y][x] = level;
+	mark_dirty(state, x, y);
+}
+
+/*************************************************************************
+ * local echo
+ *************************************************************************/
+
+/* keys lighting their own LEDs without waiting for the app to do it. the
+ * key event still goes to the app, which can draw over the echo at any
+ * time, and can claim parts of the grid for itself with /sys/echo/own.
+ * echo draws to the front frame even with the back buffer on, and is
+ * flushed like any other change: on the refresh clock if there is one,
+ * which still sends an isolated press straight out. */
+
+
+void
+sosc_led_echo_key(sosc_state_t *state, unsigned x, unsigned y, int down)
+{
+	struct sosc_led *led = &state->led;
+	uint32_t bit;
+
+	if (x >= SOSC_LED_COLS_MAX || y >= SOSC_LED_ROWS_MAX)
+		return;
+
+	bit = 1U << x;
+	if (led->echo.owned[y] & bit)
+		return;
+
+	switch (state->config.dev.echo) {
+	case SOSC_ECHO_MOMENTARY:
+		if (down) {
+			if (!(led->echo.lit[y] & bit))
+				led->echo.saved[y][x] = led->frame.level[y][x];
+
+			sosc_led_put_front(state, x, y, SOSC_LED_LEVEL_MAX);
+			led->echo.lit[y] |= bit;
+		} else {
+			if (!(led->echo.lit[y] & bit))
+				return;
+
+			led->echo.lit[y] &= ~bit;
+			sosc_led_put_front(state, x, y, led->echo.saved[y][x]);
+		}
+
+		break;
+
+	case SOSC_ECHO_TOGGLE:
+		if (!down)
+			return;
+
+		sosc_led_put_front(state, x, y,
+		                   led->frame.level[y][x] ? 0 : SOSC_LED_LEVEL_MAX);
+		break;
+
+	default:
+		return;
+	}
+
+	state->stats.led_echoes++;
+	sosc_led_update(state);
+}
+
+void
+sosc_led_echo_restore(sosc_state_t *state)
+{
+	struct sosc_led *led = &state->led;
+	unsigned x, y;
+
+	for (y = 0; y < SOSC_LED_ROWS_MAX; y++) {
+		for (x = 0; led->echo.lit[y]; x++)
+			if (led->echo.lit[y] & (1U << x)) {
+				led->echo.lit[y] &= ~(1U << x);
+				sosc_led_put_front(state, x, y, led->echo.saved[y][x]);
+			}
+	}
+
+	sosc_led_update(state);
+}
+
+void
+sosc_led_echo_own(sosc_state_t *state, unsigned x, unsigned y,
+                  unsigned w, unsigned h, int own)
+{
+	struct sosc_led *led = &state->led;
+	uint32_t mask;
+	unsigned row;
+
+	if (x >= SOSC_LED_COLS_MAX || y >= SOSC_LED_ROWS_MAX)
+		return;
+
+	if (w > SOSC_LED_COLS_MAX - x)
+		w = SOSC_LED_COLS_MAX - x;
+	if (h > SOSC_LED_ROWS_MAX - y)
+		h = SOSC_LED_ROWS_MAX - y;
+
+	/* w can be all 32 columns, which a 32-bit shift can't do */
+	mask = (uint32_t) ((((uint64_t) 1) << w) - 1) << x;
+
+	for (row = y; row < y + h; row++) {
+		if (own) {
+			/* it's the app's to draw now */
+			led->echo.owned[row] |= mask;
+			led->echo.lit[row] &= ~mask;
+		} else
+			led->echo.owned[row] &= ~mask;
+	}
+}
+
+/*************************************************************************
+ * setup
+ *************************************************************************/
+
+void
+sosc_led_init(sosc_state_t *state)
+{
+	memset(&state->led, 0, sizeof(state->led));
+	monome_led_all(state->monome, 0);
+
+	/* we don't know what the rings are showing, so the first thing
+	 * drawn to each goes out in full */
+	memset(&state->led.rings_hw, 0xFF, sizeof(state->led.rings_hw));
+}
+
+/* libmonome rotates everything on the way out, so after a rotation change
+ * the device is showing our frame in the wrong orientation. forget what
+ * we think is on the hardware and paint the whole frame again. */
+void
+sosc_led_invalidate(sosc_state_t *state)
+{
+	uint64_t now = state->in.osc_recv_at
+		? state->in.osc_recv_at : sosc_now_usec();
+	int i;
+
+	memset(&state->led.hw, 0xFF, sizeof(state->led.hw));
+	state->led.dirty = ALL_QUADS;
+
+	for (i = 0; i < SOSC_LED_QUADS; i++)
+		state->led.dirty_since[i] = now;
+
+	sosc_led_update(state);
+}
@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <serialosc/led.h>
+
+/* kept apart from led.c, which needs libmonome and a whole sosc_state,
+ * so that bench/blob-check.c can build these on their own. */
+
+size_t
+sosc_led_frame_size(unsigned cols, unsigned rows, int levels)
+{
+	if (!cols || !rows || (cols % 8))
+		return 0;
+
+	return levels ? (cols * rows) / 2 : (cols * rows) / 8;
+}
+
+/* four bytes of two levels each, high nibble first. load each byte into
+ * its own 16-bit lane, then split the nibbles into separate bytes. */
+uint64_t
+sosc_led_unpack_levels8(const uint8_t *packed)
+{
+	uint64_t x;
+
+	x = (uint64_t) packed[0]
+	  | (uint64_t) packed[1] << 16
+	  | (uint64_t) packed[2] << 32
+	  | (uint64_t) packed[3] << 48;
+
+	return ((x >> 4) & 0x000F000F000F000FULL)
+	     | ((x & 0x000F000F000F000FULL) << 8);
+}
+
+/* one byte of on/off bits, LSB first. copy the byte into every lane, keep
+ * bit n in lane n, then turn each non-zero lane into SOSC_LED_LEVEL_MAX. */
+uint64_t
+sosc_led_unpack_bits8(uint8_t bits)
+{
+	uint64_t x;
+
+	x = (bits * 0x0101010101010101ULL) & 0x8040201008040201ULL;
+	x = ((x + 0x7F7F7F7F7F7F7F7FULL) | x) & 0x8080808080808080ULL;
+
+	return (x >> 7) * SOSC_LED_LEVEL_MAX;
+}
@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <monome.h>
+
+#include <serialosc/led.h>
+
+/* the geometry led.c uses when it encodes mext itself, apart from the
+ * sosc_state so that bench/rotation-check.c can hold it up against what
+ * libmonome sends for the same calls. */
+
+void
+sosc_led_rotate_point(int rotation, unsigned cols, unsigned rows,
+                      unsigned *x, unsigned *y)
+{
+	unsigned t;
+
+	switch (rotation) {
+	case MONOME_ROTATE_90:
+		/* cols and rows are the rotated size, the device's is swapped */
+		t = *x;
+		*x = rows - 1 - *y;
+		*y = t;
+		break;
+
+	case MONOME_ROTATE_180:
+		*x = cols - 1 - *x;
+		*y = rows - 1 - *y;
+		break;
+
+	case MONOME_ROTATE_270:
+		t = *y;
+		*y = cols - 1 - *x;
+		*x = t;
+		break;
+
+	default:
+		break;
+	}
+}
+
+int
+sosc_led_rotate_row(int rotation, unsigned cols, unsigned rows,
+                    unsigned x_off, unsigned y, const uint8_t *src,
+                    unsigned *dx, unsigned *dy, uint8_t *dst)
+{
+	unsigned x0 = x_off, y0 = y, x1 = x_off + SOSC_LED_QUAD_SIZE - 1, y1 = y;
+	int i, vertical, reversed;
+
+	sosc_led_rotate_point(rotation, cols, rows, &x0, &y0);
+	sosc_led_rotate_point(rotation, cols, rows, &x1, &y1);
+
+	vertical = (x0 == x1);
+	reversed = vertical ? (y1 < y0) : (x1 < x0);
+
+	*dx = (x0 < x1) ? x0 : x1;
+	*dy = (y0 < y1) ? y0 : y1;
+
+	for (i = 0; i < SOSC_LED_QUAD_SIZE; i++)
+		dst[i] = src[reversed ? SOSC_LED_QUAD_SIZE - 1 - i : i];
+
+	return vertical;
+}
+
+void
+sosc_led_rotate_quad(int rotation, unsigned cols, unsigned rows,
+                     unsigned x_off, unsigned y_off,
+                     const uint8_t *src, size_t stride,
+                     unsigned *dx, unsigned *dy, uint8_t *dst)
+{
+	unsigned x0 = x_off, y0 = y_off;
+	unsigned x1 = x_off + SOSC_LED_QUAD_SIZE - 1;
+	unsigned y1 = y_off + SOSC_LED_QUAD_SIZE - 1;
+	unsigned x, y, px, py;
+
+	sosc_led_rotate_point(rotation, cols, rows, &x0, &y0);
+	sosc_led_rotate_point(rotation, cols, rows, &x1, &y1);
+
+	*dx = (x0 < x1) ? x0 : x1;
+	*dy = (y0 < y1) ? y0 : y1;
+
+	for (y = 0; y < SOSC_LED_QUAD_SIZE; y++)
+		for (x = 0; x < SOSC_LED_QUAD_SIZE; x++) {
+			px = x_off + x;
+			py = y_off + y;
+			sosc_led_rotate_point(rotation, cols, rows, &px, &py);
+
+			dst[(py - *dy) * SOSC_LED_QUAD_SIZE + (px - *dx)] =
+				src[y * stride + x];
+		}
+}
@@ -34,11 +34,13 @@ main(int argc, char **argv)
 	monome_t *device;
 	const char *config_dir = NULL;
 	const char *device_arg;
+	int unix_socket = 0;
 
 	int opt, longindex;
 	struct optparse options;
 	struct optparse_long longopts[] = {
 		{"config-dir", 'c', OPTPARSE_REQUIRED},
+		{"unix-socket", 'u', OPTPARSE_NONE},
 		{0, 0, 0}
 	};
 
@@ -50,6 +52,9 @@ main(int argc, char **argv)
 		case 'c':
 			config_dir = options.optarg;
 			break;
+		case 'u':
+			unix_socket = 1;
+			break;
 		default:
 			fprintf(stderr, "%s: %s\n", argv[0], options.errmsg);
 			return EXIT_FAILURE;
@@ -75,7 +80,7 @@ main(int argc, char **argv)
 #endif
 
 	sosc_zeroconf_init();
-	sosc_server_run(config_dir, device);
+	sosc_server_run(config_dir, unix_socket, device);
 	monome_close(device);
 
 	return EXIT_SUCCESS;
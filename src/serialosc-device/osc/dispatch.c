@@ -0,0 +1,415 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <arpa/inet.h>
+#else
+#include <winsock2.h>
+#endif
+
+#include <lo/lo.h>
+
+#include <serialosc/osc_dispatch.h>
+
+#define BUCKET_MASK (SOSC_OSC_DISPATCH_BUCKETS - 1)
+
+/* FNV-1a */
+static uint32_t
+hash_path(const char *path)
+{
+	uint32_t hash = 2166136261u;
+
+	for (; *path; path++) {
+		hash ^= (uint8_t) *path;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+void
+osc_dispatch_init(struct sosc_osc_dispatch *d)
+{
+	int i;
+
+	memset(d, 0, sizeof(*d));
+
+	for (i = 0; i < SOSC_OSC_DISPATCH_BUCKETS; i++)
+		d->buckets[i] = -1;
+}
+
+int
+osc_dispatch_add(struct sosc_osc_dispatch *d, const char *path,
+                 const char *types, lo_method_handler handler,
+                 void *user_data)
+{
+	struct sosc_osc_method *m;
+	int *pos;
+
+	if (d->nmethods >= SOSC_OSC_DISPATCH_METHODS) {
+		fprintf(stderr, "osc_dispatch_add(): no room for %s\n", path);
+		return -1;
+	}
+
+	m = &d->methods[d->nmethods];
+	m->path = path;
+	m->types = types;
+	m->handler = handler;
+	m->user_data = user_data;
+	m->hash = hash_path(path);
+	m->next = -1;
+
+	/* on the end of the chain, so methods are tried in the order they
+	 * were added, like liblo does */
+	pos = &d->buckets[m->hash & BUCKET_MASK];
+	while (*pos >= 0)
+		pos = &d->methods[*pos].next;
+
+	*pos = d->nmethods++;
+	return 0;
+}
+
+void
+osc_dispatch_set_prefix(struct sosc_osc_dispatch *d, const char *prefix)
+{
+	d->prefix = prefix;
+	d->prefix_len = strlen(prefix);
+}
+
+/*************************************************************************
+ * matching
+ *************************************************************************/
+
+static int
+is_numeric(char t)
+{
+	return t == LO_INT32 || t == LO_FLOAT || t == LO_INT64 || t == LO_DOUBLE;
+}
+
+static int
+is_string(char t)
+{
+	return t == LO_STRING || t == LO_SYMBOL;
+}
+
+/* liblo's rules: a method takes a message if the typetags are the same,
+ * or if they're the same length and every argument can be coerced, i.e.
+ * numbers to numbers and strings to strings. */
+static int
+can_coerce(const char *to, const char *from)
+{
+	for (; *to && *from; to++, from++)
+		if (*to != *from
+		    && !(is_numeric(*to) && is_numeric(*from))
+		    && !(is_string(*to) && is_string(*from)))
+			return 0;
+
+	return !*to && !*from;
+}
+
+static int
+call(struct sosc_osc_method *m, const char *path, const char *types,
+     lo_arg **argv, int argc, lo_message msg)
+{
+	lo_arg coerced[SOSC_OSC_DISPATCH_MAX_ARGS];
+	lo_arg *cargv[SOSC_OSC_DISPATCH_MAX_ARGS];
+	int i;
+
+	if (!m->types || !strcmp(m->types, types))
+		return m->handler(path, types, argv, argc, msg, m->user_data);
+
+	if (argc > SOSC_OSC_DISPATCH_MAX_ARGS)
+		return -1;
+
+	/* strings are laid out the same either way, so only numbers need
+	 * converting */
+	for (i = 0; i < argc; i++) {
+		cargv[i] = argv[i];
+
+		if (m->types[i] == types[i] || !is_numeric(types[i]))
+			continue;
+
+		if (!lo_coerce(m->types[i], &coerced[i], types[i], argv[i]))
+			return -1;
+
+		cargv[i] = &coerced[i];
+	}
+
+	return m->handler(path, m->types, cargv, argc, msg, m->user_data);
+}
+
+/* methods with an exact match on the typetag get the message first, then
+ * the ones that'll take it one way or the other, each in the order they
+ * were added. as with liblo, a handler returns non-zero to pass the
+ * message on to the next. returns 0 once one has taken it, -1 if none
+ * did. */
+static int
+call_path(struct sosc_osc_dispatch *d, const char *key, const char *path,
+          const char *types, lo_arg **argv, int argc, lo_message msg)
+{
+	struct sosc_osc_method *m;
+	uint32_t hash = hash_path(key);
+	int i, exact, is_exact;
+
+	for (exact = 1; exact >= 0; exact--)
+		for (i = d->buckets[hash & BUCKET_MASK]; i >= 0; i = m->next) {
+			m = &d->methods[i];
+
+			if (m->hash != hash || strcmp(m->path, key))
+				continue;
+
+			is_exact = m->types && !strcmp(m->types, types);
+
+			if (is_exact != exact
+			    || (!is_exact && m->types && !can_coerce(m->types, types)))
+				continue;
+
+			if (!call(m, path, types, argv, argc, msg))
+				return 0;
+		}
+
+	return -1;
+}
+
+static int
+matches_pattern(struct sosc_osc_dispatch *d, struct sosc_osc_method *m,
+                const char *pattern)
+{
+	char full[256];
+
+	if (m->path[0] == '/')
+		return lo_pattern_match(m->path, pattern);
+
+	if (d->prefix_len + 1 + strlen(m->path) >= sizeof(full))
+		return 0;
+
+	memcpy(full, d->prefix, d->prefix_len);
+	full[d->prefix_len] = '/';
+	strcpy(full + d->prefix_len + 1, m->path);
+
+	return lo_pattern_match(full, pattern);
+}
+
+/* the slow way, for paths with wildcards in them. every method that
+ * matches gets the message, whatever the others returned, and it counts
+ * as taken if any of them took it. */
+static int
+call_pattern(struct sosc_osc_dispatch *d, const char *path,
+             const char *types, lo_arg **argv, int argc, lo_message msg)
+{
+	struct sosc_osc_method *m;
+	unsigned int i;
+	int ret = -1;
+
+	for (i = 0; i < d->nmethods; i++) {
+		m = &d->methods[i];
+
+		if (m->types && !can_coerce(m->types, types))
+			continue;
+
+		if (!matches_pattern(d, m, path))
+			continue;
+
+		if (!call(m, path, types, argv, argc, msg))
+			ret = 0;
+	}
+
+	return ret;
+}
+
+int
+osc_dispatch_call(struct sosc_osc_dispatch *d, const char *path,
+                  const char *types, lo_arg **argv, int argc,
+                  lo_message msg)
+{
+	if (strpbrk(path, "*?[]{}"))
+		return call_pattern(d, path, types, argv, argc, msg);
+
+	if (d->prefix_len && !strncmp(path, d->prefix, d->prefix_len)
+	    && path[d->prefix_len] == '/'
+	    && !call_path(d, path + d->prefix_len + 1, path, types, argv, argc,
+	                  msg))
+		return 0;
+
+	return call_path(d, path, path, types, argv, argc, msg);
+}
+
+int
+osc_dispatch_lo_handler(const char *path, const char *types,
+                        lo_arg **argv, int argc, lo_message msg,
+                        void *user_data)
+{
+	/* liblo wants 0 for "handled" */
+	return osc_dispatch_call(user_data, path, types, argv, argc, msg)
+		? 1 : 0;
+}
+
+/*************************************************************************
+ * decoding
+ *************************************************************************/
+
+/* size of the OSC string at p, null and padding included, or 0 if it
+ * runs off the end */
+static size_t
+osc_strsize(const uint8_t *p, size_t max)
+{
+	const uint8_t *nul;
+	size_t size;
+
+	if (!(nul = memchr(p, '\0', max)))
+		return 0;
+
+	size = ((nul - p) + 4) & ~3;
+	return (size <= max) ? size : 0;
+}
+
+static void
+swap32(uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+	v = ntohl(v);
+	memcpy(p, &v, 4);
+}
+
+static void
+swap64(uint8_t *p)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		v = (v << 8) | p[i];
+
+	memcpy(p, &v, 8);
+}
+
+int
+osc_dispatch_data(struct sosc_osc_dispatch *d, void *data, size_t nbytes)
+{
+	lo_arg *argv[SOSC_OSC_DISPATCH_MAX_ARGS];
+	uint8_t *p = data, *end = p + nbytes;
+	const char *path, *types;
+	uint32_t blob_size;
+	size_t size;
+	int argc, i;
+
+	/* a bundle starts with '#' */
+	if (!nbytes || p[0] != '/' || !(size = osc_strsize(p, nbytes)))
+		return -1;
+
+	path = (const char *) p;
+	p += size;
+
+	if (p >= end || p[0] != ',' || !(size = osc_strsize(p, end - p)))
+		return -1;
+
+	types = (const char *) p + 1;
+	p += size;
+
+	if ((argc = strlen(types)) > SOSC_OSC_DISPATCH_MAX_ARGS)
+		return -1;
+
+	/* check that everything fits before touching any of it */
+	for (i = 0; i < argc; i++) {
+		argv[i] = (lo_arg *) p;
+
+		switch (types[i]) {
+		case LO_INT32:
+		case LO_FLOAT:
+		case LO_CHAR:
+		case LO_MIDI:
+			size = 4;
+			break;
+
+		case LO_INT64:
+		case LO_DOUBLE:
+		case LO_TIMETAG:
+			size = 8;
+			break;
+
+		case LO_STRING:
+		case LO_SYMBOL:
+			if (!(size = osc_strsize(p, end - p)))
+				return -1;
+			break;
+
+		case LO_BLOB:
+			if (end - p < 4)
+				return -1;
+
+			memcpy(&blob_size, p, 4);
+			blob_size = ntohl(blob_size);
+
+			if (blob_size > (size_t) (end - p) - 4)
+				return -1;
+
+			size = 4 + ((blob_size + 3) & ~3);
+			break;
+
+		case LO_TRUE:
+		case LO_FALSE:
+		case LO_NIL:
+		case LO_INFINITUM:
+			size = 0;
+			break;
+
+		default:
+			return -1;
+		}
+
+		if (size > (size_t) (end - p))
+			return -1;
+
+		p += size;
+	}
+
+	/* then swap the arguments into host order, like liblo would */
+	for (i = 0; i < argc; i++) {
+		p = (uint8_t *) argv[i];
+
+		switch (types[i]) {
+		case LO_INT32:
+		case LO_FLOAT:
+		case LO_CHAR:
+		case LO_BLOB:
+			swap32(p);
+			break;
+
+		case LO_INT64:
+		case LO_DOUBLE:
+			swap64(p);
+			break;
+
+		case LO_TIMETAG:
+			swap32(p);
+			swap32(p + 4);
+			break;
+		}
+	}
+
+	/* no lo_message: building one per datagram would cost most of what
+	 * skipping liblo saves, and none of the device's handlers look at
+	 * it, since replies go to addresses given in the message or set with
+	 * /sys/host and /sys/port rather than back to the sender. */
+	return osc_dispatch_call(d, path, types, argv, argc, NULL) ? 1 : 0;
+}
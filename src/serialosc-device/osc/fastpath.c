@@ -0,0 +1,240 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <arpa/inet.h>
+#else
+#include <winsock2.h>
+#endif
+
+#include <serialosc/serialosc.h>
+#include <serialosc/osc.h>
+#include <serialosc/led.h>
+
+/* the messages that apps send most, and that we'd most like to get
+ * through quickly, all have the same layout every time: the address, a
+ * fixed typetag, and a fixed number of int32s. so, like the outgoing
+ * templates, we keep each one's header as it will arrive for the current
+ * prefix, and a datagram of the right size whose header matches
+ * byte-for-byte gets its arguments read straight out of the receive
+ * buffer and handed to the LED layer. everything else (floats, bundles,
+ * anything unusual) goes on to the method table as before. */
+
+#define I8  "iiiiiiii"
+#define I64 I8 I8 I8 I8 I8 I8 I8 I8
+
+static const struct {
+	const char *path;
+	const char *types;
+} fast_defs[SOSC_OSC_FAST_MAX] = {
+	[SOSC_OSC_FAST_LED_SET]       = {"grid/led/set",       "iii"},
+	[SOSC_OSC_FAST_LED_MAP]       = {"grid/led/map",       "ii" I8},
+	[SOSC_OSC_FAST_LED_LEVEL_SET] = {"grid/led/level/set", "iii"},
+	[SOSC_OSC_FAST_LED_LEVEL_MAP] = {"grid/led/level/map", "ii" I64},
+	[SOSC_OSC_FAST_RING_SET]      = {"ring/set",           "iii"},
+	[SOSC_OSC_FAST_RING_MAP]      = {"ring/map",           "i" I64}
+};
+
+#undef I64
+#undef I8
+
+/* OSC strings are null-terminated and padded out to 4 bytes */
+static size_t
+osc_strsize(size_t len)
+{
+	return (len + 4) & ~3;
+}
+
+static void
+build_template(sosc_osc_fast_template_t *t, const char *prefix,
+               const char *path, const char *types)
+{
+	size_t prefix_len, path_len, types_len, addr_size, types_size;
+
+	prefix_len = strlen(prefix);
+	path_len   = strlen(path);
+	types_len  = strlen(types);
+
+	addr_size  = osc_strsize(prefix_len + 1 + path_len);
+	types_size = osc_strsize(1 + types_len);
+
+	memset(t, 0, sizeof(*t));
+
+	if (addr_size + types_size > sizeof(t->header))
+		return;
+
+	memcpy(t->header, prefix, prefix_len);
+	t->header[prefix_len] = '/';
+	memcpy(t->header + prefix_len + 1, path, path_len);
+
+	t->header[addr_size] = ',';
+	memcpy(t->header + addr_size + 1, types, types_len);
+
+	t->header_nbytes = addr_size + types_size;
+	t->nbytes = t->header_nbytes + (types_len * 4);
+}
+
+void
+osc_fastpath_build(sosc_state_t *state)
+{
+	int i;
+
+	for (i = 0; i < SOSC_OSC_FAST_MAX; i++)
+		build_template(&state->in.fast[i], state->config.app.osc_prefix,
+		               fast_defs[i].path, fast_defs[i].types);
+}
+
+/*************************************************************************
+ * decoding
+ *************************************************************************/
+
+static int32_t
+be32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+	return (int32_t) ntohl(v);
+}
+
+static unsigned
+clamp_level(int32_t level)
+{
+	if (level < 0)
+		return 0;
+	if (level > SOSC_LED_LEVEL_MAX)
+		return SOSC_LED_LEVEL_MAX;
+	return level;
+}
+
+/* 64 big-endian int32 levels to bytes. an in-range level only has bits
+ * set in the low nibble of its last byte, so check eight bytes (two
+ * levels) at a time that nothing else is set, and if so, the levels are
+ * just every fourth byte. htonl() puts the mask's bits wherever the last
+ * byte of each int32 lands when loaded in host order. otherwise, clamp
+ * them one at a time like the method handlers do. */
+static void
+unpack_levels(uint8_t *levels, const uint8_t *p)
+{
+	uint64_t mask, w, stray = 0;
+	uint32_t mask32;
+	int i;
+
+	mask32 = htonl(~(uint32_t) SOSC_LED_LEVEL_MAX);
+	mask = ((uint64_t) mask32 << 32) | mask32;
+
+	for (i = 0; i < 64; i += 2) {
+		memcpy(&w, p + (i * 4), 8);
+		stray |= w & mask;
+	}
+
+	if (!stray) {
+		for (i = 0; i < 64; i++)
+			levels[i] = p[(i * 4) + 3];
+
+		return;
+	}
+
+	for (i = 0; i < 64; i++)
+		levels[i] = clamp_level(be32(p + (i * 4)));
+}
+
+/* eight rows of on/off bits, LSB first, as the handlers take them */
+static void
+unpack_bits(uint8_t *levels, const uint8_t *p)
+{
+	int i, bit;
+	uint8_t row;
+
+	for (i = 0; i < 8; i++) {
+		row = p[(i * 4) + 3];
+
+		for (bit = 0; bit < 8; bit++)
+			levels[(i * 8) + bit] =
+				(row & (1 << bit)) ? SOSC_LED_LEVEL_MAX : 0;
+	}
+}
+
+int
+osc_fastpath_dispatch(sosc_state_t *state, const void *data, size_t nbytes)
+{
+	sosc_osc_fast_template_t *t;
+	const uint8_t *args;
+	uint8_t levels[64];
+	int i;
+
+	for (i = 0; i < SOSC_OSC_FAST_MAX; i++) {
+		t = &state->in.fast[i];
+
+		if (t->nbytes && nbytes == t->nbytes
+		    && !memcmp(data, t->header, t->header_nbytes))
+			break;
+	}
+
+	if (i == SOSC_OSC_FAST_MAX)
+		return -1;
+
+	args = (const uint8_t *) data + t->header_nbytes;
+
+	switch ((sosc_osc_fast_t) i) {
+	case SOSC_OSC_FAST_LED_SET:
+		state->stats.led_bytes_requested += SOSC_MEXT_LED_SET_SIZE;
+		sosc_led_set(state, be32(args), be32(args + 4),
+		             be32(args + 8) ? SOSC_LED_LEVEL_MAX : 0);
+		break;
+
+	case SOSC_OSC_FAST_LED_MAP:
+		unpack_bits(levels, args + 8);
+		state->stats.led_bytes_requested += SOSC_MEXT_LED_MAP_SIZE;
+		sosc_led_map(state, be32(args), be32(args + 4), levels);
+		break;
+
+	case SOSC_OSC_FAST_LED_LEVEL_SET:
+		state->stats.led_bytes_requested += SOSC_MEXT_LED_LEVEL_SET_SIZE;
+		sosc_led_set(state, be32(args), be32(args + 4),
+		             clamp_level(be32(args + 8)));
+		break;
+
+	case SOSC_OSC_FAST_LED_LEVEL_MAP:
+		unpack_levels(levels, args + 8);
+		state->stats.led_bytes_requested += SOSC_MEXT_LED_LEVEL_MAP_SIZE;
+		sosc_led_map(state, be32(args), be32(args + 4), levels);
+		break;
+
+	case SOSC_OSC_FAST_RING_SET:
+		state->stats.led_bytes_requested += SOSC_MEXT_RING_SET_SIZE;
+		sosc_led_ring_set(state, be32(args), be32(args + 4),
+		                  clamp_level(be32(args + 8)));
+		break;
+
+	case SOSC_OSC_FAST_RING_MAP:
+		unpack_levels(levels, args + 4);
+		state->stats.led_bytes_requested += SOSC_MEXT_RING_MAP_SIZE;
+		sosc_led_ring_map(state, be32(args), levels);
+		break;
+
+	default:
+		return -1;
+	}
+
+	state->stats.osc_fastpath_hits++;
+	sosc_led_update(state);
+	return 0;
+}
@@ -0,0 +1,369 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#ifndef WIN32
+#include <arpa/inet.h>
+#else
+#include <winsock2.h>
+#endif
+
+#include <lo/lo.h>
+
+#include <serialosc/serialosc.h>
+#include <serialosc/dgram.h>
+#include <serialosc/osc.h>
+
+/*************************************************************************
+ * scheduled bundles
+ *************************************************************************/
+
+/* liblo will hold on to a bundle timetagged for the future itself, but it
+ * only looks at that queue when it's asked to read from the socket, and
+ * only to the millisecond. we take those bundles out of its hands and put
+ * them on a timer wheel instead, which the scheduler runs alongside the
+ * LED flush clock, nested ones too. a bundle counts as late if it was applied more than
+ * BUNDLE_LATE_USEC after its timetag. */
+
+#define BUNDLE_HEADER_SIZE 16 /* "#bundle\0" + timetag */
+#define BUNDLE_LATE_USEC   1000
+
+static int
+is_bundle(const uint8_t *data, size_t nbytes)
+{
+	return nbytes >= BUNDLE_HEADER_SIZE && !memcmp(data, "#bundle", 8);
+}
+
+static lo_timetag
+bundle_timetag(const uint8_t *data)
+{
+	lo_timetag tt;
+	uint32_t n;
+
+	memcpy(&n, data + 8, 4);
+	tt.sec = ntohl(n);
+	memcpy(&n, data + 12, 4);
+	tt.frac = ntohl(n);
+
+	return tt;
+}
+
+/* goes through a bundle and every bundle nested in it. returns -1 if any
+ * of it is malformed. */
+static int
+check_bundle(const uint8_t *data, size_t nbytes)
+{
+	uint32_t elem_nbytes;
+	size_t off;
+
+	for (off = BUNDLE_HEADER_SIZE; off < nbytes; off += elem_nbytes) {
+		if (nbytes - off < 4)
+			return -1;
+
+		memcpy(&elem_nbytes, data + off, 4);
+		elem_nbytes = ntohl(elem_nbytes);
+		off += 4;
+
+		if (elem_nbytes > nbytes - off)
+			return -1;
+
+		if (is_bundle(data + off, elem_nbytes)
+		    && check_bundle(data + off, elem_nbytes))
+			return -1;
+	}
+
+	return 0;
+}
+
+/* seconds until a bundle is due, 0 if it's immediate, negative if it's
+ * late. timetags are wall clock time. */
+static double
+bundle_delay(const uint8_t *data, lo_timetag now)
+{
+	lo_timetag tt = bundle_timetag(data);
+
+	if (!tt.sec && tt.frac <= 1)
+		return 0;
+
+	return lo_timetag_diff(tt, now);
+}
+
+static void
+record_lateness(sosc_state_t *state, uint64_t late)
+{
+	sosc_hist_record(&state->stats.latency[SOSC_LATENCY_BUNDLE], late);
+
+	if (late > BUNDLE_LATE_USEC)
+		state->stats.osc_bundles_late++;
+}
+
+/* the scheduler runs on the monotonic clock. returns -1 if there's no
+ * room, in which case the bundle should be applied now rather than
+ * lost. */
+static int
+defer(sosc_state_t *state, const uint8_t *data, size_t nbytes, double delay)
+{
+	uint64_t deadline = sosc_now_usec() + (uint64_t) (delay * 1000000.);
+
+	if (sosc_timer_wheel_add(&state->in.scheduled, deadline, data, nbytes)) {
+		state->stats.osc_bundles_overflowed++;
+		return -1;
+	}
+
+	state->stats.osc_bundles_scheduled++;
+	return 0;
+}
+
+/* gets a bundle that's due ready to go to liblo. every bundle nested in
+ * it that's timetagged for later than it is taken out and deferred on
+ * its own, and everything left is marked immediate, so that liblo
+ * neither queues any of it itself nor decides, when we dispatch it on
+ * time, that it's a few microseconds early. the bundle has to have
+ * passed check_bundle(). returns its new size. */
+static size_t
+ready_bundle(sosc_state_t *state, uint8_t *data, size_t nbytes,
+             lo_timetag now)
+{
+	static const uint8_t immediate[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+	uint32_t elem_nbytes, ready;
+	lo_timetag tt;
+	size_t off, after;
+	uint8_t *elem;
+	double delay;
+
+	/* nested bundles are due later if they're later than this one, or
+	 * than now if this one's immediate */
+	tt = bundle_timetag(data);
+	if (!tt.sec && tt.frac <= 1)
+		tt = now;
+
+	memcpy(data + 8, immediate, sizeof(immediate));
+
+	off = BUNDLE_HEADER_SIZE;
+	while (off < nbytes) {
+		memcpy(&elem_nbytes, data + off, 4);
+		elem_nbytes = ntohl(elem_nbytes);
+
+		elem = data + off + 4;
+		after = nbytes - (off + 4 + elem_nbytes);
+
+		if (!is_bundle(elem, elem_nbytes)) {
+			off += 4 + elem_nbytes;
+			continue;
+		}
+
+		if (lo_timetag_diff(bundle_timetag(elem), tt) > 0
+		    && (delay = bundle_delay(elem, now)) > 0
+		    && !defer(state, elem, elem_nbytes, delay)) {
+			memmove(data + off, elem + elem_nbytes, after);
+			nbytes -= 4 + elem_nbytes;
+			continue;
+		}
+
+		ready = ready_bundle(state, elem, elem_nbytes, now);
+
+		if (ready < elem_nbytes) {
+			memmove(elem + ready, elem + elem_nbytes, after);
+			nbytes -= elem_nbytes - ready;
+			elem_nbytes = ready;
+
+			ready = htonl(ready);
+			memcpy(data + off, &ready, 4);
+		}
+
+		off += 4 + elem_nbytes;
+	}
+
+	return nbytes;
+}
+
+static void
+dispatch_scheduled(void *ctx, struct sosc_timer *timer)
+{
+	sosc_state_t *state = ctx;
+	uint64_t now = sosc_now_usec();
+	lo_timetag tt_now;
+	size_t nbytes;
+
+	record_lateness(state,
+	                (now > timer->deadline) ? now - timer->deadline : 0);
+
+	lo_timetag_now(&tt_now);
+	nbytes = ready_bundle(state, timer->data, timer->nbytes, tt_now);
+
+	state->in.osc_recv_at = now;
+	lo_server_dispatch_data(state->server, timer->data, nbytes);
+	state->in.osc_recv_at = 0;
+
+	/* the timetag said when this should be on the device, so it doesn't
+	 * wait on the flush clock */
+	if (state->led.dirty || state->led.rings_dirty)
+		sosc_led_flush(state);
+}
+
+/* returns 1 if the datagram was taken care of. otherwise it's to be
+ * dispatched now, with any bundles nested in it that aren't due yet
+ * taken out. */
+static int
+schedule(sosc_state_t *state, struct sosc_dgram *dgram)
+{
+	lo_timetag tt_now;
+	double delay;
+
+	/* a malformed bundle is left as it is for liblo to reject */
+	if (!is_bundle(dgram->data, dgram->nbytes)
+	    || check_bundle(dgram->data, dgram->nbytes))
+		return 0;
+
+	lo_timetag_now(&tt_now);
+	delay = bundle_delay(dgram->data, tt_now);
+
+	if (delay > 0 && !defer(state, dgram->data, dgram->nbytes, delay))
+		return 1;
+
+	if (delay < 0)
+		record_lateness(state, (uint64_t) (-delay * 1000000.));
+
+	dgram->nbytes = ready_bundle(state, dgram->data, dgram->nbytes, tt_now);
+	return 0;
+}
+
+uint64_t
+osc_scheduled_next(sosc_state_t *state)
+{
+	return sosc_timer_wheel_next(&state->in.scheduled);
+}
+
+void
+osc_scheduled_run(sosc_state_t *state, uint64_t now)
+{
+	sosc_timer_wheel_expire(&state->in.scheduled, now,
+	                        dispatch_scheduled, state);
+}
+
+/*************************************************************************
+ * receiving
+ *************************************************************************/
+
+/* rather than have liblo read one datagram per wakeup, pull everything
+ * that's waiting (up to SOSC_OSC_RECV_BUDGET, so that a flood of LED
+ * messages can't keep key presses waiting) and hand each to liblo's
+ * method table ourselves. */
+
+static void
+dispatch(void *ctx, struct sosc_dgram *dgram)
+{
+	sosc_state_t *state = ctx;
+
+	state->stats.osc_datagrams_received++;
+
+	if (schedule(state, dgram))
+		return;
+
+	/* when we got around to dispatching it, rather than when the kernel
+	 * received it */
+	state->in.osc_recv_at = sosc_now_usec();
+
+	if (!osc_fastpath_dispatch(state, dgram->data, dgram->nbytes))
+		goto out;
+
+	switch (osc_dispatch_data(&state->dispatch, dgram->data, dgram->nbytes)) {
+	case -1:
+		lo_server_dispatch_data(state->server, dgram->data, dgram->nbytes);
+		break;
+
+	case 1:
+		state->stats.osc_messages_unhandled++;
+		break;
+	}
+
+out:
+	state->in.osc_recv_at = 0;
+}
+
+static void
+count_batch(sosc_state_t *state, unsigned int n)
+{
+	unsigned int bucket;
+
+	if (!n)
+		return;
+
+	for (bucket = 0; n > 1 && bucket < SOSC_OSC_RECV_BUCKETS - 1; n >>= 1)
+		bucket++;
+
+	state->stats.osc_recv_batches[bucket]++;
+}
+
+static int
+recv_batch(sosc_state_t *state, int fd)
+{
+	unsigned int ndropped = 0;
+	int n;
+
+	n = sosc_dgram_recv(state->in.batch, fd, SOSC_OSC_RECV_BUDGET,
+	                    dispatch, state, &ndropped);
+
+	if (n < 0)
+		return 0;
+
+	state->stats.osc_datagrams_dropped += ndropped;
+	count_batch(state, n - ndropped);
+
+	/* liblo gives up on a malformed bundle partway through without
+	 * calling the end handler, which would leave the framebuffer waiting
+	 * forever for the transaction to close. nothing can still be open
+	 * once we're done dispatching, so close it here. */
+	sosc_led_abort_transaction(state);
+
+	return n == SOSC_OSC_RECV_BUDGET;
+}
+
+int
+osc_recv(sosc_state_t *state)
+{
+	int n;
+
+	if (!state->in.batch) {
+		for (n = 0; n < SOSC_OSC_RECV_BUDGET; n++) {
+			state->in.osc_recv_at = sosc_now_usec();
+
+			if (lo_server_recv_noblock(state->server, 0) <= 0)
+				break;
+		}
+
+		state->in.osc_recv_at = 0;
+		sosc_led_abort_transaction(state); /* see recv_batch() */
+
+		count_batch(state, n);
+		state->stats.osc_datagrams_received += n;
+		return n == SOSC_OSC_RECV_BUDGET;
+	}
+
+	return recv_batch(state, lo_server_get_socket_fd(state->server));
+}
+
+/* the unix socket is only opened if there are receive buffers, see
+ * server.c */
+int
+osc_recv_unix(sosc_state_t *state)
+{
+	if (state->unix_sock.fd < 0 || !state->in.batch)
+		return 0;
+
+	return recv_batch(state, state->unix_sock.fd);
+}
@@ -22,6 +22,9 @@
 
 #include <serialosc/serialosc.h>
 #include <serialosc/osc.h>
+#include <serialosc/led.h>
+#include <serialosc/anim.h>
+#include <serialosc/tile.h>
 
 static int
 coerce_arg_to_int(lo_type type, lo_arg *src)
@@ -35,34 +38,69 @@ coerce_arg_to_int(lo_type type, lo_arg *src)
 	return 0;
 }
 
+static unsigned
+clamp_level(int level)
+{
+	if (level < 0)
+		return 0;
+	if (level > SOSC_LED_LEVEL_MAX)
+		return SOSC_LED_LEVEL_MAX;
+	return level;
+}
+
+/* unpack on/off bitmasks (one byte per 8 LEDs, LSB first) into levels */
+static void
+unpack_bits(uint8_t *levels, lo_arg **argv, int nbytes)
+{
+	int i, bit;
+
+	for (i = 0; i < nbytes; i++)
+		for (bit = 0; bit < 8; bit++)
+			levels[(i * 8) + bit] =
+				(argv[i]->i & (1 << bit)) ? SOSC_LED_LEVEL_MAX : 0;
+}
+
 OSC_HANDLER_FUNC(led_set_handler)
 {
-	monome_t *monome = user_data;
-	return monome_led_set(monome, argv[0]->i, argv[1]->i, !!argv[2]->i);
+	sosc_state_t *state = user_data;
+
+	state->stats.led_bytes_requested += SOSC_MEXT_LED_SET_SIZE;
+
+	sosc_led_set(state, argv[0]->i, argv[1]->i,
+	             argv[2]->i ? SOSC_LED_LEVEL_MAX : 0);
+	sosc_led_update(state);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_all_handler)
 {
-	monome_t *monome = user_data;
-	return monome_led_all(monome, !!argv[0]->i);
+	sosc_state_t *state = user_data;
+
+	state->stats.led_bytes_requested += SOSC_MEXT_LED_ALL_SIZE;
+
+	sosc_led_all(state, argv[0]->i ? SOSC_LED_LEVEL_MAX : 0);
+	sosc_led_update(state);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_map_handler)
 {
-	monome_t *monome = user_data;
-	uint8_t buf[8];
-	int i;
+	sosc_state_t *state = user_data;
+	uint8_t levels[64];
+
+	unpack_bits(levels, &argv[argc - 8], 8);
 
-	for (i = 0; i < 8; i++)
-		buf[i] = argv[i + (argc - 8)]->i;
+	state->stats.led_bytes_requested += SOSC_MEXT_LED_MAP_SIZE;
 
-	return monome_led_map(monome, argv[0]->i, argv[1]->i, buf);
+	sosc_led_map(state, argv[0]->i, argv[1]->i, levels);
+	sosc_led_update(state);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_col_handler)
 {
-	monome_t *monome = user_data;
-	uint8_t buf[32];
+	sosc_state_t *state = user_data;
+	uint8_t levels[32 * 8];
 	int i;
 
 	if (argc < 3 || argc > 34)
@@ -72,16 +110,19 @@ OSC_HANDLER_FUNC(led_col_handler)
 		if (coerce_arg_to_int(types[i], argv[i]))
 			return 1; /* only integers are invited to this party */
 
-	for (i = 0; i < (argc - 2); i++)
-		buf[i] = argv[i + 2]->i;
+	unpack_bits(levels, &argv[2], argc - 2);
+
+	state->stats.led_bytes_requested += (argc - 2) * SOSC_MEXT_LED_ROW_SIZE;
 
-	return monome_led_col(monome, argv[0]->i, argv[1]->i, argc - 2, buf);
+	sosc_led_col(state, argv[0]->i, argv[1]->i, (argc - 2) * 8, levels);
+	sosc_led_update(state);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_row_handler)
 {
-	monome_t *monome = user_data;
-	uint8_t buf[32];
+	sosc_state_t *state = user_data;
+	uint8_t levels[32 * 8];
 	int i;
 
 	if (argc < 3 || argc > 34)
@@ -91,45 +132,64 @@ OSC_HANDLER_FUNC(led_row_handler)
 		if (coerce_arg_to_int(types[i], argv[i]))
 			return 1;
 
-	for (i = 0; i < (argc - 2); i++)
-		buf[i] = argv[i + 2]->i;
+	unpack_bits(levels, &argv[2], argc - 2);
 
-	return monome_led_row(monome, argv[0]->i, argv[1]->i, argc - 2, buf);
+	state->stats.led_bytes_requested += (argc - 2) * SOSC_MEXT_LED_ROW_SIZE;
+
+	sosc_led_row(state, argv[0]->i, argv[1]->i, (argc - 2) * 8, levels);
+	sosc_led_update(state);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_intensity_handler)
 {
-	monome_t *monome = user_data;
-	return monome_led_intensity(monome, argv[0]->i);
+	sosc_state_t *state = user_data;
+
+	sosc_led_intensity(state, argv[0]->i);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_level_set_handler)
 {
-	monome_t *monome = user_data;
-	return monome_led_level_set(monome, argv[0]->i, argv[1]->i, argv[2]->i);
+	sosc_state_t *state = user_data;
+
+	state->stats.led_bytes_requested += SOSC_MEXT_LED_LEVEL_SET_SIZE;
+
+	sosc_led_set(state, argv[0]->i, argv[1]->i, clamp_level(argv[2]->i));
+	sosc_led_update(state);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_level_all_handler)
 {
-	monome_t *monome = user_data;
-	return monome_led_level_all(monome, argv[0]->i);
+	sosc_state_t *state = user_data;
+
+	state->stats.led_bytes_requested += SOSC_MEXT_LED_LEVEL_ALL_SIZE;
+
+	sosc_led_all(state, clamp_level(argv[0]->i));
+	sosc_led_update(state);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_level_map_handler)
 {
-	monome_t *monome = user_data;
+	sosc_state_t *state = user_data;
 	uint8_t buf[64];
 	int i;
 
 	for (i = 0; i < 64; i++)
-		buf[i] = argv[i + (argc - 64)]->i;
+		buf[i] = clamp_level(argv[i + (argc - 64)]->i);
+
+	state->stats.led_bytes_requested += SOSC_MEXT_LED_LEVEL_MAP_SIZE;
 
-	return monome_led_level_map(monome, argv[0]->i, argv[1]->i, buf);
+	sosc_led_map(state, argv[0]->i, argv[1]->i, buf);
+	sosc_led_update(state);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_level_col_handler)
 {
-	monome_t *monome = user_data;
+	sosc_state_t *state = user_data;
 	uint8_t buf[32];
 	int i;
 
@@ -141,14 +201,19 @@ OSC_HANDLER_FUNC(led_level_col_handler)
 			return 1; /* only integers are invited to this party */
 
 	for (i = 0; i < (argc - 2); i++)
-		buf[i] = argv[i + 2]->i;
+		buf[i] = clamp_level(argv[i + 2]->i);
+
+	state->stats.led_bytes_requested +=
+		((argc - 2 + 7) / 8) * SOSC_MEXT_LED_LEVEL_ROW_SIZE;
 
-	return monome_led_level_col(monome, argv[0]->i, argv[1]->i, argc - 2, buf);
+	sosc_led_col(state, argv[0]->i, argv[1]->i, argc - 2, buf);
+	sosc_led_update(state);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_level_row_handler)
 {
-	monome_t *monome = user_data;
+	sosc_state_t *state = user_data;
 	uint8_t buf[32];
 	int i;
 
@@ -160,74 +225,517 @@ OSC_HANDLER_FUNC(led_level_row_handler)
 			return 1;
 
 	for (i = 0; i < (argc - 2); i++)
-		buf[i] = argv[i + 2]->i;
+		buf[i] = clamp_level(argv[i + 2]->i);
+
+	state->stats.led_bytes_requested +=
+		((argc - 2 + 7) / 8) * SOSC_MEXT_LED_LEVEL_ROW_SIZE;
+
+	sosc_led_row(state, argv[0]->i, argv[1]->i, argc - 2, buf);
+	sosc_led_update(state);
+	return 0;
+}
+
+/* what the same frame would have cost as one map per quad */
+static size_t
+frame_request_cost(sosc_state_t *state, size_t map_size)
+{
+	return ((monome_get_cols(state->monome) / SOSC_LED_QUAD_SIZE)
+	        * (monome_get_rows(state->monome) / SOSC_LED_QUAD_SIZE))
+		* map_size;
+}
+
+OSC_HANDLER_FUNC(led_frame_handler)
+{
+	sosc_state_t *state = user_data;
+
+	if (sosc_led_frame(state, lo_blob_dataptr((lo_blob) argv[0]),
+	                   lo_blob_datasize((lo_blob) argv[0])))
+		return 1;
+
+	state->stats.led_bytes_requested +=
+		frame_request_cost(state, SOSC_MEXT_LED_MAP_SIZE);
+
+	sosc_led_update(state);
+	return 0;
+}
+
+OSC_HANDLER_FUNC(led_level_frame_handler)
+{
+	sosc_state_t *state = user_data;
+
+	if (sosc_led_level_frame(state, lo_blob_dataptr((lo_blob) argv[0]),
+	                         lo_blob_datasize((lo_blob) argv[0])))
+		return 1;
+
+	/* an unnumbered frame is as good as a numbered one, but there's
+	 * nothing to count the next delta from but the delta itself */
+	state->led.seq.have_seq = 1;
+	state->led.seq.rebase = 1;
+	state->led.seq.resync = 0;
+
+	state->stats.led_bytes_requested +=
+		frame_request_cost(state, SOSC_MEXT_LED_LEVEL_MAP_SIZE);
+
+	sosc_led_update(state);
+	return 0;
+}
+
+/*************************************************************************
+ * sequenced frames and deltas
+ *************************************************************************/
+
+/* /grid/led/level/frame ib and /grid/led/level/delta ib carry a sequence
+ * number. a delta only makes sense on top of the one before it, so when
+ * one goes missing we ask the app for a full frame with /sys/resync
+ * (passing the last sequence number we saw) and meanwhile keep applying
+ * newer deltas, which are still closer to right than what's showing.
+ * a delta older than one we've already applied is dropped. after a plain
+ * /grid/led/level/frame b, the next delta is taken as it comes and
+ * counted from. */
+
+#define RESYNC_INTERVAL 250000 /* usec between repeated /sys/resync */
+
+static void
+request_resync(sosc_state_t *state)
+{
+	uint64_t now = sosc_now_usec();
+
+	if (state->led.seq.resync
+	    && now - state->led.seq.resync_sent < RESYNC_INTERVAL)
+		return;
+
+	state->led.seq.resync = 1;
+	state->led.seq.resync_sent = now;
+	state->stats.led_resync_requests++;
+
+	lo_send_from(state->outgoing, state->server, LO_TT_IMMEDIATE,
+	             "/sys/resync", "i", (int32_t) state->led.seq.last_seq);
+}
+
+/* returns non-zero if the delta is stale and should be dropped */
+static int
+check_delta_seq(sosc_state_t *state, uint32_t seq)
+{
+	int32_t diff = (int32_t) (seq - state->led.seq.last_seq);
+
+	if (!state->led.seq.have_seq) {
+		/* no full frame to count from, so this delta is going on top of
+		 * who knows what. count from it, but ask for a frame. */
+		state->led.seq.have_seq = 1;
+		state->led.seq.last_seq = seq;
+		request_resync(state);
+	} else if (state->led.seq.rebase) {
+		state->led.seq.rebase = 0;
+	} else if (diff <= 0) {
+		state->stats.led_deltas_stale++;
+		return 1;
+	} else if (diff > 1) {
+		state->stats.led_deltas_lost += diff - 1;
+		request_resync(state);
+	} else if (state->led.seq.resync)
+		request_resync(state); /* still waiting, maybe ask again */
 
-	return monome_led_level_row(monome, argv[0]->i, argv[1]->i, argc - 2, buf);
+	state->led.seq.last_seq = seq;
+	return 0;
+}
+
+OSC_HANDLER_FUNC(led_level_frame_seq_handler)
+{
+	sosc_state_t *state = user_data;
+
+	if (sosc_led_level_frame(state, lo_blob_dataptr((lo_blob) argv[1]),
+	                         lo_blob_datasize((lo_blob) argv[1])))
+		return 1;
+
+	state->led.seq.last_seq = argv[0]->i;
+	state->led.seq.have_seq = 1;
+	state->led.seq.rebase = 0;
+	state->led.seq.resync = 0;
+
+	state->stats.led_bytes_requested +=
+		frame_request_cost(state, SOSC_MEXT_LED_LEVEL_MAP_SIZE);
+
+	sosc_led_update(state);
+	return 0;
+}
+
+OSC_HANDLER_FUNC(led_level_delta_handler)
+{
+	sosc_state_t *state = user_data;
+	int nchanged;
+
+	if (check_delta_seq(state, argv[0]->i))
+		return 0;
+
+	if ((nchanged = sosc_led_level_delta(state,
+	                lo_blob_dataptr((lo_blob) argv[1]),
+	                lo_blob_datasize((lo_blob) argv[1]))) < 0) {
+		/* we've moved the sequence on, but the cells are lost */
+		request_resync(state);
+		return 1;
+	}
+
+	state->stats.led_deltas_applied++;
+	state->stats.led_bytes_requested +=
+		nchanged * SOSC_MEXT_LED_LEVEL_SET_SIZE;
+
+	sosc_led_update(state);
+	return 0;
+}
+
+/* only does anything with /sys/backbuffer 1. the grid and the rings share
+ * the one back buffer, so either path commits both. */
+OSC_HANDLER_FUNC(led_commit_handler)
+{
+	sosc_state_t *state = user_data;
+
+	sosc_led_commit(state);
+	return 0;
+}
+
+/*************************************************************************
+ * tiles
+ *************************************************************************/
+
+OSC_HANDLER_FUNC(led_tile_define_handler)
+{
+	sosc_state_t *state = user_data;
+
+	return !!sosc_tile_define(state, argv[0]->i, argv[1]->i, argv[2]->i,
+	                          lo_blob_dataptr((lo_blob) argv[3]),
+	                          lo_blob_datasize((lo_blob) argv[3]));
+}
+
+static int
+clamp_origin(int v, int max)
+{
+	if (v < -SOSC_TILE_SIZE_MAX)
+		return -SOSC_TILE_SIZE_MAX;
+	if (v > max)
+		return max;
+	return v;
+}
+
+/* what the app would have sent without the tile: a level map for every
+ * quad that the visible part of it touches */
+static size_t
+blit_request_cost(sosc_state_t *state, unsigned id, int x, int y)
+{
+	const struct sosc_tile *tile = &state->tiles.tile[id];
+	int x0, y0, x1, y1;
+
+	/* as in sosc_tile_blit(), so x + w can't overflow */
+	x = clamp_origin(x, SOSC_LED_COLS_MAX);
+	y = clamp_origin(y, SOSC_LED_ROWS_MAX);
+
+	x0 = (x < 0) ? 0 : x;
+	y0 = (y < 0) ? 0 : y;
+	x1 = x + (int) tile->w - 1;
+	y1 = y + (int) tile->h - 1;
+
+	if (x1 >= SOSC_LED_COLS_MAX)
+		x1 = SOSC_LED_COLS_MAX - 1;
+	if (y1 >= SOSC_LED_ROWS_MAX)
+		y1 = SOSC_LED_ROWS_MAX - 1;
+
+	if (x0 > x1 || y0 > y1)
+		return 0;
+
+	return ((x1 / SOSC_LED_QUAD_SIZE) - (x0 / SOSC_LED_QUAD_SIZE) + 1)
+		* ((y1 / SOSC_LED_QUAD_SIZE) - (y0 / SOSC_LED_QUAD_SIZE) + 1)
+		* SOSC_MEXT_LED_LEVEL_MAP_SIZE;
+}
+
+OSC_HANDLER_FUNC(led_tile_blit_handler)
+{
+	sosc_state_t *state = user_data;
+
+	if (sosc_tile_blit(state, argv[0]->i, argv[1]->i, argv[2]->i,
+	                   (argc > 3) ? argv[3]->i : 0) < 0)
+		return 1;
+
+	state->stats.led_tile_blits++;
+	state->stats.led_bytes_requested +=
+		blit_request_cost(state, argv[0]->i, argv[1]->i, argv[2]->i);
+
+	sosc_led_update(state);
+	return 0;
+}
+
+OSC_HANDLER_FUNC(led_tile_forget_handler)
+{
+	sosc_state_t *state = user_data;
+
+	if (argc)
+		sosc_tile_forget(state, argv[0]->i);
+	else
+		sosc_tile_forget_all(state);
+
+	return 0;
+}
+
+/*************************************************************************
+ * animations
+ *************************************************************************/
+
+/* every one of these starts with the animation's number and the rectangle
+ * it covers, id x y w h, and times are in milliseconds. see anim.c. */
+
+#define ANIM_USEC(ms) ((uint64_t) (ms) * 1000)
+
+OSC_HANDLER_FUNC(led_anim_fade_handler)
+{
+	sosc_state_t *state = user_data;
+
+	if (argv[7]->i < 0)
+		return 1;
+
+	return !!sosc_anim_fade(state, argv[0]->i, argv[1]->i, argv[2]->i,
+	                        argv[3]->i, argv[4]->i, clamp_level(argv[5]->i),
+	                        clamp_level(argv[6]->i), ANIM_USEC(argv[7]->i),
+	                        (argc > 8) ? argv[8]->i : 0);
+}
+
+OSC_HANDLER_FUNC(led_anim_blink_handler)
+{
+	sosc_state_t *state = user_data;
+
+	if (argv[7]->i < 0)
+		return 1;
+
+	return !!sosc_anim_blink(state, argv[0]->i, argv[1]->i, argv[2]->i,
+	                         argv[3]->i, argv[4]->i, clamp_level(argv[5]->i),
+	                         clamp_level(argv[6]->i), ANIM_USEC(argv[7]->i));
+}
+
+OSC_HANDLER_FUNC(led_anim_scroll_handler)
+{
+	sosc_state_t *state = user_data;
+
+	if (argv[7]->i < 0 || argv[8]->i <= 0)
+		return 1;
+
+	return !!sosc_anim_scroll(state, argv[0]->i, argv[1]->i, argv[2]->i,
+	                          argv[3]->i, argv[4]->i, argv[5]->i,
+	                          argv[6]->i, ANIM_USEC(argv[7]->i), argv[8]->i,
+	                          lo_blob_dataptr((lo_blob) argv[9]),
+	                          lo_blob_datasize((lo_blob) argv[9]));
+}
+
+OSC_HANDLER_FUNC(led_anim_frames_handler)
+{
+	sosc_state_t *state = user_data;
+
+	if (argv[5]->i < 0)
+		return 1;
+
+	return !!sosc_anim_frames(state, argv[0]->i, argv[1]->i, argv[2]->i,
+	                          argv[3]->i, argv[4]->i, ANIM_USEC(argv[5]->i),
+	                          lo_blob_dataptr((lo_blob) argv[6]),
+	                          lo_blob_datasize((lo_blob) argv[6]));
+}
+
+OSC_HANDLER_FUNC(led_anim_stop_handler)
+{
+	sosc_state_t *state = user_data;
+
+	if (argc)
+		sosc_anim_stop(state, argv[0]->i);
+	else
+		sosc_anim_stop_all(state);
+
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_ring_set_handler)
 {
-	monome_t *monome = user_data;
-	return monome_led_ring_set(monome, argv[0]->i, argv[1]->i, argv[2]->i);
+	sosc_state_t *state = user_data;
+
+	state->stats.led_bytes_requested += SOSC_MEXT_RING_SET_SIZE;
+
+	sosc_led_ring_set(state, argv[0]->i, argv[1]->i,
+	                  clamp_level(argv[2]->i));
+	sosc_led_update(state);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_ring_all_handler)
 {
-	monome_t *monome = user_data;
-	return monome_led_ring_all(monome, argv[0]->i, argv[1]->i);
+	sosc_state_t *state = user_data;
+
+	state->stats.led_bytes_requested += SOSC_MEXT_RING_ALL_SIZE;
+
+	sosc_led_ring_all(state, argv[0]->i, clamp_level(argv[1]->i));
+	sosc_led_update(state);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_ring_map_handler)
 {
-	monome_t *monome = user_data;
+	sosc_state_t *state = user_data;
 	uint8_t buf[64];
 	int i;
 
 	for (i = 0; i < 64; i++)
-		buf[i] = argv[i + (argc - 64)]->i;
+		buf[i] = clamp_level(argv[i + (argc - 64)]->i);
+
+	state->stats.led_bytes_requested += SOSC_MEXT_RING_MAP_SIZE;
+
+	sosc_led_ring_map(state, argv[0]->i, buf);
+	sosc_led_update(state);
+	return 0;
+}
+
+OSC_HANDLER_FUNC(led_ring_frame_handler)
+{
+	sosc_state_t *state = user_data;
+	int nrings;
+
+	nrings = sosc_led_ring_frame(state, lo_blob_dataptr((lo_blob) argv[0]),
+	                             lo_blob_datasize((lo_blob) argv[0]));
+	if (nrings < 0)
+		return 1;
 
-	return monome_led_ring_map(monome, argv[0]->i, buf);
+	state->stats.led_bytes_requested += nrings * SOSC_MEXT_RING_MAP_SIZE;
+
+	sosc_led_update(state);
+	return 0;
+}
+
+OSC_HANDLER_FUNC(led_ring_delta_handler)
+{
+	sosc_state_t *state = user_data;
+	int nchanged;
+
+	nchanged = sosc_led_ring_delta(state, lo_blob_dataptr((lo_blob) argv[0]),
+	                               lo_blob_datasize((lo_blob) argv[0]));
+	if (nchanged < 0)
+		return 1;
+
+	state->stats.led_bytes_requested += nchanged * SOSC_MEXT_RING_SET_SIZE;
+
+	sosc_led_update(state);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_ring_range_handler)
 {
-	monome_t *monome = user_data;
+	sosc_state_t *state = user_data;
+
+	state->stats.led_bytes_requested += SOSC_MEXT_RING_RANGE_SIZE;
 
-	return monome_led_ring_range(monome, argv[0]->i, argv[1]->i, argv[2]->i, argv[3]->i);
+	sosc_led_ring_range(state, argv[0]->i, argv[1]->i, argv[2]->i,
+	                    clamp_level(argv[3]->i));
+	sosc_led_update(state);
+	return 0;
 }
 
 OSC_HANDLER_FUNC(led_ring_intensity_handler)
 {
-	monome_t *monome = user_data;
-	return monome_led_ring_intensity(monome, argv[0]->i);
+	sosc_state_t *state = user_data;
+
+	sosc_led_ring_intensity(state, clamp_level(argv[0]->i));
+	return 0;
+}
+
+/* with a serial output queue, these have to go through it like the LED
+ * commands do, or they could land in the middle of a queued packet */
+static int
+tilt_enable(sosc_state_t *state, unsigned sensor, int on)
+{
+	if (!sosc_serial_out_active(state))
+		return on
+			? monome_tilt_enable(state->monome, sensor)
+			: monome_tilt_disable(state->monome, sensor);
+
+	return sosc_serial_out_tilt(state, sensor, on);
 }
 
 OSC_HANDLER_FUNC(tilt_set_handler)
 {
-	monome_t *monome = user_data;
+	sosc_state_t *state = user_data;
 
 	if (argv[1]->i)
-		return monome_tilt_enable(monome, argv[0]->i);
-	else
-		return monome_tilt_disable(monome, argv[0]->i);
+		osc_tilt_reset(state, argv[0]->i);
+
+	return tilt_enable(state, argv[0]->i, argv[1]->i);
+}
+
+/* see osc_send_tilt() */
+
+static int
+nonnegative(int v)
+{
+	return (v > 0) ? v : 0;
+}
+
+static int
+smoothing(int v)
+{
+	return (v > SOSC_TILT_SMOOTHING_MAX)
+		? SOSC_TILT_SMOOTHING_MAX : nonnegative(v);
+}
+
+/* each of these starts with the sensor number */
+
+OSC_HANDLER_FUNC(tilt_config_handler)
+{
+	sosc_state_t *state = user_data;
+	unsigned n = argv[0]->i;
+
+	if (n >= SOSC_OSC_TILT_MAX)
+		return 1;
+
+	state->config.tilt[n].rate = nonnegative(argv[1]->i);
+	state->config.tilt[n].deadband = nonnegative(argv[2]->i);
+	state->config.tilt[n].smoothing = smoothing(argv[3]->i);
+	return 0;
 }
 
-#define METHOD(path) for (cmd_buf = osc_path(path, prefix); cmd_buf; \
-                          s_free(cmd_buf), cmd_buf = NULL)
+OSC_HANDLER_FUNC(tilt_config_rate_handler)
+{
+	sosc_state_t *state = user_data;
+	unsigned n = argv[0]->i;
+
+	if (n >= SOSC_OSC_TILT_MAX)
+		return 1;
+
+	state->config.tilt[n].rate = nonnegative(argv[1]->i);
+	return 0;
+}
+
+OSC_HANDLER_FUNC(tilt_config_deadband_handler)
+{
+	sosc_state_t *state = user_data;
+	unsigned n = argv[0]->i;
+
+	if (n >= SOSC_OSC_TILT_MAX)
+		return 1;
+
+	state->config.tilt[n].deadband = nonnegative(argv[1]->i);
+	return 0;
+}
+
+OSC_HANDLER_FUNC(tilt_config_smoothing_handler)
+{
+	sosc_state_t *state = user_data;
+	unsigned n = argv[0]->i;
+
+	if (n >= SOSC_OSC_TILT_MAX)
+		return 1;
+
+	state->config.tilt[n].smoothing = smoothing(argv[1]->i);
+	return 0;
+}
 
 void
 osc_register_methods(sosc_state_t *state)
 {
-	char *prefix, *cmd_buf;
-	monome_t *monome;
-	lo_server srv;
-
-	prefix = state->config.app.osc_prefix;
-	monome = state->monome;
-	srv = state->server;
+	const char *cmd;
 
+#define METHOD(path) for (cmd = path; cmd; cmd = NULL)
 #define REGISTER(typetags, cb) \
-	lo_server_add_method(srv, cmd_buf, typetags, cb, monome)
+	osc_dispatch_add(&state->dispatch, cmd, typetags, cb, state)
 
 	METHOD("grid/led/set")
 		REGISTER("iii", led_set_handler);
@@ -244,6 +752,9 @@ osc_register_methods(sosc_state_t *state)
 	METHOD("grid/led/row")
 		REGISTER(NULL, led_row_handler);
 
+	METHOD("grid/led/frame")
+		REGISTER("b", led_frame_handler);
+
 	METHOD("grid/led/intensity")
 		REGISTER("i", led_intensity_handler);
 
@@ -265,6 +776,49 @@ osc_register_methods(sosc_state_t *state)
 		         "iiiiiiii",
 		         led_level_map_handler);
 
+	METHOD("grid/led/level/frame") {
+		REGISTER("b", led_level_frame_handler);
+		REGISTER("ib", led_level_frame_seq_handler);
+	}
+
+	METHOD("grid/led/level/delta")
+		REGISTER("ib", led_level_delta_handler);
+
+	METHOD("grid/led/commit")
+		REGISTER("", led_commit_handler);
+
+	METHOD("grid/led/tile/define")
+		REGISTER("iiib", led_tile_define_handler);
+
+	METHOD("grid/led/tile/blit") {
+		REGISTER("iii", led_tile_blit_handler);
+		REGISTER("iiii", led_tile_blit_handler);
+	}
+
+	METHOD("grid/led/tile/forget") {
+		REGISTER("i", led_tile_forget_handler);
+		REGISTER("", led_tile_forget_handler);
+	}
+
+	METHOD("grid/led/anim/fade") {
+		REGISTER("iiiiiiii", led_anim_fade_handler);
+		REGISTER("iiiiiiiii", led_anim_fade_handler);
+	}
+
+	METHOD("grid/led/anim/blink")
+		REGISTER("iiiiiiii", led_anim_blink_handler);
+
+	METHOD("grid/led/anim/scroll")
+		REGISTER("iiiiiiiiib", led_anim_scroll_handler);
+
+	METHOD("grid/led/anim/frames")
+		REGISTER("iiiiiib", led_anim_frames_handler);
+
+	METHOD("grid/led/anim/stop") {
+		REGISTER("i", led_anim_stop_handler);
+		REGISTER("", led_anim_stop_handler);
+	}
+
 	METHOD("grid/led/level/col")
 		REGISTER(NULL, led_level_col_handler);
 
@@ -292,92 +846,33 @@ osc_register_methods(sosc_state_t *state)
 	METHOD("ring/range")
 		REGISTER("iiii", led_ring_range_handler);
 
+	METHOD("ring/frame")
+		REGISTER("b", led_ring_frame_handler);
+
+	METHOD("ring/delta")
+		REGISTER("b", led_ring_delta_handler);
+
+	METHOD("ring/commit")
+		REGISTER("", led_commit_handler);
+
 	METHOD("ring/intensity")
 		REGISTER("i", led_ring_intensity_handler);
 
 	METHOD("tilt/set")
 		REGISTER("ii", tilt_set_handler);
 
-#undef REGISTER
-}
-
-void
-osc_unregister_methods(sosc_state_t *state)
-{
-	char *prefix, *cmd_buf;
-	lo_server srv;
-
-	prefix = state->config.app.osc_prefix;
-	srv = state->server;
-
-#define UNREGISTER(typetags) \
-	lo_server_del_method(srv, cmd_buf, typetags)
-
-	METHOD("grid/led/set")
-		UNREGISTER("iii");
-
-	METHOD("grid/led/all")
-		UNREGISTER("i");
-
-	METHOD("grid/led/map")
-		UNREGISTER("iiiiiiiiii");
-
-	METHOD("grid/led/col")
-		UNREGISTER(NULL);
-
-	METHOD("grid/led/row")
-		UNREGISTER(NULL);
-
-	METHOD("grid/led/intensity")
-		UNREGISTER("i");
-
-	METHOD("grid/led/level/set")
-		UNREGISTER("iii");
-
-	METHOD("grid/led/level/all")
-		UNREGISTER("i");
-
-	METHOD("grid/led/level/map")
-		UNREGISTER("ii"
-		           "iiiiiiii"
-		           "iiiiiiii"
-		           "iiiiiiii"
-		           "iiiiiiii"
-		           "iiiiiiii"
-		           "iiiiiiii"
-		           "iiiiiiii"
-		           "iiiiiiii");
-
-	METHOD("grid/led/level/col")
-		UNREGISTER(NULL);
-
-	METHOD("grid/led/level/row")
-		UNREGISTER(NULL);
-
-	METHOD("ring/set")
-		UNREGISTER("iii");
+	METHOD("tilt/config")
+		REGISTER("iiii", tilt_config_handler);
 
-	METHOD("ring/all")
-		UNREGISTER("ii");
+	METHOD("tilt/config/rate")
+		REGISTER("ii", tilt_config_rate_handler);
 
-	METHOD("ring/map")
-		UNREGISTER("i"
-		           "iiiiiiii"
-		           "iiiiiiii"
-		           "iiiiiiii"
-		           "iiiiiiii"
-		           "iiiiiiii"
-		           "iiiiiiii"
-		           "iiiiiiii"
-		           "iiiiiiii");
+	METHOD("tilt/config/deadband")
+		REGISTER("ii", tilt_config_deadband_handler);
 
-	METHOD("ring/range")
-		UNREGISTER("iiii");
-
-	METHOD("tilt/set")
-		UNREGISTER("ii");
-
-#undef UNREGISTER
-}
+	METHOD("tilt/config/smoothing")
+		REGISTER("ii", tilt_config_smoothing_handler);
 
+#undef REGISTER
 #undef METHOD
+}
@@ -0,0 +1,785 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#endif
+
+#include <lo/lo.h>
+#include <monome.h>
+
+#include <serialosc/serialosc.h>
+#include <serialosc/platform.h>
+#include <serialosc/dgram.h>
+#include <serialosc/osc.h>
+
+/* every key press, encoder turn and tilt sample used to go through
+ * osc_path() and lo_send_from(), which is an asprintf(), a full lo_message
+ * build and a handful of frees per event. instead, we keep one encoded
+ * datagram per event type around, rebuild them when the prefix changes,
+ * and just patch the int32 arguments in before handing it to sendto(). */
+
+static const struct {
+	const char *path;
+	const char *types;
+} event_defs[SOSC_OSC_EVENT_MAX] = {
+	[SOSC_OSC_GRID_KEY]  = {"grid/key",  "iii"},
+	[SOSC_OSC_ENC_DELTA] = {"enc/delta", "ii"},
+	[SOSC_OSC_ENC_KEY]   = {"enc/key",   "ii"},
+	[SOSC_OSC_TILT]      = {"tilt",      "iiii"}
+};
+
+/* OSC strings are null-terminated and padded out to 4 bytes */
+static size_t
+osc_strsize(size_t len)
+{
+	return (len + 4) & ~3;
+}
+
+static void
+build_template(sosc_osc_template_t *t, const char *prefix,
+               const char *path, const char *types)
+{
+	size_t prefix_len, path_len, types_len, addr_size, types_size;
+
+	prefix_len = strlen(prefix);
+	path_len   = strlen(path);
+	types_len  = strlen(types);
+
+	addr_size  = osc_strsize(prefix_len + 1 + path_len);
+	types_size = osc_strsize(1 + types_len);
+
+	memset(t, 0, sizeof(*t));
+
+	if (addr_size + types_size + (types_len * 4) > sizeof(t->buf))
+		return;
+
+	memcpy(t->buf, prefix, prefix_len);
+	t->buf[prefix_len] = '/';
+	memcpy(t->buf + prefix_len + 1, path, path_len);
+
+	t->buf[addr_size] = ',';
+	memcpy(t->buf + addr_size + 1, types, types_len);
+
+	t->args_offset = addr_size + types_size;
+	t->nbytes = t->args_offset + (types_len * 4);
+}
+
+static void
+build_templates(sosc_osc_template_t *templates, const char *prefix)
+{
+	int i;
+
+	for (i = 0; i < SOSC_OSC_EVENT_MAX; i++)
+		build_template(&templates[i], prefix,
+		               event_defs[i].path, event_defs[i].types);
+}
+
+void
+osc_outgoing_build_templates(sosc_state_t *state)
+{
+	build_templates(state->out.templates, state->config.app.osc_prefix);
+}
+
+/* only called when a destination is set (at startup, by /sys/host,
+ * /sys/port and /sys/subscribe), never per event. a name that has to go
+ * out to DNS holds up the event loop once, as liblo's own lookup for
+ * /sys/host does, and events go straight to the sockaddr after that. */
+static socklen_t
+resolve(sosc_state_t *state, lo_address addr, struct sockaddr_storage *sa)
+{
+	struct addrinfo hints, *res;
+	struct sockaddr_storage local;
+	socklen_t local_len, salen = 0;
+	const char *host;
+	int fd, err;
+
+	fd = lo_server_get_socket_fd(state->server);
+	local_len = sizeof(local);
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_NUMERICSERV;
+
+	/* match whatever address family liblo bound the server socket to,
+	 * otherwise sendto() will refuse the address. */
+	if (!getsockname(fd, (struct sockaddr *) &local, &local_len))
+		hints.ai_family = local.ss_family;
+
+	/* hosts files don't always list localhost for both families */
+	host = lo_address_get_hostname(addr);
+	if (!strcmp(host, "localhost"))
+		host = (hints.ai_family == AF_INET6) ? "::1" : "127.0.0.1";
+
+	if ((err = getaddrinfo(host, lo_address_get_port(addr), &hints, &res))) {
+		fprintf(stderr, "serialosc: couldn't resolve %s:%s: %s\n",
+		        host, lo_address_get_port(addr), gai_strerror(err));
+		return 0;
+	}
+
+	if (res->ai_addrlen <= sizeof(*sa)) {
+		memcpy(sa, res->ai_addr, res->ai_addrlen);
+		salen = res->ai_addrlen;
+	}
+
+	freeaddrinfo(res);
+	return salen;
+}
+
+int
+osc_outgoing_resolve(sosc_state_t *state)
+{
+	state->out.addrlen = resolve(state, state->outgoing, &state->out.addr);
+	return !state->out.addrlen;
+}
+
+static void
+send_event_alloc(sosc_state_t *state, lo_address to, const char *prefix,
+                 sosc_osc_event_t ev, const int32_t *args)
+{
+	lo_server server = osc_reply_server(state, to);
+	char *cmd;
+
+	cmd = osc_path(event_defs[ev].path, prefix);
+
+	switch (strlen(event_defs[ev].types)) {
+	case 2:
+		lo_send_from(to, server, LO_TT_IMMEDIATE, cmd,
+		             event_defs[ev].types, args[0], args[1]);
+		break;
+
+	case 3:
+		lo_send_from(to, server, LO_TT_IMMEDIATE, cmd,
+		             event_defs[ev].types, args[0], args[1], args[2]);
+		break;
+
+	case 4:
+		lo_send_from(to, server, LO_TT_IMMEDIATE, cmd,
+		             event_defs[ev].types, args[0], args[1], args[2], args[3]);
+		break;
+	}
+
+	s_free(cmd);
+	state->stats.osc_events_allocated++;
+}
+
+/* liblo's socket can only reach UDP destinations, so anything for a unix
+ * socket subscriber is sent from ours. those go first: whoever asked for
+ * a unix socket is on this machine and after the lowest latency. */
+static unsigned int
+send_all(sosc_state_t *state, struct sosc_dgram_out *out, unsigned int n)
+{
+	unsigned int sent = 0;
+
+#ifndef WIN32
+	struct sosc_dgram_out local[1 + SOSC_OSC_SUBSCRIBERS_MAX];
+	unsigned int i, nlocal = 0, nudp = 0;
+
+	for (i = 0; i < n; i++) {
+		if (out[i].to->sa_family == AF_UNIX)
+			local[nlocal++] = out[i];
+		else
+			out[nudp++] = out[i];
+	}
+
+	if (nlocal)
+		sent = sosc_dgram_send(state->unix_sock.fd, local, nlocal);
+
+	n = nudp;
+#endif
+
+	if (n)
+		sent += sosc_dgram_send(lo_server_get_socket_fd(state->server),
+		                        out, n);
+
+	return sent;
+}
+
+/* one datagram to state->outgoing, and the same one to every subscriber
+ * that shares its prefix, all in one go */
+static void
+send_datagram(sosc_state_t *state, const uint8_t *buf, size_t nbytes)
+{
+	struct sosc_dgram_out out[1 + SOSC_OSC_SUBSCRIBERS_MAX];
+	sosc_osc_subscriber_t *sub;
+	unsigned int i, n = 0, app = 0, sent;
+
+	if (state->out.addrlen) {
+		out[n++] = (struct sosc_dgram_out) {
+			buf, nbytes,
+			(struct sockaddr *) &state->out.addr, state->out.addrlen
+		};
+
+		app = 1;
+	}
+
+	for (i = 0; i < state->out.nsubscribers; i++) {
+		sub = &state->out.subscribers[i];
+
+		if (sub->prefix || !sub->salen)
+			continue;
+
+		out[n++] = (struct sosc_dgram_out) {
+			buf, nbytes, (struct sockaddr *) &sub->sa, sub->salen
+		};
+	}
+
+	/* the count doesn't say which ones failed. if any did, assume the
+	 * app's went, so that this never overcounts. */
+	sent = send_all(state, out, n);
+	if (sent > app)
+		state->stats.osc_fanout_datagrams += sent - app;
+}
+
+/*************************************************************************
+ * bundling
+ *************************************************************************/
+
+/* when bundling is on, everything the event loop drains from the serial
+ * port in one go is sent as a single bundle. every message is wrapped in
+ * its own nested bundle so that its timetag says when that particular
+ * event was read, and the outer bundle carries the time of the first. */
+
+#define BUNDLE_HEADER_SIZE   16 /* "#bundle\0" + timetag */
+#define BUNDLE_ELEMENT_SIZE(msg_nbytes) \
+	(4 + BUNDLE_HEADER_SIZE + 4 + (msg_nbytes))
+
+static size_t
+emit_bundle_header(uint8_t *buf, lo_timetag tt)
+{
+	uint32_t sec, frac;
+
+	sec  = htonl(tt.sec);
+	frac = htonl(tt.frac);
+
+	memcpy(buf, "#bundle", 8);
+	memcpy(buf + 8, &sec, 4);
+	memcpy(buf + 12, &frac, 4);
+
+	return BUNDLE_HEADER_SIZE;
+}
+
+static size_t
+emit_int32(uint8_t *buf, int32_t v)
+{
+	uint32_t n = htonl((uint32_t) v);
+	memcpy(buf, &n, 4);
+	return 4;
+}
+
+static void
+bundle_flush(sosc_state_t *state)
+{
+	if (!state->out.bundle.nmsgs)
+		return;
+
+	send_datagram(state, state->out.bundle.buf, state->out.bundle.nbytes);
+
+	state->stats.osc_bundles_sent++;
+	state->stats.osc_datagrams_saved += state->out.bundle.nmsgs - 1;
+
+	state->out.bundle.nmsgs = 0;
+	state->out.bundle.nbytes = 0;
+}
+
+static void
+bundle_append(sosc_state_t *state, const uint8_t *msg, size_t msg_nbytes)
+{
+	uint8_t *buf;
+	lo_timetag tt;
+
+	if (state->out.bundle.nbytes + BUNDLE_ELEMENT_SIZE(msg_nbytes)
+	    > sizeof(state->out.bundle.buf))
+		bundle_flush(state);
+
+	lo_timetag_now(&tt);
+
+	buf = state->out.bundle.buf;
+
+	if (!state->out.bundle.nmsgs)
+		state->out.bundle.nbytes = emit_bundle_header(buf, tt);
+
+	buf += state->out.bundle.nbytes;
+
+	buf += emit_int32(buf, BUNDLE_HEADER_SIZE + 4 + msg_nbytes);
+	buf += emit_bundle_header(buf, tt);
+	buf += emit_int32(buf, msg_nbytes);
+	memcpy(buf, msg, msg_nbytes);
+
+	state->out.bundle.nbytes += BUNDLE_ELEMENT_SIZE(msg_nbytes);
+	state->out.bundle.nmsgs++;
+}
+
+void
+osc_bundle_begin(sosc_state_t *state)
+{
+	if (!state->config.app.bundle_events || !state->out.addrlen)
+		return;
+
+	state->out.bundle.open = 1;
+	state->out.bundle.nmsgs = 0;
+	state->out.bundle.nbytes = 0;
+}
+
+void
+osc_bundle_end(sosc_state_t *state)
+{
+	if (!state->out.bundle.open)
+		return;
+
+	bundle_flush(state);
+	state->out.bundle.open = 0;
+}
+
+/*************************************************************************
+ * events
+ *************************************************************************/
+
+static void
+patch_args(sosc_osc_template_t *t, const int32_t *args)
+{
+	size_t i, nargs;
+
+	nargs = (t->nbytes - t->args_offset) / 4;
+
+	for (i = 0; i < nargs; i++)
+		emit_int32(t->buf + t->args_offset + (i * 4), args[i]);
+}
+
+/* subscribers with a prefix of their own get their own datagrams, and
+ * aren't bundled */
+static void
+send_event_prefixed(sosc_state_t *state, sosc_osc_event_t ev,
+                    const int32_t *args)
+{
+	struct sosc_dgram_out out[SOSC_OSC_SUBSCRIBERS_MAX];
+	sosc_osc_subscriber_t *sub;
+	sosc_osc_template_t *t;
+	unsigned int i, n = 0;
+
+	for (i = 0; i < state->out.nsubscribers; i++) {
+		sub = &state->out.subscribers[i];
+		t = &sub->templates[ev];
+
+		if (!sub->prefix)
+			continue;
+
+		if (!t->nbytes || !sub->salen) {
+			send_event_alloc(state, sub->addr, sub->prefix, ev, args);
+			continue;
+		}
+
+		patch_args(t, args);
+		out[n++] = (struct sosc_dgram_out) {
+			t->buf, t->nbytes, (struct sockaddr *) &sub->sa, sub->salen
+		};
+	}
+
+	if (!n)
+		return;
+
+	state->stats.osc_fanout_datagrams += send_all(state, out, n);
+}
+
+void
+osc_send_event(sosc_state_t *state, sosc_osc_event_t ev, const int32_t *args)
+{
+	sosc_osc_template_t *t = &state->out.templates[ev];
+	sosc_osc_subscriber_t *sub;
+	unsigned int i;
+
+	if (state->out.nsubscribers)
+		send_event_prefixed(state, ev, args);
+
+	/* prefix too long for the template, or we couldn't resolve the
+	 * destination. take the slow path, it still works. */
+	if (!t->nbytes || !state->out.addrlen) {
+		send_event_alloc(state, state->outgoing,
+		                 state->config.app.osc_prefix, ev, args);
+
+		for (i = 0; i < state->out.nsubscribers; i++) {
+			sub = &state->out.subscribers[i];
+
+			if (!sub->prefix)
+				send_event_alloc(state, sub->addr,
+				                 state->config.app.osc_prefix, ev, args);
+		}
+
+		return;
+	}
+
+	patch_args(t, args);
+
+	if (state->out.bundle.open)
+		bundle_append(state, t->buf, t->nbytes);
+	else
+		send_datagram(state, t->buf, t->nbytes);
+
+	state->stats.osc_events_prebuilt++;
+}
+
+/*************************************************************************
+ * encoder deltas
+ *************************************************************************/
+
+/* an arc reports every step of every knob on its own, which for a quick
+ * turn is hundreds of messages a second. with config.dev.enc_window set,
+ * each encoder sends at most one /enc/delta a window, carrying the sum of
+ * everything since the last one. as with the LED flush clock, a knob
+ * that's been still for a whole window sends straight away. */
+
+static uint64_t
+enc_window_usec(sosc_state_t *state)
+{
+#ifdef WIN32
+	/* events are sent from the serial thread on windows, and the
+	 * scheduler that would send what we held back runs on the OSC one */
+	return 0;
+#else
+	return (uint64_t) state->config.dev.enc_window * 1000;
+#endif
+}
+
+static void
+enc_send(sosc_state_t *state, unsigned n, uint64_t now)
+{
+	int32_t args[] = {n, state->out.enc.pending[n]};
+
+	state->out.enc.pending[n] = 0;
+	state->out.enc.last_sent[n] = now;
+
+	osc_send_event(state, SOSC_OSC_ENC_DELTA, args);
+	state->stats.enc_deltas_sent++;
+}
+
+static void
+enc_schedule(sosc_state_t *state)
+{
+	uint64_t deadline, window = enc_window_usec(state);
+	unsigned n;
+
+	state->out.enc.deadline = 0;
+
+	for (n = 0; n < SOSC_OSC_ENC_MAX; n++) {
+		if (!state->out.enc.pending[n])
+			continue;
+
+		deadline = state->out.enc.last_sent[n] + window;
+
+		if (!state->out.enc.deadline || deadline < state->out.enc.deadline)
+			state->out.enc.deadline = deadline;
+	}
+}
+
+void
+osc_send_enc_delta(sosc_state_t *state, unsigned n, int32_t delta)
+{
+	int32_t args[] = {n, delta};
+	uint64_t now, window;
+
+	state->stats.enc_deltas_received++;
+
+	if (!(window = enc_window_usec(state)) || n >= SOSC_OSC_ENC_MAX) {
+		osc_send_event(state, SOSC_OSC_ENC_DELTA, args);
+		state->stats.enc_deltas_sent++;
+		return;
+	}
+
+	now = sosc_now_usec();
+	state->out.enc.pending[n] += delta;
+
+	/* deltas that cancel out within a window aren't sent at all */
+	if (state->out.enc.pending[n]
+	    && now - state->out.enc.last_sent[n] >= window)
+		enc_send(state, n, now);
+
+	enc_schedule(state);
+}
+
+/* before an /enc/key, so that it doesn't overtake the turn before it */
+void
+osc_enc_flush(sosc_state_t *state, unsigned n)
+{
+	if (n >= SOSC_OSC_ENC_MAX || !state->out.enc.pending[n])
+		return;
+
+	enc_send(state, n, sosc_now_usec());
+	enc_schedule(state);
+}
+
+uint64_t
+osc_enc_next(sosc_state_t *state)
+{
+	return state->out.enc.deadline;
+}
+
+void
+osc_enc_run(sosc_state_t *state, uint64_t now)
+{
+	uint64_t window = enc_window_usec(state);
+	unsigned n;
+
+	if (!state->out.enc.deadline || state->out.enc.deadline > now)
+		return;
+
+	for (n = 0; n < SOSC_OSC_ENC_MAX; n++)
+		if (state->out.enc.pending[n]
+		    && state->out.enc.last_sent[n] + window <= now)
+			enc_send(state, n, now);
+
+	enc_schedule(state);
+}
+
+/*************************************************************************
+ * tilt
+ *************************************************************************/
+
+/* once enabled, a tilt sensor streams samples whether or not anything is
+ * moving. config.tilt[n] thins that out for sensor n: samples are run
+ * through a low-pass filter (an exponential moving average, where each
+ * sample moves the filtered position 1/2^smoothing of the way towards
+ * it), and the result is only sent once an axis has moved further than
+ * the deadband since the last one we sent, and then no more than rate
+ * times a second. the sensor keeps on sampling, so the resting position
+ * still gets out once the rate limit allows. with everything at 0, every
+ * sample is passed straight through. */
+
+static int32_t
+unfix(int32_t v)
+{
+	return (v >= 0) ? (v + 128) / 256 : -((-v + 128) / 256);
+}
+
+void
+osc_send_tilt(sosc_state_t *state, unsigned n, int32_t x, int32_t y,
+              int32_t z)
+{
+	int32_t args[] = {n, x, y, z};
+	const int32_t raw[] = {x, y, z};
+	struct sosc_osc_tilt *tilt;
+	uint64_t now;
+	int i, rate, deadband, smoothing, moved = 0;
+
+	state->stats.tilt_samples_received++;
+
+	if (n >= SOSC_OSC_TILT_MAX)
+		goto send;
+
+	rate = state->config.tilt[n].rate;
+	deadband = state->config.tilt[n].deadband;
+	smoothing = state->config.tilt[n].smoothing;
+
+	if (!rate && !deadband && !smoothing)
+		goto send;
+
+	tilt = &state->out.tilt[n];
+	now = sosc_now_usec();
+
+	for (i = 0; i < 3; i++) {
+		if (!tilt->primed)
+			tilt->filtered[i] = raw[i] * 256;
+		else
+			tilt->filtered[i] +=
+				(raw[i] * 256 - tilt->filtered[i]) / (1 << smoothing);
+
+		args[i + 1] = unfix(tilt->filtered[i]);
+
+		if (abs(args[i + 1] - tilt->sent[i]) > deadband)
+			moved = 1;
+	}
+
+	if (tilt->primed
+	    && (!moved || (rate && now - tilt->last_sent < 1000000 / rate)))
+		return;
+
+	memcpy(tilt->sent, &args[1], sizeof(tilt->sent));
+	tilt->last_sent = now;
+	tilt->primed = 1;
+
+send:
+	osc_send_event(state, SOSC_OSC_TILT, args);
+	state->stats.tilt_samples_sent++;
+}
+
+/* when a sensor is turned on, so that it doesn't start out filtered
+ * towards wherever it was last time */
+void
+osc_tilt_reset(sosc_state_t *state, unsigned n)
+{
+	if (n < SOSC_OSC_TILT_MAX)
+		memset(&state->out.tilt[n], 0, sizeof(state->out.tilt[n]));
+}
+
+/*************************************************************************
+ * subscribers
+ *************************************************************************/
+
+/* everything sent to state->outgoing goes to these as well, rather than
+ * through a separate router process. subscribers without a prefix of
+ * their own follow /sys/prefix and get exactly the same datagrams (or
+ * bundles) as the app, from the same buffer and in the same
+ * sosc_dgram_send() (one per socket, if some are unix sockets). */
+
+static sosc_osc_subscriber_t *
+find_subscriber(sosc_state_t *state, const char *host, const char *port)
+{
+	sosc_osc_subscriber_t *sub;
+	unsigned int i;
+
+	for (i = 0; i < state->out.nsubscribers; i++) {
+		sub = &state->out.subscribers[i];
+
+		if (!port) {
+			if (sub->path && !strcmp(sub->path, host))
+				return sub;
+		} else if (!sub->path
+		           && !strcmp(lo_address_get_hostname(sub->addr), host)
+		           && !strcmp(lo_address_get_port(sub->addr), port))
+			return sub;
+	}
+
+	return NULL;
+}
+
+static void
+release_subscriber(sosc_osc_subscriber_t *sub)
+{
+	lo_address_free(sub->addr);
+	s_free(sub->path);
+	s_free(sub->prefix);
+}
+
+static int
+init_subscriber(sosc_state_t *state, sosc_osc_subscriber_t *sub,
+                const char *host, const char *port)
+{
+	memset(sub, 0, sizeof(*sub));
+
+	if (port) {
+		if (!(sub->addr = lo_address_new(host, port)))
+			goto err_addr;
+
+		if (!(sub->salen = resolve(state, sub->addr, &sub->sa))) {
+			lo_address_free(sub->addr);
+			return -1;
+		}
+
+		return 0;
+	}
+
+#ifdef WIN32
+	return -1;
+#else
+	if (state->unix_sock.fd < 0) {
+		fprintf(stderr, "osc_subscribe(): can't send to %s without a unix "
+		        "socket of our own\n", host);
+		return -1;
+	}
+
+	if (!(sub->salen = sosc_dgram_unix_addr(&sub->sa, host))) {
+		fprintf(stderr, "osc_subscribe(): %s is too long\n", host);
+		return -1;
+	}
+
+	if (!(sub->addr = lo_address_new_with_proto(LO_UNIX, NULL, host)))
+		goto err_addr;
+
+	if (!(sub->path = s_strdup(host))) {
+		lo_address_free(sub->addr);
+		return -1;
+	}
+
+	return 0;
+#endif
+
+err_addr:
+	fprintf(stderr, "osc_subscribe(): error in lo_address_new()\n");
+	return -1;
+}
+
+int
+osc_subscribe(sosc_state_t *state, const char *host, const char *port,
+              const char *prefix)
+{
+	sosc_osc_subscriber_t *sub;
+	char *p = NULL;
+
+	if (!(sub = find_subscriber(state, host, port))
+	    && state->out.nsubscribers >= SOSC_OSC_SUBSCRIBERS_MAX)
+		return -1;
+
+	if (prefix && *prefix) {
+		p = (*prefix != '/') ? s_asprintf("/%s", prefix) : s_strdup(prefix);
+		if (!p)
+			return -1;
+	}
+
+	/* subscribing again just changes the prefix */
+	if (sub) {
+		s_free(sub->prefix);
+		sub->prefix = p;
+	} else {
+		sub = &state->out.subscribers[state->out.nsubscribers];
+
+		if (init_subscriber(state, sub, host, port)) {
+			s_free(p);
+			return -1;
+		}
+
+		sub->prefix = p;
+		state->out.nsubscribers++;
+	}
+
+	if (sub->prefix)
+		build_templates(sub->templates, sub->prefix);
+
+	return 0;
+}
+
+int
+osc_unsubscribe(sosc_state_t *state, const char *host, const char *port)
+{
+	sosc_osc_subscriber_t *sub, *last;
+
+	if (!(sub = find_subscriber(state, host, port)))
+		return -1;
+
+	release_subscriber(sub);
+
+	last = &state->out.subscribers[--state->out.nsubscribers];
+	if (sub != last)
+		memcpy(sub, last, sizeof(*sub));
+
+	return 0;
+}
+
+void
+osc_unsubscribe_all(sosc_state_t *state)
+{
+	unsigned int i;
+
+	for (i = 0; i < state->out.nsubscribers; i++)
+		release_subscriber(&state->out.subscribers[i]);
+
+	state->out.nsubscribers = 0;
+}
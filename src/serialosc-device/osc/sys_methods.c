@@ -14,8 +14,10 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <lo/lo.h>
 #include <monome.h>
@@ -39,22 +41,29 @@ portstr(char *dest, int src)
 
 typedef void (info_reply_func_t)(lo_address *, sosc_state_t *);
 
+/* replies go to a host and port, our host and the given port, or a unix
+ * socket path */
 static int
-info_prop_handler(lo_arg **argv, int argc, void *user_data,
-                              info_reply_func_t cb) {
+info_prop_handler(const char *types, lo_arg **argv, int argc,
+                  void *user_data, info_reply_func_t cb) {
 	sosc_state_t *state = user_data;
 	const char *host = NULL;
 	char port[6];
 	lo_address *dst;
 
-	if (argc == 2)
-		host = &argv[0]->s;
-	else
-		host = lo_address_get_hostname(state->outgoing);
+	if (argc == 1 && types[0] == 's') {
+		dst = lo_address_new_with_proto(LO_UNIX, NULL, &argv[0]->s);
+	} else {
+		if (argc == 2)
+			host = &argv[0]->s;
+		else
+			host = lo_address_get_hostname(state->outgoing);
 
-	portstr(port, argv[argc - 1]->i);
+		portstr(port, argv[argc - 1]->i);
+		dst = lo_address_new(host, port);
+	}
 
-	if (!(dst = lo_address_new(host, port))) {
+	if (!dst) {
 		fprintf(stderr, "sys_info_handler(): error in lo_address_new()");
 		return 1;
 	}
@@ -75,13 +84,14 @@ info_prop_handler_default(void *user_data, info_reply_func_t cb)
 
 #define DECLARE_INFO_REPLY_FUNC(prop, typetag, ...)\
 	static void info_reply_##prop(lo_address *to, sosc_state_t *state) {\
-		lo_send_from(to, state->server, LO_TT_IMMEDIATE, "/sys/" #prop,\
-					 typetag, __VA_ARGS__);\
+		lo_send_from(to, osc_reply_server(state, to), LO_TT_IMMEDIATE,\
+					 "/sys/" #prop, typetag, __VA_ARGS__);\
 	}
 
 #define DECLARE_INFO_HANDLERS(prop)\
 	OSC_HANDLER_FUNC(sys_info_##prop##_handler) {\
-		return info_prop_handler(argv, argc, user_data, info_reply_##prop);\
+		return info_prop_handler(types, argv, argc, user_data,\
+		                         info_reply_##prop);\
 	}\
 	OSC_HANDLER_FUNC(sys_info_##prop##_handler_default) {\
 		return info_prop_handler_default(user_data, info_reply_##prop);\
@@ -98,18 +108,40 @@ DECLARE_INFO_PROP(host, "s", lo_address_get_hostname(state->outgoing))
 DECLARE_INFO_PROP(port, "i", atoi(lo_address_get_port(state->outgoing)))
 DECLARE_INFO_PROP(prefix, "s", state->config.app.osc_prefix)
 
+/* whether LED output is backed up right now, or -1 if this device will
+ * never say: congestion is only seen by the serial output queue, and
+ * devices that don't use it (anything but mext, and everything on
+ * windows) write through libmonome, which blocks instead. */
+DECLARE_INFO_PROP(congestion, "i", sosc_serial_out_active(state)
+                  ? state->serial_out.congested : -1)
+
 static void
 info_reply_rotation(lo_address *to, sosc_state_t *state)
 {
+	lo_server from = osc_reply_server(state, to);
+
 	if (monome_get_cols(state->monome) != monome_get_rows(state->monome))
 		info_reply_size(to, state);
 
-	lo_send_from(to, state->server, LO_TT_IMMEDIATE, "/sys/rotation", "i",
+	lo_send_from(to, from, LO_TT_IMMEDIATE, "/sys/rotation", "i",
 	             monome_get_rotation(state->monome) * 90);
 }
 
 DECLARE_INFO_HANDLERS(rotation);
 
+/* part of /sys/info if there's a unix socket. there's no /sys/info/unix
+ * of its own: "unix" is a predefined macro on most unices, and
+ * DECLARE_INFO_PROP() would expand it. */
+static void
+info_reply_unix_path(lo_address *to, sosc_state_t *state)
+{
+	if (!state->unix_sock.path)
+		return;
+
+	lo_send_from(to, osc_reply_server(state, to), LO_TT_IMMEDIATE,
+	             "/sys/unix", "s", state->unix_sock.path);
+}
+
 static void
 info_reply_all(lo_address *to, sosc_state_t *state)
 {
@@ -119,11 +151,13 @@ info_reply_all(lo_address *to, sosc_state_t *state)
 	info_reply_port(to, state);
 	info_reply_prefix(to, state);
 	info_reply_rotation(to, state);
+	info_reply_congestion(to, state);
+	info_reply_unix_path(to, state);
 }
 
 OSC_HANDLER_FUNC(sys_info_handler)
 {
-	return info_prop_handler(argv, argc, user_data, info_reply_all);
+	return info_prop_handler(types, argv, argc, user_data, info_reply_all);
 }
 
 OSC_HANDLER_FUNC(sys_info_handler_default)
@@ -131,6 +165,122 @@ OSC_HANDLER_FUNC(sys_info_handler_default)
 	return info_prop_handler_default(user_data, info_reply_all);
 }
 
+/*************************************************************************
+ * /sys/stats
+ *************************************************************************/
+
+#define STAT(name) {#name, offsetof(struct sosc_stats, name)}
+
+static const struct {
+	const char *name;
+	size_t offset;
+} stats_counters[] = {
+	STAT(osc_events_prebuilt),
+	STAT(osc_events_allocated),
+	STAT(osc_bundles_sent),
+	STAT(osc_datagrams_saved),
+	STAT(osc_fanout_datagrams),
+	STAT(enc_deltas_received),
+	STAT(enc_deltas_sent),
+	STAT(tilt_samples_received),
+	STAT(tilt_samples_sent),
+	STAT(led_bytes_requested),
+	STAT(led_bytes_written),
+	STAT(led_transactions),
+	STAT(osc_datagrams_received),
+	STAT(osc_datagrams_dropped),
+	STAT(osc_messages_unhandled),
+	STAT(osc_fastpath_hits),
+	STAT(osc_bundles_scheduled),
+	STAT(osc_bundles_late),
+	STAT(osc_bundles_overflowed),
+	STAT(serial_out_bytes),
+	STAT(serial_out_writes),
+	STAT(serial_out_full),
+	STAT(serial_out_write_usec),
+	STAT(serial_out_write_usec_max),
+	STAT(serial_out_queued),
+	STAT(serial_out_queued_max),
+	STAT(serial_out_bytes_dropped),
+	STAT(serial_out_congestion_events),
+	STAT(serial_out_commands_deferred),
+	STAT(led_flushes_deferred),
+	STAT(led_deltas_applied),
+	STAT(led_deltas_lost),
+	STAT(led_deltas_stale),
+	STAT(led_resync_requests),
+	STAT(led_commits),
+	STAT(led_echoes),
+	STAT(led_anim_steps),
+	STAT(led_tile_blits),
+
+	/* datagrams read per wakeup */
+	{"osc_recv_batch_1",     offsetof(struct sosc_stats, osc_recv_batches[0])},
+	{"osc_recv_batch_2_3",   offsetof(struct sosc_stats, osc_recv_batches[1])},
+	{"osc_recv_batch_4_7",   offsetof(struct sosc_stats, osc_recv_batches[2])},
+	{"osc_recv_batch_8_15",  offsetof(struct sosc_stats, osc_recv_batches[3])},
+	{"osc_recv_batch_16_31", offsetof(struct sosc_stats, osc_recv_batches[4])},
+	{"osc_recv_batch_32_63", offsetof(struct sosc_stats, osc_recv_batches[5])},
+	{"osc_recv_batch_64",    offsetof(struct sosc_stats, osc_recv_batches[6])}
+};
+
+#undef STAT
+
+/* one /sys/stats/latency per path: name, count, then p50, p99, p99.9 and
+ * max in microseconds */
+static void
+info_reply_latency(lo_address *to, sosc_state_t *state)
+{
+	lo_server from = osc_reply_server(state, to);
+	struct sosc_latency_summary s;
+	int i;
+
+	for (i = 0; i < SOSC_LATENCY_MAX; i++) {
+		sosc_hist_summarize(&state->stats.latency[i], &s);
+
+		lo_send_from(to, from, LO_TT_IMMEDIATE, "/sys/stats/latency",
+		             "shiiii", sosc_latency_path_name(i), (int64_t) s.count,
+		             s.p50, s.p99, s.p999, s.max);
+	}
+}
+
+static void
+info_reply_stats(lo_address *to, sosc_state_t *state)
+{
+	const uint8_t *stats = (const uint8_t *) &state->stats;
+	lo_server from = osc_reply_server(state, to);
+	uint64_t value, saved;
+	int i;
+
+	for (i = 0; i < sizeof(stats_counters) / sizeof(*stats_counters); i++) {
+		value = *(const uint64_t *) (stats + stats_counters[i].offset);
+
+		lo_send_from(to, from, LO_TT_IMMEDIATE, "/sys/stats", "sh",
+		             stats_counters[i].name, (int64_t) value);
+	}
+
+	/* a full repaint (after a rotation, say) writes more than was asked
+	 * for, so this can go negative. it's reported as 0 rather than wrap;
+	 * the two counters above have the whole story. */
+	saved = (state->stats.led_bytes_requested > state->stats.led_bytes_written)
+		? state->stats.led_bytes_requested - state->stats.led_bytes_written
+		: 0;
+
+	lo_send_from(to, from, LO_TT_IMMEDIATE, "/sys/stats", "sh",
+	             "led_bytes_saved", (int64_t) saved);
+
+	/* encoder deltas per /enc/delta sent, in thousandths */
+	if (state->stats.enc_deltas_sent)
+		lo_send_from(to, from, LO_TT_IMMEDIATE, "/sys/stats", "sh",
+		             "enc_coalescing_ratio_x1000",
+		             (int64_t) ((state->stats.enc_deltas_received * 1000)
+		                        / state->stats.enc_deltas_sent));
+
+	info_reply_latency(to, state);
+}
+
+DECLARE_INFO_HANDLERS(stats);
+
 /**/
 
 OSC_HANDLER_FUNC(sys_cable_legacy_handler)
@@ -173,6 +323,8 @@ OSC_HANDLER_FUNC(sys_cable_legacy_handler)
 		return 0;
 
 	monome_set_rotation(state->monome, new);
+	sosc_led_invalidate(state);
+
 	info_reply_rotation(state->outgoing, state);
 	return 0;
 }
@@ -189,10 +341,26 @@ OSC_HANDLER_FUNC(sys_rotation_handler)
 		return 0;
 
 	monome_set_rotation(state->monome, new);
+	sosc_led_invalidate(state);
+
 	info_reply_rotation(state->outgoing, state);
 	return 0;
 }
 
+/* the back buffer, echo ownership, animations and tiles are per client.
+ * whoever we're talking to now may well not know to commit, about the
+ * regions the last app claimed, to stop its animations, or that its tile
+ * numbers mean something already. only called when the destination has
+ * actually changed, apps send /sys/host and /sys/port on every start. */
+static void
+reset_client_state(sosc_state_t *state)
+{
+	sosc_led_set_back_buffered(state, 0);
+	sosc_led_echo_own(state, 0, 0, SOSC_LED_COLS_MAX, SOSC_LED_ROWS_MAX, 0);
+	sosc_anim_stop_all(state);
+	sosc_tile_forget_all(state);
+}
+
 OSC_HANDLER_FUNC(sys_port_handler)
 {
 	sosc_state_t *state = user_data;
@@ -201,12 +369,20 @@ OSC_HANDLER_FUNC(sys_port_handler)
 
 	portstr(port, argv[0]->i);
 
+	if (!strcmp(port, lo_address_get_port(old))) {
+		info_reply_port(old, state);
+		return 0;
+	}
+
 	if (!(new = lo_address_new(lo_address_get_hostname(old), port))) {
 		fprintf(stderr, "sys_port_handler(): error in lo_address_new()\n");
 		return 1;
 	}
 
 	state->outgoing = new;
+	osc_outgoing_resolve(state);
+
+	reset_client_state(state);
 
 	info_reply_port(old, state);
 	info_reply_port(new, state);
@@ -220,13 +396,30 @@ OSC_HANDLER_FUNC(sys_host_handler)
 {
 	sosc_state_t *state = user_data;
 	lo_address *new, *old = state->outgoing;
+	struct sockaddr_storage old_addr;
+	socklen_t old_addrlen;
+
+	if (!strcmp(&argv[0]->s, lo_address_get_hostname(old))) {
+		info_reply_host(old, state);
+		return 0;
+	}
 
 	if (!(new = lo_address_new(&argv[0]->s, lo_address_get_port(old)))) {
 		fprintf(stderr, "sys_host_handler(): error in lo_address_new()\n");
 		return 1;
 	}
 
+	old_addr = state->out.addr;
+	old_addrlen = state->out.addrlen;
+
 	state->outgoing = new;
+	osc_outgoing_resolve(state);
+
+	/* a different name for the same place (localhost and 127.0.0.1) is
+	 * still the same client */
+	if (!old_addrlen || old_addrlen != state->out.addrlen
+	    || memcmp(&old_addr, &state->out.addr, old_addrlen))
+		reset_client_state(state);
 
 	info_reply_host(old, state);
 	info_reply_host(new, state);
@@ -247,9 +440,10 @@ OSC_HANDLER_FUNC(sys_prefix_handler)
 	else
 		new = s_strdup(&argv[0]->s);
 
-	osc_unregister_methods(state);
 	state->config.app.osc_prefix = new;
-	osc_register_methods(state);
+	osc_dispatch_set_prefix(&state->dispatch, new);
+	osc_outgoing_build_templates(state);
+	osc_fastpath_build(state);
 
 	info_reply_prefix(state->outgoing, state);
 
@@ -258,18 +452,152 @@ OSC_HANDLER_FUNC(sys_prefix_handler)
 	return 0;
 }
 
+OSC_HANDLER_FUNC(sys_bundle_handler)
+{
+	sosc_state_t *state = user_data;
+
+	state->config.app.bundle_events = !!argv[0]->i;
+	return 0;
+}
+
+OSC_HANDLER_FUNC(sys_backbuffer_handler)
+{
+	sosc_state_t *state = user_data;
+
+	sosc_led_set_back_buffered(state, argv[0]->i);
+	return 0;
+}
+
+OSC_HANDLER_FUNC(sys_echo_handler)
+{
+	sosc_state_t *state = user_data;
+	int mode = argv[0]->i;
+
+	if (mode < 0 || mode >= SOSC_ECHO_MAX)
+		return 1;
+
+#ifdef WIN32
+	/* keys arrive on the serial thread there, away from the framebuffer,
+	 * see handle_press() in server.c */
+	if (mode != SOSC_ECHO_OFF) {
+		fprintf(stderr, "serialosc: local echo isn't available on windows\n");
+		return 1;
+	}
+#endif
+
+	state->config.dev.echo = mode;
+	sosc_led_echo_restore(state);
+	return 0;
+}
+
+OSC_HANDLER_FUNC(sys_echo_own_handler)
+{
+	sosc_state_t *state = user_data;
+
+	if (argv[0]->i < 0 || argv[1]->i < 0 || argv[2]->i < 0 || argv[3]->i < 0)
+		return 1;
+
+	sosc_led_echo_own(state, argv[0]->i, argv[1]->i, argv[2]->i,
+	                  argv[3]->i, 1);
+	return 0;
+}
+
+OSC_HANDLER_FUNC(sys_echo_release_handler)
+{
+	sosc_state_t *state = user_data;
+
+	if (argv[0]->i < 0 || argv[1]->i < 0 || argv[2]->i < 0 || argv[3]->i < 0)
+		return 1;
+
+	sosc_led_echo_own(state, argv[0]->i, argv[1]->i, argv[2]->i,
+	                  argv[3]->i, 0);
+	return 0;
+}
+
+OSC_HANDLER_FUNC(sys_echo_release_all_handler)
+{
+	sosc_state_t *state = user_data;
+
+	sosc_led_echo_own(state, 0, 0, SOSC_LED_COLS_MAX, SOSC_LED_ROWS_MAX, 0);
+	return 0;
+}
+
+OSC_HANDLER_FUNC(sys_subscribe_handler)
+{
+	sosc_state_t *state = user_data;
+	char port[6];
+
+	portstr(port, argv[1]->i);
+
+	return !!osc_subscribe(state, &argv[0]->s, port,
+	                       (argc > 2) ? &argv[2]->s : NULL);
+}
+
+/* a unix socket path, and optionally a prefix */
+OSC_HANDLER_FUNC(sys_subscribe_unix_handler)
+{
+	sosc_state_t *state = user_data;
+
+	return !!osc_subscribe(state, &argv[0]->s, NULL,
+	                       (argc > 1) ? &argv[1]->s : NULL);
+}
+
+OSC_HANDLER_FUNC(sys_unsubscribe_handler)
+{
+	sosc_state_t *state = user_data;
+	char port[6];
+
+	if (!argc) {
+		osc_unsubscribe_all(state);
+		return 0;
+	}
+
+	if (argc == 1)
+		return !!osc_unsubscribe(state, &argv[0]->s, NULL);
+
+	portstr(port, argv[1]->i);
+	return !!osc_unsubscribe(state, &argv[0]->s, port);
+}
+
+OSC_HANDLER_FUNC(sys_enc_window_handler)
+{
+	sosc_state_t *state = user_data;
+	unsigned n;
+
+	/* send anything held back for the old window now */
+	for (n = 0; n < SOSC_OSC_ENC_MAX; n++)
+		osc_enc_flush(state, n);
+
+	state->config.dev.enc_window = (argv[0]->i > 0) ? argv[0]->i : 0;
+	return 0;
+}
+
+OSC_HANDLER_FUNC(sys_refresh_handler)
+{
+	sosc_state_t *state = user_data;
+
+	state->config.dev.led_refresh_rate = (argv[0]->i > 0) ? argv[0]->i : 0;
+
+	/* don't leave anything waiting on a clock that's just changed */
+	if (state->led.flush_deadline)
+		sosc_led_flush(state);
+
+	return 0;
+}
+
 void
 osc_register_sys_methods(sosc_state_t *state)
 {
-	char *cmd;
+	const char *cmd;
 
 #define METHOD(path) for (cmd = "/sys/" path; cmd; cmd = NULL)
 #define REGISTER(types, handler, context) \
-	lo_server_add_method(state->server, cmd, types, handler, context)
+	osc_dispatch_add(&state->dispatch, cmd, types, handler, context)
 #define REGISTER_INFO_PROP(prop) do {\
 	METHOD("info/" #prop) {\
 		REGISTER("si", sys_info_##prop##_handler, state);\
 		REGISTER("i", sys_info_##prop##_handler, state);\
+		REGISTER("s", sys_info_##prop##_handler, state);\
 		REGISTER("", sys_info_##prop##_handler_default, state);\
 	} } while ( 0 )
 
@@ -279,13 +607,22 @@ osc_register_sys_methods(sosc_state_t *state)
 	REGISTER_INFO_PROP(port);
 	REGISTER_INFO_PROP(prefix);
 	REGISTER_INFO_PROP(rotation);
+	REGISTER_INFO_PROP(congestion);
 
 	METHOD("info") {
 		REGISTER("si", sys_info_handler, state);
 		REGISTER("i", sys_info_handler, state);
+		REGISTER("s", sys_info_handler, state);
 		REGISTER("", sys_info_handler_default, state);
 	}
 
+	METHOD("stats") {
+		REGISTER("si", sys_info_stats_handler, state);
+		REGISTER("i", sys_info_stats_handler, state);
+		REGISTER("s", sys_info_stats_handler, state);
+		REGISTER("", sys_info_stats_handler_default, state);
+	}
+
 	METHOD("cable")
 		REGISTER("s", sys_cable_legacy_handler, state);
 
@@ -301,6 +638,42 @@ osc_register_sys_methods(sosc_state_t *state)
 	METHOD("prefix")
 		REGISTER("s", sys_prefix_handler, state);
 
+	METHOD("bundle")
+		REGISTER("i", sys_bundle_handler, state);
+
+	METHOD("refresh")
+		REGISTER("i", sys_refresh_handler, state);
+
+	METHOD("backbuffer")
+		REGISTER("i", sys_backbuffer_handler, state);
+
+	METHOD("enc/window")
+		REGISTER("i", sys_enc_window_handler, state);
+
+	METHOD("subscribe") {
+		REGISTER("si", sys_subscribe_handler, state);
+		REGISTER("sis", sys_subscribe_handler, state);
+		REGISTER("s", sys_subscribe_unix_handler, state);
+		REGISTER("ss", sys_subscribe_unix_handler, state);
+	}
+
+	METHOD("unsubscribe") {
+		REGISTER("si", sys_unsubscribe_handler, state);
+		REGISTER("s", sys_unsubscribe_handler, state);
+		REGISTER("", sys_unsubscribe_handler, state);
+	}
+
+	METHOD("echo")
+		REGISTER("i", sys_echo_handler, state);
+
+	METHOD("echo/own")
+		REGISTER("iiii", sys_echo_own_handler, state);
+
+	METHOD("echo/release") {
+		REGISTER("iiii", sys_echo_release_handler, state);
+		REGISTER("", sys_echo_release_all_handler, state);
+	}
+
 #undef REGISTER
 #undef METHOD
 }
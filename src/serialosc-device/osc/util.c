@@ -39,3 +39,14 @@ osc_path(const char *path, const char *prefix)
 
 	return buf;
 }
+
+/* liblo won't send to a unix socket through a UDP server's socket, but
+ * given no server it connects one of the address's own */
+lo_server
+osc_reply_server(sosc_state_t *state, lo_address to)
+{
+	if (lo_address_get_protocol(to) == LO_UNIX)
+		return NULL;
+
+	return state->server;
+}
@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+
+#include <serialosc/serialosc.h>
+#include <serialosc/platform.h>
+#include <serialosc/led.h>
+#include <serialosc/anim.h>
+#include <serialosc/osc.h>
+
+/* the event loops block until there's input or until the earliest thing
+ * that wants doing at a particular time (the LED flush clock, an OSC
+ * bundle timetagged for the future, the next step of an animation, or
+ * encoder deltas held back for the accumulation window) comes due.
+ * deadlines are sosc_now_usec() values, 0 meaning "not scheduled". */
+
+static uint64_t
+earliest(uint64_t a, uint64_t b)
+{
+	if (!a || (b && b < a))
+		return b;
+
+	return a;
+}
+
+uint64_t
+sosc_scheduler_next_deadline(sosc_state_t *state)
+{
+	uint64_t deadline;
+
+	deadline = earliest(state->led.flush_deadline, osc_scheduled_next(state));
+	deadline = earliest(deadline, sosc_anim_next(state));
+
+	return earliest(deadline, osc_enc_next(state));
+}
+
+/* milliseconds until the next deadline, in the form poll() wants: -1 if
+ * nothing is scheduled and 0 if something is already due. rounded up so
+ * that we don't wake a little early and then spin until it's time. */
+int
+sosc_scheduler_timeout(sosc_state_t *state)
+{
+	uint64_t deadline, now;
+
+	if (!(deadline = sosc_scheduler_next_deadline(state)))
+		return -1;
+
+	now = sosc_now_usec();
+
+	if (deadline <= now)
+		return 0;
+
+	return (int) ((deadline - now + 999) / 1000);
+}
+
+void
+sosc_scheduler_run(sosc_state_t *state)
+{
+	uint64_t now = sosc_now_usec();
+
+	osc_scheduled_run(state, now);
+	osc_enc_run(state, now);
+	sosc_anim_run(state, now);
+	sosc_led_tick(state, now);
+}
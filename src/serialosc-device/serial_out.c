@@ -0,0 +1,339 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <monome.h>
+
+#include <serialosc/serialosc.h>
+#include <serialosc/serial_out.h>
+
+/* how long closing waits for the port to take what's still queued */
+#define DRAIN_TIMEOUT_MS 1000
+
+#define MEXT_LED_INTENSITY 0x17
+#define MEXT_TILT_ENABLE   0x82
+#define MEXT_TILT_DISABLE  0x83
+
+static void
+update_depth(sosc_state_t *state)
+{
+	struct sosc_serial_out *out = &state->serial_out;
+
+	state->stats.serial_out_queued = out->tail - out->head;
+
+	if (state->stats.serial_out_queued > state->stats.serial_out_queued_max)
+		state->stats.serial_out_queued_max = state->stats.serial_out_queued;
+}
+
+static void
+discard(sosc_state_t *state)
+{
+	struct sosc_serial_out *out = &state->serial_out;
+
+	state->stats.serial_out_bytes_dropped += out->tail - out->head;
+	out->head = out->tail = 0;
+	update_depth(state);
+}
+
+int
+sosc_serial_out_active(sosc_state_t *state)
+{
+	return state->serial_out.fd > -1;
+}
+
+size_t
+sosc_serial_out_pending(sosc_state_t *state)
+{
+	return state->serial_out.tail - state->serial_out.head;
+}
+
+size_t
+sosc_serial_out_space(sosc_state_t *state)
+{
+	return SOSC_SERIAL_OUT_SIZE - sosc_serial_out_pending(state);
+}
+
+uint8_t *
+sosc_serial_out_reserve(sosc_state_t *state, size_t nbytes)
+{
+	struct sosc_serial_out *out = &state->serial_out;
+	uint8_t *p;
+
+	if (nbytes > sosc_serial_out_space(state))
+		return NULL;
+
+	if (out->tail + nbytes > SOSC_SERIAL_OUT_SIZE) {
+		memmove(out->buf, out->buf + out->head, out->tail - out->head);
+		out->tail -= out->head;
+		out->head = 0;
+	}
+
+	p = out->buf + out->tail;
+	out->tail += nbytes;
+
+	update_depth(state);
+	return p;
+}
+
+/*************************************************************************
+ * commands
+ *************************************************************************/
+
+static int
+queue_command(sosc_state_t *state, uint8_t cmd, uint8_t arg)
+{
+	uint8_t *p;
+
+	if (!(p = sosc_serial_out_reserve(state, 2)))
+		return -1;
+
+	p[0] = cmd;
+	p[1] = arg;
+	return 0;
+}
+
+void
+sosc_serial_out_intensity(sosc_state_t *state, unsigned level)
+{
+	struct sosc_serial_out *out = &state->serial_out;
+
+	if (!queue_command(state, MEXT_LED_INTENSITY, level)) {
+		out->intensity = -1;
+		return;
+	}
+
+	if (out->intensity < 0)
+		state->stats.serial_out_commands_deferred++;
+
+	out->intensity = level;
+}
+
+int
+sosc_serial_out_tilt(sosc_state_t *state, unsigned sensor, int on)
+{
+	struct sosc_serial_out *out = &state->serial_out;
+	uint32_t bit;
+
+	if (!queue_command(state, on ? MEXT_TILT_ENABLE : MEXT_TILT_DISABLE,
+	                   sensor)) {
+		if (sensor < SOSC_SERIAL_OUT_TILT_MAX)
+			out->tilt_waiting &= ~(1U << sensor);
+
+		return 0;
+	}
+
+	if (sensor >= SOSC_SERIAL_OUT_TILT_MAX)
+		return -1;
+
+	bit = 1U << sensor;
+
+	if (!(out->tilt_waiting & bit))
+		state->stats.serial_out_commands_deferred++;
+
+	out->tilt_waiting |= bit;
+	out->tilt_on = on ? (out->tilt_on | bit) : (out->tilt_on & ~bit);
+	return 0;
+}
+
+/* ahead of any LED flush that's waiting, since these are one-offs and
+ * the flush will only be replaced by a later one */
+static void
+queue_waiting(sosc_state_t *state)
+{
+	struct sosc_serial_out *out = &state->serial_out;
+	uint32_t bit;
+	unsigned i;
+
+	if (out->intensity > -1
+	    && !queue_command(state, MEXT_LED_INTENSITY, out->intensity))
+		out->intensity = -1;
+
+	for (i = 0; out->tilt_waiting && i < SOSC_SERIAL_OUT_TILT_MAX; i++) {
+		bit = 1U << i;
+
+		if (!(out->tilt_waiting & bit))
+			continue;
+
+		if (queue_command(state, (out->tilt_on & bit)
+		                  ? MEXT_TILT_ENABLE : MEXT_TILT_DISABLE, i))
+			break;
+
+		out->tilt_waiting &= ~bit;
+	}
+}
+
+void
+sosc_serial_out_set_congested(sosc_state_t *state, int congested)
+{
+	if (state->serial_out.congested == congested)
+		return;
+
+	state->serial_out.congested = congested;
+
+	if (congested)
+		state->stats.serial_out_congestion_events++;
+
+	lo_send_from(state->outgoing, state->server, LO_TT_IMMEDIATE,
+	             "/sys/congestion", "i", congested);
+}
+
+#ifndef WIN32
+
+void
+sosc_serial_out_write(sosc_state_t *state)
+{
+	struct sosc_serial_out *out = &state->serial_out;
+	uint64_t start, elapsed;
+	ssize_t written;
+
+	while (out->head < out->tail) {
+		start = sosc_now_usec();
+		written = write(out->fd, out->buf + out->head, out->tail - out->head);
+		elapsed = sosc_now_usec() - start;
+
+		/* the fd is non-blocking, so this should only ever be the cost
+		 * of the copy into the tty layer */
+		state->stats.serial_out_write_usec += elapsed;
+		if (elapsed > state->stats.serial_out_write_usec_max)
+			state->stats.serial_out_write_usec_max = elapsed;
+
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				state->stats.serial_out_full++;
+				break;
+			}
+
+			/* the device is probably going away, in which case the
+			 * event loop is about to hear about it on the read side */
+			perror("sosc_serial_out_write()");
+			discard(state);
+			return;
+		}
+
+		out->head += written;
+		state->stats.serial_out_bytes += written;
+		state->stats.serial_out_writes++;
+	}
+
+	if (out->head == out->tail)
+		out->head = out->tail = 0;
+
+	update_depth(state);
+	queue_waiting(state);
+
+	/* a flush that was held back for want of room can go now */
+	if (state->led.waiting && sosc_serial_out_space(state)
+	    >= SOSC_LED_FLUSH_MAX + SOSC_SERIAL_OUT_RESERVE)
+		sosc_led_flush(state);
+
+	if (!sosc_serial_out_pending(state) && !state->led.waiting)
+		sosc_serial_out_set_congested(state, 0);
+}
+
+/* only on the way out, when there's no event loop left to hold up */
+static void
+drain(sosc_state_t *state)
+{
+	struct pollfd p = {
+		.fd = state->serial_out.fd,
+		.events = POLLOUT
+	};
+
+	while (sosc_serial_out_pending(state)) {
+		if (poll(&p, 1, DRAIN_TIMEOUT_MS) <= 0 || p.revents & (POLLERR | POLLHUP)) {
+			discard(state);
+			break;
+		}
+
+		sosc_serial_out_write(state);
+	}
+}
+
+void
+sosc_serial_out_open(sosc_state_t *state)
+{
+	struct sosc_serial_out *out = &state->serial_out;
+	const char *proto = monome_get_proto(state->monome);
+
+	out->fd = -1;
+	out->head = out->tail = 0;
+	out->congested = 0;
+	out->intensity = -1;
+	out->tilt_waiting = out->tilt_on = 0;
+
+	if (!proto || strcmp(proto, "mext"))
+		return;
+
+	/* a second open file description, so that O_NONBLOCK is ours alone
+	 * and libmonome's reads and writes behave as they always have */
+	out->fd = open(monome_get_devpath(state->monome),
+	               O_WRONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+	if (out->fd < 0)
+		fprintf(stderr, "serialosc [%s]: couldn't open %s for queued output, "
+		        "LED writes will block\n", monome_get_serial(state->monome),
+		        monome_get_devpath(state->monome));
+}
+
+void
+sosc_serial_out_close(sosc_state_t *state)
+{
+	if (state->serial_out.fd < 0)
+		return;
+
+	drain(state);
+	close(state->serial_out.fd);
+	state->serial_out.fd = -1;
+}
+
+#else
+
+/* the windows event loop runs serial I/O on its own thread, so LED writes
+ * there don't hold up anything else. */
+
+void
+sosc_serial_out_write(sosc_state_t *state)
+{
+}
+
+void
+sosc_serial_out_open(sosc_state_t *state)
+{
+	state->serial_out.fd = -1;
+	state->serial_out.head = state->serial_out.tail = 0;
+	state->serial_out.congested = 0;
+	state->serial_out.intensity = -1;
+	state->serial_out.tilt_waiting = state->serial_out.tilt_on = 0;
+}
+
+void
+sosc_serial_out_close(sosc_state_t *state)
+{
+}
+
+#endif
@@ -50,6 +50,23 @@ lo_error(int num, const char *error_msg, const char *path)
 	fflush(stderr);
 }
 
+/* liblo dispatches the messages in a bundle one at a time, so left to
+ * itself a bundled redraw would be flushed to the device piecemeal.
+ * hold the LED flush until the whole bundle has been through. */
+static int
+bundle_start_handler(lo_timetag time, void *user_data)
+{
+	sosc_led_begin(user_data);
+	return 0;
+}
+
+static int
+bundle_end_handler(void *user_data)
+{
+	sosc_led_end(user_data);
+	return 0;
+}
+
 static const char *
 null_if_zero(const char *s)
 {
@@ -66,48 +83,59 @@ static void
 handle_press(const monome_event_t *e, void *data)
 {
 	sosc_state_t *state = data;
-	char *cmd;
+	int32_t args[] = {
+		e->grid.x, e->grid.y, e->event_type == MONOME_BUTTON_DOWN
+	};
+
+	osc_send_event(state, SOSC_OSC_GRID_KEY, args);
+
+	sosc_hist_record(&state->stats.latency[SOSC_LATENCY_KEY],
+	                 sosc_now_usec() - state->in.serial_read_at);
 
-	cmd = osc_path("grid/key", state->config.app.osc_prefix);
-	lo_send_from(state->outgoing, state->server, LO_TT_IMMEDIATE, cmd, "iii",
-	             e->grid.x, e->grid.y, e->event_type == MONOME_BUTTON_DOWN);
-	s_free(cmd);
+#ifndef WIN32
+	/* the app hears about the key before the echo is drawn. on windows,
+	 * keys are handled on the serial thread, and the LED framebuffer
+	 * belongs to the OSC one */
+	sosc_led_echo_key(state, e->grid.x, e->grid.y,
+	                  e->event_type == MONOME_BUTTON_DOWN);
+#endif
 }
 
 static void
 handle_enc_delta(const monome_event_t *e, void *data)
 {
 	sosc_state_t *state = data;
-	char *cmd;
 
-	cmd = osc_path("enc/delta", state->config.app.osc_prefix);
-	lo_send_from(state->outgoing, state->server, LO_TT_IMMEDIATE, cmd, "ii",
-	             e->encoder.number, e->encoder.delta);
-	s_free(cmd);
+	osc_send_enc_delta(state, e->encoder.number, e->encoder.delta);
 }
 
 static void
 handle_enc_key(const monome_event_t *e, void *data)
 {
 	sosc_state_t *state = data;
-	char *cmd;
+	int32_t args[] = {
+		e->encoder.number, e->event_type == MONOME_ENCODER_KEY_DOWN
+	};
 
-	cmd = osc_path("enc/key", state->config.app.osc_prefix);
-	lo_send_from(state->outgoing, state->server, LO_TT_IMMEDIATE, cmd, "ii",
-	             e->encoder.number, e->event_type == MONOME_ENCODER_KEY_DOWN);
-	s_free(cmd);
+	osc_enc_flush(state, e->encoder.number);
+	osc_send_event(state, SOSC_OSC_ENC_KEY, args);
 }
 
 static void
 handle_tilt(const monome_event_t *e, void *data)
 {
 	sosc_state_t *state = data;
-	char *cmd;
 
-	cmd = osc_path("tilt", state->config.app.osc_prefix);
-	lo_send_from(state->outgoing, state->server, LO_TT_IMMEDIATE, cmd, "iiii",
-	             e->tilt.sensor, e->tilt.x, e->tilt.y, e->tilt.z);
-	s_free(cmd);
+	osc_send_tilt(state, e->tilt.sensor, e->tilt.x, e->tilt.y, e->tilt.z);
+}
+
+/* monome_event_handle_next(), noting when we went to read so that the
+ * handlers above can tell how long the event took to get out */
+int
+sosc_serial_handle_next(sosc_state_t *state)
+{
+	state->in.serial_read_at = sosc_now_usec();
+	return monome_event_handle_next(state->monome);
 }
 
 static void
@@ -158,6 +186,57 @@ send_osc_port_change(int fd, uint16_t port)
 
 	sosc_ipc_msg_write(fd, &msg);
 }
+
+static void
+send_unix_path(int fd, const char *path)
+{
+	sosc_ipc_msg_t msg = {
+		.type = SOSC_OSC_UNIX_PATH,
+	};
+
+	msg.unix_path.path = (char *) path;
+
+	sosc_ipc_msg_write(fd, &msg);
+}
+
+/* <config dir>/<serial>.sock, next to the preferences. it's read the
+ * same way as the UDP socket, so without receive buffers there's no
+ * unix socket. */
+static void
+open_unix_socket(sosc_state_t *state, const char *config_dir)
+{
+	char *default_dir = NULL;
+
+	if (!state->in.batch)
+		return;
+
+	if (!config_dir)
+		config_dir = default_dir = sosc_get_default_config_dir();
+
+	state->unix_sock.path = s_asprintf("%s/%s.sock", config_dir,
+	                                   monome_get_serial(state->monome));
+	s_free(default_dir);
+
+	if (!state->unix_sock.path)
+		return;
+
+	state->unix_sock.fd = sosc_dgram_unix_open(state->unix_sock.path);
+
+	if (state->unix_sock.fd < 0) {
+		s_free(state->unix_sock.path);
+		state->unix_sock.path = NULL;
+	}
+}
+
+static void
+close_unix_socket(sosc_state_t *state)
+{
+	sosc_dgram_unix_close(state->unix_sock.fd, state->unix_sock.path);
+	s_free(state->unix_sock.path);
+
+	state->unix_sock.fd = -1;
+	state->unix_sock.path = NULL;
+}
 #else
 /* windows. */
 static void
@@ -215,14 +294,39 @@ send_osc_port_change(int fd, uint16_t port)
 #endif
 
 void
-sosc_server_run(const char *config_dir, monome_t *monome)
+sosc_server_report_stats(sosc_state_t *state, uint32_t seq)
+{
+	sosc_ipc_msg_t msg = {
+		.type = SOSC_STATS_REPORT,
+	};
+	int i;
+
+	if (state->ipc_out_fd < 0)
+		return;
+
+	msg.stats.seq = seq;
+
+	for (i = 0; i < SOSC_LATENCY_MAX; i++)
+		sosc_hist_summarize(&state->stats.latency[i], &msg.stats.latency[i]);
+
+#ifdef WIN32
+	send_ipc_msg(&msg);
+#else
+	sosc_ipc_msg_write(state->ipc_out_fd, &msg);
+#endif
+}
+
+void
+sosc_server_run(const char *config_dir, int unix_socket, monome_t *monome)
 {
 	char *svc_name;
 	sosc_state_t state = {
 		.monome = monome,
 
 		.ipc_in_fd  = (!isatty(STDIN_FILENO))  ? STDIN_FILENO  : -1,
-		.ipc_out_fd = (!isatty(STDOUT_FILENO)) ? STDOUT_FILENO : -1
+		.ipc_out_fd = (!isatty(STDOUT_FILENO)) ? STDOUT_FILENO : -1,
+
+		.unix_sock.fd = -1
 	};
 
 	if (sosc_config_read(config_dir, monome_get_serial(state.monome), &state.config)) {
@@ -235,6 +339,9 @@ sosc_server_run(const char *config_dir, monome_t *monome)
 					lo_error)))
 		goto err_server_new;
 
+	lo_server_add_bundle_handlers(state.server,
+			bundle_start_handler, bundle_end_handler, &state);
+
 	if (!(state.outgoing = lo_address_new(
 				state.config.app.host, null_if_zero(state.config.app.port)))) {
 		fprintf(
@@ -243,6 +350,22 @@ sosc_server_run(const char *config_dir, monome_t *monome)
 		goto err_lo_addr;
 	}
 
+	osc_outgoing_resolve(&state);
+	osc_outgoing_build_templates(&state);
+	osc_fastpath_build(&state);
+
+	if (!(state.in.batch = sosc_dgram_batch_new()))
+		fprintf(
+			stderr, "serialosc [%s]: couldn't allocate receive buffers, "
+			"reading OSC one message at a time\n",
+			monome_get_serial(state.monome));
+
+#ifndef WIN32
+	/* -u doesn't go in the preferences, config.server.unix_socket does */
+	if (unix_socket || state.config.server.unix_socket)
+		open_unix_socket(&state, config_dir);
+#endif
+
 	svc_name = s_asprintf(
 		"%s (%s)", monome_get_friendly_name(state.monome),
 		monome_get_serial(state.monome));
@@ -282,19 +405,34 @@ sosc_server_run(const char *config_dir, monome_t *monome)
 #undef HANDLE
 
 	monome_set_rotation(state.monome, state.config.dev.rotation);
-	monome_led_all(state.monome, 0);
+	sosc_led_init(&state);
+	sosc_serial_out_open(&state);
 
+	osc_dispatch_init(&state.dispatch);
+	osc_dispatch_set_prefix(&state.dispatch, state.config.app.osc_prefix);
 	osc_register_sys_methods(&state);
 	osc_register_methods(&state);
 
+	/* whatever liblo dispatches itself comes through here too */
+	lo_server_add_method(state.server, NULL, NULL,
+			osc_dispatch_lo_handler, &state.dispatch);
+
 	if (state.ipc_out_fd < 0) {
 		fprintf(
 			stderr, "serialosc [%s]: connected, server running on port %d\n",
 			monome_get_serial(state.monome), lo_server_get_port(state.server));
+
+		if (state.unix_sock.path)
+			fprintf(stderr, "serialosc [%s]: and on %s\n",
+			        monome_get_serial(state.monome), state.unix_sock.path);
 	} else {
 		send_device_info(state.ipc_out_fd, monome);
 		send_osc_port_change(
 			state.ipc_out_fd, lo_server_get_port(state.server));
+#ifndef WIN32
+		if (state.unix_sock.path)
+			send_unix_path(state.ipc_out_fd, state.unix_sock.path);
+#endif
 		send_simple_ipc(state.ipc_out_fd, SOSC_DEVICE_READY);
 	}
 
@@ -303,6 +441,7 @@ sosc_server_run(const char *config_dir, monome_t *monome)
 
 	send_connection_status(&state, 1);
 	sosc_event_loop(&state);
+	sosc_serial_out_close(&state);
 	send_connection_status(&state, 0);
 
 	sosc_zeroconf_unregister(&state);
@@ -320,6 +459,14 @@ sosc_server_run(const char *config_dir, monome_t *monome)
 	}
 
 err_svc_name:
+	osc_unsubscribe_all(&state);
+#ifndef WIN32
+	close_unix_socket(&state);
+#endif
+	sosc_anim_stop_all(&state);
+	sosc_tile_forget_all(&state);
+	sosc_timer_wheel_clear(&state.in.scheduled);
+	sosc_dgram_batch_free(state.in.batch);
 	lo_address_free(state.outgoing);
 err_lo_addr:
 	lo_server_free(state.server);
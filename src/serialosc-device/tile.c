@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include <serialosc/serialosc.h>
+#include <serialosc/platform.h>
+#include <serialosc/led.h>
+#include <serialosc/tile.h>
+
+/* blits are drawn into the framebuffer like any other LED call, so they
+ * land in the back buffer if it's on, and the flush works out the
+ * cheapest way of getting them to the device, which for a tile that
+ * changes a handful of cells is a handful of level/set commands. */
+
+int
+sosc_tile_define(sosc_state_t *state, unsigned id, unsigned w, unsigned h,
+                 const uint8_t *data, size_t nbytes)
+{
+	struct sosc_tile *tile;
+	uint8_t *levels;
+	unsigned i;
+
+	if (id >= SOSC_TILE_MAX || !w || !h
+	    || w > SOSC_TILE_SIZE_MAX || h > SOSC_TILE_SIZE_MAX
+	    || nbytes != (w * h + 1) / 2)
+		return -1;
+
+	tile = &state->tiles.tile[id];
+
+	/* redefining a tile at the same size is common enough (a glyph
+	 * that changes now and then) to be worth not reallocating for */
+	if (tile->levels && tile->w * tile->h == w * h)
+		levels = tile->levels;
+	else if (!(levels = s_malloc(w * h)))
+		return -1;
+
+	for (i = 0; i < w * h; i++)
+		levels[i] = (data[i / 2] >> ((i & 1) ? 0 : 4)) & 0x0F;
+
+	if (levels != tile->levels)
+		s_free(tile->levels);
+
+	tile->w = w;
+	tile->h = h;
+	tile->levels = levels;
+	return 0;
+}
+
+/* anything further off the grid than this draws nothing anyway, and
+ * pulling it in keeps x + w from overflowing near INT_MIN/INT_MAX */
+static int
+clamp_origin(int v, int max)
+{
+	if (v < -SOSC_TILE_SIZE_MAX)
+		return -SOSC_TILE_SIZE_MAX;
+	if (v > max)
+		return max;
+	return v;
+}
+
+int
+sosc_tile_blit(sosc_state_t *state, unsigned id, int x, int y,
+               int transparent)
+{
+	struct sosc_tile *tile;
+	const uint8_t *row;
+	int i, j, i0, j0, i1, j1, drawn = 0;
+
+	if (id >= SOSC_TILE_MAX || !(tile = &state->tiles.tile[id])->levels)
+		return -1;
+
+	x = clamp_origin(x, SOSC_LED_COLS_MAX);
+	y = clamp_origin(y, SOSC_LED_ROWS_MAX);
+
+	/* the part of the tile that's on the grid */
+	i0 = (x < 0) ? -x : 0;
+	j0 = (y < 0) ? -y : 0;
+	i1 = (int) tile->w;
+	j1 = (int) tile->h;
+
+	if (x + i1 > SOSC_LED_COLS_MAX)
+		i1 = SOSC_LED_COLS_MAX - x;
+	if (y + j1 > SOSC_LED_ROWS_MAX)
+		j1 = SOSC_LED_ROWS_MAX - y;
+
+	for (j = j0; j < j1; j++) {
+		row = tile->levels + (j * tile->w);
+
+		for (i = i0; i < i1; i++) {
+			if (transparent && !row[i])
+				continue;
+
+			sosc_led_set(state, x + i, y + j, row[i]);
+			drawn++;
+		}
+	}
+
+	return drawn;
+}
+
+void
+sosc_tile_forget(sosc_state_t *state, unsigned id)
+{
+	struct sosc_tile *tile;
+
+	if (id >= SOSC_TILE_MAX)
+		return;
+
+	tile = &state->tiles.tile[id];
+
+	s_free(tile->levels);
+	memset(tile, 0, sizeof(*tile));
+}
+
+void
+sosc_tile_forget_all(sosc_state_t *state)
+{
+	unsigned i;
+
+	for (i = 0; i < SOSC_TILE_MAX; i++)
+		sosc_tile_forget(state, i);
+}
@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) 2010-2015 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include <serialosc/platform.h>
+#include <serialosc/timer_wheel.h>
+
+#define SLOT_MASK (SOSC_TIMER_WHEEL_SLOTS - 1)
+
+static uint64_t
+tick_of(uint64_t usec)
+{
+	return usec / SOSC_TIMER_WHEEL_TICK_USEC;
+}
+
+int
+sosc_timer_wheel_add(struct sosc_timer_wheel *wheel, uint64_t deadline,
+                     const void *data, size_t nbytes)
+{
+	struct sosc_timer *timer, **pos;
+
+	if (wheel->count >= SOSC_TIMER_WHEEL_MAX)
+		return -1;
+
+	if (!(timer = s_malloc(sizeof(*timer) + nbytes)))
+		return -1;
+
+	timer->deadline = deadline;
+	timer->nbytes = nbytes;
+	memcpy(timer->data, data, nbytes);
+
+	pos = &wheel->slots[tick_of(deadline) & SLOT_MASK];
+	while (*pos && (*pos)->deadline <= deadline)
+		pos = &(*pos)->next;
+
+	timer->next = *pos;
+	*pos = timer;
+
+	if (!wheel->count++ || tick_of(deadline) < wheel->cursor)
+		wheel->cursor = tick_of(deadline);
+
+	return 0;
+}
+
+/* walk forward from the cursor to the first slot with something due in
+ * that very tick. anything in a slot that's due a lap or more later sorts
+ * behind it, so only the head of each slot needs looking at. if a whole
+ * lap turns up nothing, everything is further out than that, and we take
+ * the smallest head the slow way. */
+static struct sosc_timer **
+find_next(struct sosc_timer_wheel *wheel)
+{
+	struct sosc_timer **head, **min = NULL;
+	uint64_t tick;
+	int i;
+
+	if (!wheel->count)
+		return NULL;
+
+	for (i = 0; i < SOSC_TIMER_WHEEL_SLOTS; i++) {
+		tick = wheel->cursor + i;
+		head = &wheel->slots[tick & SLOT_MASK];
+
+		if (*head && tick_of((*head)->deadline) == tick) {
+			wheel->cursor = tick;
+			return head;
+		}
+	}
+
+	for (i = 0; i < SOSC_TIMER_WHEEL_SLOTS; i++) {
+		head = &wheel->slots[i];
+
+		if (*head && (!min || (*head)->deadline < (*min)->deadline))
+			min = head;
+	}
+
+	wheel->cursor = tick_of((*min)->deadline);
+	return min;
+}
+
+uint64_t
+sosc_timer_wheel_next(struct sosc_timer_wheel *wheel)
+{
+	struct sosc_timer **head;
+
+	if (!(head = find_next(wheel)))
+		return 0;
+
+	return (*head)->deadline;
+}
+
+void
+sosc_timer_wheel_expire(struct sosc_timer_wheel *wheel, uint64_t now,
+                        sosc_timer_cb_t cb, void *ctx)
+{
+	struct sosc_timer **head, *timer;
+
+	while ((head = find_next(wheel)) && (*head)->deadline <= now) {
+		timer = *head;
+		*head = timer->next;
+		wheel->count--;
+
+		cb(ctx, timer);
+		s_free(timer);
+	}
+}
+
+void
+sosc_timer_wheel_clear(struct sosc_timer_wheel *wheel)
+{
+	struct sosc_timer *timer, *next;
+	int i;
+
+	for (i = 0; i < SOSC_TIMER_WHEEL_SLOTS; i++)
+		for (timer = wheel->slots[i]; timer; timer = next) {
+			next = timer->next;
+			s_free(timer);
+		}
+
+	memset(wheel, 0, sizeof(*wheel));
+}
@@ -18,6 +18,7 @@
 #include <unistd.h>
 #include <libgen.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <uv.h>
 #include <wwrl/vector_stdlib.h>
@@ -56,6 +57,7 @@ struct sosc_subprocess {
 	uv_pipe_t to_proc, from_proc;
 };
 
+/* an empty port means host is a unix socket path */
 struct sosc_notification_endpoint {
 	char host[128];
 	char port[6];
@@ -68,6 +70,7 @@ struct sosc_supervisor {
 	char *detector_exe_path;
 	char *device_exe_path;
 	char *config_dir;
+	int unix_socket;
 
 	struct sosc_subprocess detector;
 
@@ -79,11 +82,30 @@ struct sosc_supervisor {
 	struct {
 		lo_server *server;
 		uv_poll_t poll;
+		sosc_dgram_batch_t *batch;
+
+		/* the same methods, on <config dir>/serialoscd.sock if we were
+		 * started with -u. fd is -1 otherwise. */
+		struct {
+			int fd;
+			char *path;
+			uv_poll_t poll;
+		} unix_sock;
 	} osc;
 
 	VECTOR(sosc_notifications, struct sosc_notification_endpoint)
 		notifications;
 
+	/* the /serialosc/stats request in flight, if any. each device
+	 * that's been asked has dev->stats_seq == stats.seq until it
+	 * replies or goes away. */
+	struct {
+		uint32_t seq;
+		unsigned int outstanding;
+		lo_address dst;
+		struct sosc_latency_summary total[SOSC_LATENCY_MAX];
+	} stats;
+
 	uv_check_t drain_notifications;
 };
 
@@ -93,9 +115,11 @@ struct sosc_device_subprocess {
 
 	int ready;
 	int port;
+	uint32_t stats_seq;
 
 	char *serial;
 	char *friendly;
+	char *unix_path;
 };
 
 static int
@@ -333,6 +357,47 @@ portstr(char *dest, int src)
 	return snprintf(dest, 6, "%d", src);
 }
 
+/* requests carry a host and port to answer to or, from apps on this
+ * machine, a unix socket path */
+static lo_address
+reply_address(const char *types, lo_arg **argv)
+{
+	char port[6];
+
+	if (!strcmp(types, "s"))
+		return lo_address_new_with_proto(LO_UNIX, NULL, &argv[0]->s);
+
+	portstr(port, argv[1]->i);
+	return lo_address_new(&argv[0]->s, port);
+}
+
+/* liblo won't send to a unix socket through our UDP server's socket, but
+ * given no server it connects one of the address's own */
+static lo_server
+reply_server(struct sosc_supervisor *self, lo_address dst)
+{
+	if (lo_address_get_protocol(dst) == LO_UNIX)
+		return NULL;
+
+	return self->osc.server;
+}
+
+/* /serialosc/device, /add and /remove. anyone listening on a unix socket
+ * also gets the device's own socket path, or "" if it hasn't one. UDP
+ * clients don't: their "ssi" methods wouldn't match. */
+static void
+send_device(struct sosc_supervisor *self, lo_address dst, const char *path,
+		struct sosc_device_subprocess *dev)
+{
+	if (lo_address_get_protocol(dst) == LO_UNIX)
+		lo_send_from(dst, NULL, LO_TT_IMMEDIATE, path, "ssis",
+				dev->serial, dev->friendly, dev->port,
+				dev->unix_path ? dev->unix_path : "");
+	else
+		lo_send_from(dst, self->osc.server, LO_TT_IMMEDIATE, path, "ssi",
+				dev->serial, dev->friendly, dev->port);
+}
+
 struct walk_cb_args {
 	struct sosc_supervisor *self;
 	lo_address *dst;
@@ -354,20 +419,16 @@ list_devices_walk_cb(uv_handle_t *handle, void *_args)
 	if (!dev->ready)
 		return;
 
-	lo_send_from(dst, self->osc.server, LO_TT_IMMEDIATE, "/serialosc/device",
-			"ssi", dev->serial, dev->friendly, dev->port);
+	send_device(self, dst, "/serialosc/device", dev);
 }
 
 OSC_HANDLER_FUNC(osc_list_devices)
 {
 	struct sosc_supervisor *self = user_data;
 	struct walk_cb_args args;
-	char port[6];
-
-	portstr(port, argv[1]->i);
 
 	args.self = self;
-	args.dst  = lo_address_new(&argv[0]->s, port);
+	args.dst  = reply_address(types, argv);
 
 	if (!args.dst)
 		return 1;
@@ -378,13 +439,134 @@ OSC_HANDLER_FUNC(osc_list_devices)
 	return 0;
 }
 
+/* devices answer a stats request over IPC whenever they get to it, so
+ * /serialosc/stats replies with one /serialosc/stats per device and path
+ * as the answers come in, then a /serialosc/stats/total per path once
+ * every device that was asked has answered or disconnected. */
+
+static void
+stats_finish(struct sosc_supervisor *self)
+{
+	struct sosc_latency_summary *t;
+	int i;
+
+	if (!self->stats.dst)
+		return;
+
+	for (i = 0; i < SOSC_LATENCY_MAX; i++) {
+		t = &self->stats.total[i];
+
+		lo_send_from(self->stats.dst, reply_server(self, self->stats.dst),
+				LO_TT_IMMEDIATE, "/serialosc/stats/total", "shiiii",
+				sosc_latency_path_name(i), (int64_t) t->count,
+				t->p50, t->p99, t->p999, t->max);
+	}
+
+	lo_address_free(self->stats.dst);
+	self->stats.dst = NULL;
+}
+
+static void
+stats_device_done(struct sosc_supervisor *self,
+		struct sosc_device_subprocess *dev)
+{
+	if (!dev->stats_seq || dev->stats_seq != self->stats.seq)
+		return;
+
+	dev->stats_seq = 0;
+
+	if (!--self->stats.outstanding)
+		stats_finish(self);
+}
+
+static void
+stats_request_walk_cb(uv_handle_t *handle, void *_args)
+{
+	struct sosc_supervisor *self = _args;
+	struct sosc_device_subprocess *dev;
+	struct sosc_ipc_msg msg = {
+		.type = SOSC_STATS_REQUEST
+	};
+
+	if (handle->data != &device_type)
+		return;
+
+	dev = container_of(handle, struct sosc_device_subprocess, subprocess.proc);
+
+	if (!dev->ready)
+		return;
+
+	msg.stats.seq = self->stats.seq;
+	write_ipc_msg_to_stream((void *) &dev->subprocess.to_proc, &msg);
+
+	dev->stats_seq = self->stats.seq;
+	self->stats.outstanding++;
+}
+
+OSC_HANDLER_FUNC(osc_report_stats)
+{
+	struct sosc_supervisor *self = user_data;
+	lo_address dst;
+
+	if (!(dst = reply_address(types, argv)))
+		return 1;
+
+	/* a new request supersedes whatever was still in flight */
+	if (self->stats.dst)
+		lo_address_free(self->stats.dst);
+
+	self->stats.dst = dst;
+	self->stats.outstanding = 0;
+	memset(self->stats.total, 0, sizeof(self->stats.total));
+
+	/* 0 means "not asked" in dev->stats_seq */
+	if (!++self->stats.seq)
+		self->stats.seq++;
+
+	uv_walk(self->loop, stats_request_walk_cb, self);
+
+	if (!self->stats.outstanding)
+		stats_finish(self);
+
+	return 0;
+}
+
+static void
+handle_stats_report(struct sosc_supervisor *self,
+		struct sosc_device_subprocess *dev, struct sosc_ipc_msg *msg)
+{
+	struct sosc_latency_summary *s;
+	int i;
+
+	if (msg->stats.seq != self->stats.seq || dev->stats_seq != msg->stats.seq)
+		return;
+
+	for (i = 0; i < SOSC_LATENCY_MAX; i++) {
+		s = &msg->stats.latency[i];
+
+		lo_send_from(self->stats.dst, reply_server(self, self->stats.dst),
+				LO_TT_IMMEDIATE, "/serialosc/stats", "sshiiii", dev->serial,
+				sosc_latency_path_name(i), (int64_t) s->count,
+				s->p50, s->p99, s->p999, s->max);
+
+		sosc_latency_summary_merge(&self->stats.total[i], s);
+	}
+
+	stats_device_done(self, dev);
+}
+
 OSC_HANDLER_FUNC(osc_add_notification_endpoint)
 {
 	struct sosc_supervisor *self = user_data;
 	struct sosc_notification_endpoint n;
 
-	portstr(n.port, argv[1]->i);
-	sosc_strlcpy(n.host, &argv[0]->s, sizeof(n.host));
+	if (sosc_strlcpy(n.host, &argv[0]->s, sizeof(n.host)) >= sizeof(n.host))
+		return 1;
+
+	if (argc > 1)
+		portstr(n.port, argv[1]->i);
+	else
+		n.port[0] = '\0';
 
 	VECTOR_PUSH_BACK(&self->notifications, n);
 	return 0;
@@ -408,13 +590,11 @@ OSC_HANDLER_FUNC(osc_report_status)
 {
 	struct sosc_supervisor *self = user_data;
 	lo_address *dst;
-	char port[6];
 
-	portstr(port, argv[1]->i);
-	if (!(dst = lo_address_new(&argv[0]->s, port)))
+	if (!(dst = reply_address(types, argv)))
 		return 1;
 
-	lo_send_from(dst, self->osc.server, LO_TT_IMMEDIATE,
+	lo_send_from(dst, reply_server(self, dst), LO_TT_IMMEDIATE,
 			"/serialosc/status", "i", self->state);
 
 	lo_address_free(dst);
@@ -425,24 +605,39 @@ OSC_HANDLER_FUNC(osc_report_version)
 {
 	struct sosc_supervisor *self = user_data;
 	lo_address *dst;
-	char port[6];
 
-	portstr(port, argv[1]->i);
-	if (!(dst = lo_address_new(&argv[0]->s, port)))
+	if (!(dst = reply_address(types, argv)))
 		return 1;
 
-	lo_send_from(dst, self->osc.server, LO_TT_IMMEDIATE,
+	lo_send_from(dst, reply_server(self, dst), LO_TT_IMMEDIATE,
 			"/serialosc/version", "ss", VERSION, GIT_COMMIT);
 
 	lo_address_free(dst);
 	return 0;
 }
 
+static void
+osc_dispatch_cb(void *ctx, struct sosc_dgram *dgram)
+{
+	struct sosc_supervisor *self = ctx;
+	lo_server_dispatch_data(self->osc.server, dgram->data, dgram->nbytes);
+}
+
 static void
 osc_poll_cb(uv_poll_t *handle, int status, int events)
 {
 	SELF_FROM(handle, osc.poll);
-	lo_server_recv_noblock(self->osc.server, 0);
+
+	if (!self->osc.batch) {
+		lo_server_recv_noblock(self->osc.server, 0);
+		return;
+	}
+
+	/* whatever's left after the budget keeps the poll handle ready, so
+	 * we'll be back after libuv has had a look at everything else. */
+	sosc_dgram_recv(self->osc.batch,
+			lo_server_get_socket_fd(self->osc.server),
+			SOSC_OSC_RECV_BUDGET, osc_dispatch_cb, self, NULL);
 }
 
 static int
@@ -451,10 +646,15 @@ init_osc_server(struct sosc_supervisor *self)
 	if (!(self->osc.server = lo_server_new(SOSC_SUPERVISOR_OSC_PORT, NULL)))
 		return -1;
 
+	/* the "s" variants reply to a unix socket path */
 	lo_server_add_method(self->osc.server,
 			"/serialosc/list", "si", osc_list_devices, self);
+	lo_server_add_method(self->osc.server,
+			"/serialosc/list", "s", osc_list_devices, self);
 	lo_server_add_method(self->osc.server,
 			"/serialosc/notify", "si", osc_add_notification_endpoint, self);
+	lo_server_add_method(self->osc.server,
+			"/serialosc/notify", "s", osc_add_notification_endpoint, self);
 
 	lo_server_add_method(self->osc.server,
 			"/serialosc/enable", "", osc_handle_enable, self);
@@ -462,16 +662,81 @@ init_osc_server(struct sosc_supervisor *self)
 			"/serialosc/disable", "", osc_handle_disable, self);
 	lo_server_add_method(self->osc.server,
 			"/serialosc/status", "si", osc_report_status, self);
+	lo_server_add_method(self->osc.server,
+			"/serialosc/status", "s", osc_report_status, self);
 
 	lo_server_add_method(self->osc.server,
 			"/serialosc/version", "si", osc_report_version, self);
+	lo_server_add_method(self->osc.server,
+			"/serialosc/version", "s", osc_report_version, self);
+
+	lo_server_add_method(self->osc.server,
+			"/serialosc/stats", "si", osc_report_stats, self);
+	lo_server_add_method(self->osc.server,
+			"/serialosc/stats", "s", osc_report_stats, self);
 
 	uv_poll_init_socket(self->loop, &self->osc.poll,
 			lo_server_get_socket_fd(self->osc.server));
 
+	/* if this fails, osc_poll_cb() reads one datagram at a time */
+	self->osc.batch = sosc_dgram_batch_new();
+
 	return 0;
 }
 
+#ifndef WIN32
+static void
+unix_poll_cb(uv_poll_t *handle, int status, int events)
+{
+	SELF_FROM(handle, osc.unix_sock.poll);
+
+	sosc_dgram_recv(self->osc.batch, self->osc.unix_sock.fd,
+			SOSC_OSC_RECV_BUDGET, osc_dispatch_cb, self, NULL);
+}
+
+/* without the receive buffers, we'd have no way of reading it */
+static int
+init_unix_socket(struct sosc_supervisor *self)
+{
+	char *default_dir = NULL;
+	const char *dir;
+
+	if (!self->osc.batch)
+		return -1;
+
+	if (!(dir = self->config_dir))
+		dir = default_dir = sosc_get_default_config_dir();
+
+	self->osc.unix_sock.path = s_asprintf("%s/serialoscd.sock", dir);
+	s_free(default_dir);
+
+	if (!self->osc.unix_sock.path)
+		return -1;
+
+	self->osc.unix_sock.fd = sosc_dgram_unix_open(self->osc.unix_sock.path);
+
+	if (self->osc.unix_sock.fd < 0) {
+		s_free(self->osc.unix_sock.path);
+		self->osc.unix_sock.path = NULL;
+		return -1;
+	}
+
+	uv_poll_init_socket(self->loop, &self->osc.unix_sock.poll,
+			self->osc.unix_sock.fd);
+	uv_poll_start(&self->osc.unix_sock.poll, UV_READABLE, unix_poll_cb);
+
+	fprintf(stderr, "serialosc: listening on %s\n", self->osc.unix_sock.path);
+	return 0;
+}
+
+static void
+fini_unix_socket(struct sosc_supervisor *self)
+{
+	sosc_dgram_unix_close(self->osc.unix_sock.fd, self->osc.unix_sock.path);
+	s_free(self->osc.unix_sock.path);
+}
+#endif
+
 static void
 drain_notifications_cb(uv_check_t *handle)
 {
@@ -506,13 +771,17 @@ osc_notify(struct sosc_supervisor *self, struct sosc_device_subprocess *dev,
 	for (i = 0; i < self->notifications.size; i++) {
 		n = &self->notifications.data[i];
 
-		if (!(dst = lo_address_new(n->host, n->port))) {
+		if (*n->port)
+			dst = lo_address_new(n->host, n->port);
+		else
+			dst = lo_address_new_with_proto(LO_UNIX, NULL, n->host);
+
+		if (!dst) {
 			fprintf(stderr, "notify(): couldn't allocate lo_address\n");
 			continue;
 		}
 
-		lo_send_from(dst, self->osc.server, LO_TT_IMMEDIATE, path, "ssi",
-		             dev->serial, dev->friendly, dev->port);
+		send_device(self, dst, path, dev);
 
 		lo_address_free(dst);
 	}
@@ -531,16 +800,22 @@ static int
 device_init(struct sosc_supervisor *self, struct sosc_device_subprocess *dev,
 		char *devnode)
 {
-	char *device_args_config_dir[] = {self->device_exe_path, "-c", self->config_dir, devnode, NULL};
-	char *device_args_no_config_dir[] = {self->device_exe_path, devnode, NULL};
-	char **device_args;
+	char *device_args[6], **arg = device_args;
+
+	*arg++ = self->device_exe_path;
 
 	if (self->config_dir != NULL) {
-		device_args = device_args_config_dir;
-	} else {
-		device_args = device_args_no_config_dir;
+		*arg++ = "-c";
+		*arg++ = self->config_dir;
 	}
 
+	/* and -u goes for the devices too */
+	if (self->unix_socket)
+		*arg++ = "-u";
+
+	*arg++ = devnode;
+	*arg = NULL;
+
 	if (launch_subprocess(self, &dev->subprocess, self->device_exe_path,
 				device_exit_cb, device_args))
 		return -1;
@@ -555,6 +830,7 @@ device_fini(struct sosc_device_subprocess *dev)
 {
 	s_free(dev->serial);
 	s_free(dev->friendly);
+	s_free(dev->unix_path);
 }
 
 static void
@@ -585,6 +861,8 @@ device_exit_cb(uv_process_t *process, int64_t exit_status, int term_signal)
 		osc_notify(dev->supervisor, dev, SOSC_DEVICE_DISCONNECTION);
 	}
 
+	stats_device_done(dev->supervisor, dev);
+
 	uv_close((void *) &dev->subprocess.to_proc, NULL);
 	uv_close((void *) &dev->subprocess.from_proc, device_pipe_close_cb);
 }
@@ -600,12 +878,21 @@ handle_device_msg(struct sosc_supervisor *self,
 	switch (msg->type) {
 	case SOSC_DEVICE_CONNECTION:
 	case SOSC_PROCESS_SHOULD_EXIT:
+	case SOSC_STATS_REQUEST:
 		return -1;
 
+	case SOSC_STATS_REPORT:
+		handle_stats_report(self, dev, msg);
+		return 0;
+
 	case SOSC_OSC_PORT_CHANGE:
 		dev->port = msg->port_change.port;
 		return 0;
 
+	case SOSC_OSC_UNIX_PATH:
+		dev->unix_path = msg->unix_path.path;
+		return 0;
+
 	case SOSC_DEVICE_INFO:
 		dev->serial   = msg->device_info.serial;
 		dev->friendly = msg->device_info.friendly;
@@ -673,10 +960,13 @@ handle_detector_msg(struct sosc_supervisor *self,
 		return ret;
 
 	case SOSC_OSC_PORT_CHANGE:
+	case SOSC_OSC_UNIX_PATH:
 	case SOSC_DEVICE_INFO:
 	case SOSC_DEVICE_READY:
 	case SOSC_DEVICE_DISCONNECTION:
+	case SOSC_STATS_REPORT:
 	case SOSC_PROCESS_SHOULD_EXIT:
+	case SOSC_STATS_REQUEST:
 		return -1;
 	}
 
@@ -763,11 +1053,13 @@ main(int argc, char **argv)
 #endif
 {
 	struct sosc_supervisor self = {NULL};
+	self.osc.unix_sock.fd = -1;
 
 	int opt, longindex;
 	struct optparse options;
 	struct optparse_long longopts[] = {
 		{"config-dir", 'c', OPTPARSE_REQUIRED},
+		{"unix-socket", 'u', OPTPARSE_NONE},
 		{"version", 'v', OPTPARSE_NONE},
 		{0, 0, 0}
 	};
@@ -783,6 +1075,9 @@ main(int argc, char **argv)
 		case 'c':
 			self.config_dir = options.optarg;
 			break;
+		case 'u':
+			self.unix_socket = 1;
+			break;
 		default:
 			fprintf(stderr, "%s: %s\n", argv[0], options.errmsg);
 			return EXIT_FAILURE;
@@ -813,6 +1108,12 @@ main(int argc, char **argv)
 	if (init_osc_server(&self))
 		goto err_osc_server;
 
+#ifndef WIN32
+	if (self.unix_socket && init_unix_socket(&self))
+		fprintf(stderr, "serialosc: couldn't open a unix socket, "
+				"carrying on without\n");
+#endif
+
 	if (supervisor_enable(&self))
 		goto err_enable;
 
@@ -824,17 +1125,30 @@ main(int argc, char **argv)
 	uv_close((void *) &self.drain_notifications, NULL);
 	uv_close((void *) &self.state_change.check, NULL);
 
+#ifndef WIN32
+	if (self.osc.unix_sock.fd > -1)
+		uv_close((void *) &self.osc.unix_sock.poll, NULL);
+#endif
+
 	/* run once more to make sure libuv cleans up any internal resources. */
 	uv_run(self.loop, UV_RUN_NOWAIT);
 
 	VECTOR_FREE(&self.notifications);
 	uv_loop_close(self.loop);
 
+#ifndef WIN32
+	fini_unix_socket(&self);
+#endif
+
 	free_paths(&self);
 
 	return 0;
 
 err_enable:
+#ifndef WIN32
+	fini_unix_socket(&self);
+#endif
+	sosc_dgram_batch_free(self.osc.batch);
 	lo_server_free(self.osc.server);
 err_osc_server:
 	uv_loop_close(self.loop);